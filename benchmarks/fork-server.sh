@@ -0,0 +1,78 @@
+#!/bin/bash
+set -e
+
+if [ $# -lt 5 ]; then
+  echo "Usage: $0 <kompiled-dir> <fork-server> <rounds> <sort> <pgm.kore>..."
+  echo 'Runs each <pgm.kore>, a KORE term of sort <sort>, as the $PGM of the'
+  echo 'definition in <kompiled-dir> <rounds> times, once by invoking llvm-krun'
+  echo 'for every program, and once by sending all of them to a single'
+  echo '<fork-server> (built with "fork-server") whose base configuration binds'
+  echo '$PGM to a variable, and reports the throughput of both.'
+  exit 1
+fi
+dir="$1"
+server="$2"
+rounds="$3"
+sort="$4"
+shift; shift; shift; shift
+inputs=("$@")
+krun="$(dirname "$0")/../bin/llvm-krun"
+if ! [ -x "$krun" ]; then
+  krun=llvm-krun
+fi
+
+base="$(mktemp tmp.base.XXXXXXXXXX)"
+requests="$(mktemp tmp.fork-server.XXXXXXXXXX)"
+trap 'rm -f "$base" "$requests"' INT TERM EXIT
+
+# writes its argument as a 64-bit little-endian integer.
+le64() {
+  local i
+  for i in 0 1 2 3 4 5 6 7; do
+    printf "\\x$(printf %02x $(( ($1 >> (8 * i)) & 255 )))"
+  done
+}
+
+# writes its argument preceded by its length in bytes.
+field() {
+  local LC_ALL=C
+  le64 "${#1}"
+  printf %s "$1"
+}
+
+"$krun" -d "$dir" --dry-run -nm -c PGM 'VarPGM:SortKItem{}' KItem kore -o "$base"
+
+: > "$requests"
+for ((r = 0; r < rounds; r++)); do
+  for input in "${inputs[@]}"; do
+    if [ "$sort" = KItem ]; then
+      value="$(cat "$input")"
+    else
+      value="inj{Sort$sort{}, SortKItem{}}($(cat "$input"))"
+    fi
+    le64 1 >> "$requests"
+    field VarPGM >> "$requests"
+    field "$value" >> "$requests"
+  done
+done
+count=$((rounds * ${#inputs[@]}))
+
+now() {
+  date +%s.%N
+}
+
+start="$(now)"
+for ((r = 0; r < rounds; r++)); do
+  for input in "${inputs[@]}"; do
+    "$krun" -d "$dir" -c PGM "$input" "$sort" korefile -o /dev/null > /dev/null 2>&1 || true
+  done
+done
+krunTime="$(awk -v s="$start" -v e="$(now)" 'BEGIN { printf "%.3f", e - s }')"
+
+start="$(now)"
+"$server" -1 "$base" < "$requests" > /dev/null
+forkTime="$(awk -v s="$start" -v e="$(now)" 'BEGIN { printf "%.3f", e - s }')"
+
+printf "%-20s %10s %12s %14s\n" mode requests "time (s)" "requests/s"
+printf "%-20s %10s %12s %14s\n" "llvm-krun" "$count" "$krunTime" "$(awk -v n="$count" -v t="$krunTime" 'BEGIN { printf "%.1f", n / t }')"
+printf "%-20s %10s %12s %14s\n" "fork-server" "$count" "$forkTime" "$(awk -v n="$count" -v t="$forkTime" 'BEGIN { printf "%.1f", n / t }')"
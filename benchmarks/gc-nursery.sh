@@ -0,0 +1,39 @@
+#!/bin/bash
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <interpreter> <input.kore> [depth] [interval]"
+  echo 'Runs <interpreter> on <input.kore> and reports how the size of the young'
+  echo 'generation and the frequency of garbage collections evolve over time, in'
+  echo 'intervals of <interval> collections (100 by default). Set KLLVM_NURSERY_MAX'
+  echo 'to compare against a capped young generation.'
+  exit 1
+fi
+interpreter="$1"
+input="$2"
+depth="${3:--1}"
+interval="${4:-100}"
+
+log="$(mktemp tmp.gc.XXXXXXXXXX)"
+trap 'rm -f "$log"' INT TERM EXIT
+
+KLLVM_GC_PAUSE_LOG="$log" "$interpreter" "$input" "$depth" /dev/null > /dev/null || true
+
+awk -v interval="$interval" '
+  NR == 1 {
+    start = last = $6 - $2
+    printf "%12s %10s %12s %12s %12s %11s\n", "collections", "time (s)", "nursery (MB)", "GCs/s", "pause (ms)", "survival"
+  }
+  {
+    n++; pause += $2; total += $2; alloc += $4; surv += $5
+    if ($2 > max) max = $2
+    if (n % interval == 0) {
+      elapsed = ($6 - last) / 1e9
+      printf "%12d %10.3f %12.1f %12.1f %12.3f %10.1f%%\n", n, ($6 - start) / 1e9, $3 / 1048576,
+        (elapsed > 0 ? interval / elapsed : 0), pause / interval / 1e6, (alloc ? 100 * surv / alloc : 0)
+      last = $6; pause = 0; alloc = 0; surv = 0
+    }
+  }
+  END {
+    if (n) printf "\n%d collections, %.3f ms total, %.3f ms mean, %.3f ms max\n", n, total / 1e6, total / n / 1e6, max / 1e6
+  }' "$log"
@@ -0,0 +1,50 @@
+#!/bin/bash
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <interpreter> <input.kore> [depth] [runs]"
+  echo 'Runs <interpreter> on <input.kore> with the garbage collector scanning'
+  echo 'copied objects in breadth-first and in depth-first order, and reports'
+  echo 'the number of rewrite steps per second and, if perf is available, the'
+  echo 'number of last level cache misses. Each configuration is run <runs> times'
+  echo '(3 by default) and the fastest run is reported.'
+  exit 1
+fi
+interpreter="$1"
+input="$2"
+depth="${3:--1}"
+runs="${4:-3}"
+
+tmp="$(mktemp -d tmp.gc.XXXXXXXXXX)"
+trap 'rm -rf "$tmp"' INT TERM EXIT
+
+perf=
+if command -v perf > /dev/null && perf stat -e LLC-load-misses true > /dev/null 2>&1; then
+  perf=1
+fi
+
+printf "%-14s %12s %12s %14s %16s\n" order steps "time (s)" "steps/s" "LLC misses"
+for order in breadth-first depth-first; do
+  best=
+  for ((i = 0; i < runs; i++)); do
+    start="$(date +%s%N)"
+    if [ -n "$perf" ]; then
+      KLLVM_GC_ORDER="$order" perf stat -x, -e LLC-load-misses -o "$tmp/perf" \
+        "$interpreter" "$input" "$depth" "$tmp/out" --statistics > /dev/null || true
+    else
+      KLLVM_GC_ORDER="$order" "$interpreter" "$input" "$depth" "$tmp/out" --statistics > /dev/null || true
+    fi
+    end="$(date +%s%N)"
+    elapsed=$((end - start))
+    if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+      best="$elapsed"
+      steps="$(head -n 1 "$tmp/out")"
+      misses=-
+      if [ -n "$perf" ]; then
+        misses="$(awk -F, '/LLC-load-misses/ { print $1 }' "$tmp/perf")"
+      fi
+    fi
+  done
+  awk -v o="$order" -v s="$steps" -v t="$best" -v m="$misses" 'BEGIN {
+    printf "%-14s %12d %12.3f %14.0f %16s\n", o, s, t / 1e9, s / (t / 1e9), m }'
+done
@@ -0,0 +1,44 @@
+#!/bin/bash
+set -e
+
+if [ "$1" = "-h" ] || [ "$1" = "--help" ]; then
+  echo "Usage: $0 [definition.kore...]"
+  echo 'Compiles each definition (every definition of test/defn with an input'
+  echo 'in test/input by default) and runs it on its input once with the'
+  echo 'adaptive and once with the fixed old generation collection policy,'
+  echo 'reporting the total garbage collection time and the peak RSS.'
+  exit 1
+fi
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+defns=("$@")
+if [ ${#defns[@]} -eq 0 ]; then
+  defns=("$root"/test/defn/*.kore)
+fi
+
+tmp="$(mktemp -d tmp.gc.XXXXXXXXXX)"
+trap 'rm -rf "$tmp"' INT TERM EXIT
+
+printf "%-28s %-10s %12s %12s %12s %14s\n" definition policy collections full "total (ms)" "peak RSS (KB)"
+for defn in "${defns[@]}"; do
+  name="$(basename "$defn" .kore)"
+  input="$root/test/input/$name.in.kore"
+  if [ ! -f "$input" ]; then
+    continue
+  fi
+  llvm-kompile-testing "$defn" main -o "$tmp/$name.interpreter" > /dev/null
+  stdin="$root/test/input/$name.stdin.txt"
+  if [ ! -f "$stdin" ]; then
+    stdin=/dev/null
+  fi
+  for policy in adaptive fixed; do
+    : > "$tmp/log"
+    KLLVM_GC_POLICY="$policy" KLLVM_GC_PAUSE_LOG="$tmp/log" /usr/bin/time -f %M -o "$tmp/rss" \
+      "$tmp/$name.interpreter" "$input" -1 /dev/null < "$stdin" > /dev/null 2>&1 || true
+    rss="$(tail -n 1 "$tmp/rss")"
+    read -r count full total <<< "$(awk '
+      { n++; t += $2; if ($1 == 1) f++ }
+      END { printf "%d %d %.3f", n, f, t / 1e6 }' "$tmp/log")"
+    printf "%-28s %-10s %12s %12s %12s %14s\n" "$name" "$policy" "$count" "$full" "$total" "$rss"
+  done
+done
@@ -0,0 +1,35 @@
+#!/bin/bash
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <interpreter> <input.kore> [depth] [threads...]"
+  echo 'Runs <interpreter> on <input.kore> once for each number of GC threads'
+  echo '(1 2 4 8 16 by default) and reports the garbage collection pause times.'
+  exit 1
+fi
+interpreter="$1"
+input="$2"
+depth="${3:--1}"
+shift; shift; shift || true
+threads=("$@")
+if [ ${#threads[@]} -eq 0 ]; then
+  threads=(1 2 4 8 16)
+fi
+
+log="$(mktemp tmp.gc.XXXXXXXXXX)"
+trap 'rm -f "$log"' INT TERM EXIT
+
+printf "%8s %12s %12s %12s %12s %10s\n" threads collections "total (ms)" "max (ms)" "full (ms)" speedup
+base=
+for n in "${threads[@]}"; do
+  : > "$log"
+  KLLVM_GC_THREADS="$n" KLLVM_GC_PAUSE_LOG="$log" "$interpreter" "$input" "$depth" /dev/null > /dev/null || true
+  read -r count total max full <<< "$(awk '
+    { n++; t += $2; if ($2 > m) m = $2; if ($1 == 1) f += $2 }
+    END { printf "%d %.3f %.3f %.3f", n, t / 1e6, m / 1e6, f / 1e6 }' "$log")"
+  if [ -z "$base" ]; then
+    base="$total"
+  fi
+  speedup="$(awk -v b="$base" -v t="$total" 'BEGIN { if (t > 0) printf "%.2fx", b / t; else print "-" }')"
+  printf "%8s %12s %12s %12s %12s %10s\n" "$n" "$count" "$total" "$max" "$full" "$speedup"
+done
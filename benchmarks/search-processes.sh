@@ -0,0 +1,57 @@
+#!/bin/bash
+set -e
+
+if [ $# -lt 3 ]; then
+  echo "Usage: $0 <interpreter> <input.kore> <depth> [processes...]"
+  echo 'Runs <interpreter> (built with "search") on <input.kore> split between'
+  echo 'each number of local processes (1 2 4 8 by default), connected by Unix'
+  echo 'domain sockets, reports the time taken and the speedup over the first,'
+  echo 'and checks that every run finds as many states as the first. The'
+  echo 'results of a distributed search come in no particular order, so only'
+  echo 'their number of states is compared.'
+  exit 1
+fi
+interpreter="$1"
+input="$2"
+depth="$3"
+shift; shift; shift
+processes=("$@")
+if [ ${#processes[@]} -eq 0 ]; then
+  processes=(1 2 4 8)
+fi
+
+output="$(mktemp tmp.search.XXXXXXXXXX)"
+summary="$(mktemp tmp.search.XXXXXXXXXX)"
+sockets="$(mktemp -d tmp.search.XXXXXXXXXX)"
+trap 'rm -rf "$output" "$summary" "$sockets"' INT TERM EXIT
+
+now() {
+  date +%s.%N
+}
+
+printf "%10s %12s %10s %10s\n" processes "time (s)" speedup states
+base=
+expected=
+for n in "${processes[@]}"; do
+  addresses="unix:$sockets/0"
+  for ((i = 1; i < n; i++)); do
+    addresses="$addresses,unix:$sockets/$i"
+  done
+  : > "$output"
+  start="$(now)"
+  for ((i = 1; i < n; i++)); do
+    "$interpreter" "$input" "$depth" /dev/null --visited exact --processes "$addresses" --process $i 2> /dev/null &
+  done
+  "$interpreter" "$input" "$depth" "$output" --visited exact --processes "$addresses" --process 0 2> "$summary"
+  wait
+  time="$(awk -v s="$start" -v e="$(now)" 'BEGIN { printf "%.3f", e - s }')"
+  states="$(awk '/^states:/ { print $2 }' "$summary")"
+  if [ -z "$base" ]; then
+    base="$time"
+    expected="$states"
+  elif [ "$states" != "$expected" ]; then
+    states="$states DIFFERENT"
+  fi
+  speedup="$(awk -v b="$base" -v t="$time" 'BEGIN { if (t > 0) printf "%.2fx", b / t; else print "-" }')"
+  printf "%10s %12s %10s %10s\n" "$n" "$time" "$speedup" "$states"
+done
@@ -0,0 +1,47 @@
+#!/bin/bash
+set -e
+
+if [ $# -lt 3 ]; then
+  echo "Usage: $0 <interpreter> <input.kore> <depth> [threads...]"
+  echo 'Runs <interpreter> (built with "search") on <input.kore> once for each'
+  echo 'number of search threads (1 2 4 8 16 32 by default), reports the time'
+  echo 'taken and the speedup over the first, and checks that every run finds'
+  echo 'the same states as the first.'
+  exit 1
+fi
+interpreter="$1"
+input="$2"
+depth="$3"
+shift; shift; shift
+threads=("$@")
+if [ ${#threads[@]} -eq 0 ]; then
+  threads=(1 2 4 8 16 32)
+fi
+
+expected="$(mktemp tmp.search.XXXXXXXXXX)"
+actual="$(mktemp tmp.search.XXXXXXXXXX)"
+trap 'rm -f "$expected" "$actual"' INT TERM EXIT
+
+now() {
+  date +%s.%N
+}
+
+printf "%8s %12s %10s %10s\n" threads "time (s)" speedup results
+base=
+for n in "${threads[@]}"; do
+  : > "$actual"
+  start="$(now)"
+  KLLVM_SEARCH_THREADS="$n" "$interpreter" "$input" "$depth" "$actual" > /dev/null
+  time="$(awk -v s="$start" -v e="$(now)" 'BEGIN { printf "%.3f", e - s }')"
+  if [ -z "$base" ]; then
+    base="$time"
+    cp "$actual" "$expected"
+    results=ok
+  elif cmp -s "$expected" "$actual"; then
+    results=ok
+  else
+    results=DIFFERENT
+  fi
+  speedup="$(awk -v b="$base" -v t="$time" 'BEGIN { if (t > 0) printf "%.2fx", b / t; else print "-" }')"
+  printf "%8s %12s %10s %10s\n" "$n" "$time" "$speedup" "$results"
+done
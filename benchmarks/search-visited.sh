@@ -0,0 +1,38 @@
+#!/bin/bash
+set -e
+
+if [ $# -lt 3 ]; then
+  echo "Usage: $0 <interpreter> <input.kore> <depth> [mode...]"
+  echo 'Runs <interpreter> (built with "search") on <input.kore> once for each'
+  echo 'visited set mode (exact fingerprint64 fingerprint128 bitstate:16M by'
+  echo 'default) and reports the states found per second, the peak resident'
+  echo 'set size and the estimated probability that states were omitted.'
+  exit 1
+fi
+interpreter="$1"
+input="$2"
+depth="$3"
+shift; shift; shift
+modes=("$@")
+if [ ${#modes[@]} -eq 0 ]; then
+  modes=(exact fingerprint64 fingerprint128 bitstate:16M)
+fi
+
+summary="$(mktemp tmp.search.XXXXXXXXXX)"
+trap 'rm -f "$summary"' INT TERM EXIT
+
+now() {
+  date +%s.%N
+}
+
+printf "%-16s %10s %10s %12s %14s %12s\n" mode states "time (s)" "states/s" "peak RSS (KB)" omission
+for mode in "${modes[@]}"; do
+  start="$(now)"
+  "$interpreter" "$input" "$depth" /dev/null --visited "$mode" > /dev/null 2> "$summary"
+  time="$(awk -v s="$start" -v e="$(now)" 'BEGIN { printf "%.3f", e - s }')"
+  states="$(awk '/^states:/ { print $2 }' "$summary")"
+  rss="$(awk '/^peak resident set size:/ { print $5 }' "$summary")"
+  omission="$(awk '/^estimated omission probability:/ { print $4 }' "$summary")"
+  rate="$(awk -v n="$states" -v t="$time" 'BEGIN { if (t > 0) printf "%.0f", n / t; else print "-" }')"
+  printf "%-16s %10s %10s %12s %14s %12s\n" "$mode" "$states" "$time" "$rate" "$rss" "$omission"
+done
@@ -0,0 +1,56 @@
+#!/bin/bash
+set -e
+
+if [ $# -lt 4 ]; then
+  echo "Usage: $0 <interpreter> <server> <rounds> <input.kore>..."
+  echo 'Rewrites each <input.kore> <rounds> times, once by starting <interpreter>'
+  echo '(built with "main") for every input, and once by sending all of them to'
+  echo 'a single <server> (built with "server") on its stdin, and reports the'
+  echo 'throughput of both.'
+  exit 1
+fi
+interpreter="$1"
+server="$2"
+rounds="$3"
+shift; shift; shift
+inputs=("$@")
+
+requests="$(mktemp tmp.server.XXXXXXXXXX)"
+trap 'rm -f "$requests"' INT TERM EXIT
+
+# writes its argument as a 64-bit little-endian integer.
+le64() {
+  local i
+  for i in 0 1 2 3 4 5 6 7; do
+    printf "\\x$(printf %02x $(( ($1 >> (8 * i)) & 255 )))"
+  done
+}
+
+: > "$requests"
+for ((r = 0; r < rounds; r++)); do
+  for input in "${inputs[@]}"; do
+    le64 "$(wc -c < "$input")" >> "$requests"
+    cat "$input" >> "$requests"
+  done
+done
+count=$((rounds * ${#inputs[@]}))
+
+now() {
+  date +%s.%N
+}
+
+start="$(now)"
+for ((r = 0; r < rounds; r++)); do
+  for input in "${inputs[@]}"; do
+    "$interpreter" "$input" -1 /dev/null > /dev/null 2>&1 || true
+  done
+done
+processes="$(awk -v s="$start" -v e="$(now)" 'BEGIN { printf "%.3f", e - s }')"
+
+start="$(now)"
+"$server" -1 < "$requests" > /dev/null
+single="$(awk -v s="$start" -v e="$(now)" 'BEGIN { printf "%.3f", e - s }')"
+
+printf "%-20s %10s %12s %14s\n" mode requests "time (s)" "requests/s"
+printf "%-20s %10s %12s %14s\n" "process per input" "$count" "$processes" "$(awk -v n="$count" -v t="$processes" 'BEGIN { printf "%.1f", n / t }')"
+printf "%-20s %10s %12s %14s\n" "server" "$count" "$single" "$(awk -v n="$count" -v t="$single" 'BEGIN { printf "%.1f", n / t }')"
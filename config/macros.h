@@ -11,6 +11,8 @@
 #define HDR_MASK @HDR_MASK@
 #define TAG_MASK @TAG_MASK@LL
 #define LENGTH_MASK @LENGTH_MASK@
+#define SMALL_INT_MIN (@SMALL_INT_MIN@LL)
+#define SMALL_INT_MAX @SMALL_INT_MAX@LL
 
 #define MAP_LAYOUT @MAP_LAYOUT@
 #define LIST_LAYOUT @LIST_LAYOUT@
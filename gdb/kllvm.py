@@ -473,6 +473,10 @@ class termPrinter:
 
     def appendInt(self, val, sort):
         self.result += "\\dv{" + sort + "}(\""
+        address = int(val.cast(self.long_int))
+        if address & 1:
+            self.result += str(address >> 1) + "\")"
+            return
         size = int(val.dereference()['_mp_size'])
         if size == 0:
             self.result += "0"
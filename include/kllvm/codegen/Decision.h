@@ -332,6 +332,8 @@ private:
   ValueType Cat;
   llvm::PHINode *FailSubject, *FailPattern, *FailSort;
   llvm::Value *ResultBuffer, *ResultCount, *ResultCapacity;
+  /* whether a leaf returns true instead of applying its rule. */
+  bool Predicate;
 
   std::map<var_type, llvm::AllocaInst *> symbols;
 
@@ -357,7 +359,8 @@ public:
     llvm::PHINode *FailSort,
     llvm::Value *ResultBuffer,
     llvm::Value *ResultCount,
-    llvm::Value *ResultCapacity) :
+    llvm::Value *ResultCapacity,
+    bool Predicate = false) :
       Definition(Definition),
       CurrentBlock(EntryBlock),
       FailureBlock(FailureBlock),
@@ -373,7 +376,8 @@ public:
       FailSort(FailSort),
       ResultBuffer(ResultBuffer),
       ResultCount(ResultCount),
-      ResultCapacity(ResultCapacity)
+      ResultCapacity(ResultCapacity),
+      Predicate(Predicate)
        {}
 
   /* adds code to the specified basic block to take a single step based on
@@ -400,6 +404,11 @@ void makeAnywhereFunction(KORESymbol *function, KOREDefinition *definition, llvm
 void makeStepFunction(KOREDefinition *definition, llvm::Module *module, DecisionNode *dt, bool search);
 void makeStepFunction(KOREAxiomDeclaration *axiom, KOREDefinition *definition, llvm::Module *module, PartialStep res);
 void makeMatchReasonFunction(KOREDefinition *definition, llvm::Module *module, KOREAxiomDeclaration *axiom, DecisionNode *dt);
+/* construct the function search_pattern, which returns whether a configuration
+   matches one of the axioms of the definition marked search-pattern, according
+   to the specified decision tree. If dt is null, every configuration
+   matches. */
+void makeSearchPatternFunction(KOREDefinition *definition, llvm::Module *module, DecisionNode *dt);
 
 }
 #endif // DECISION_H
@@ -0,0 +1,55 @@
+#ifndef RULE_PROFILE_H
+#define RULE_PROFILE_H
+
+#include "kllvm/ast/AST.h"
+
+#include "llvm/IR/Module.h"
+
+namespace kllvm {
+
+// Profiling of the rules applied by the interpreter, set by the profile
+// argument of llvm-kompile-codegen: 0 for none, 1 to count the applications
+// of each rule, 2 to also accumulate the cycles spent in its apply_rule_ and
+// side_condition_ functions, as read by llvm.readcyclecounter.
+//
+// The counters are kept in the global kllvm_rule_profile, indexed by axiom
+// ordinal. A constructor passes it, together with the label and the source
+// location of each axiom, to registerRuleProfile in the runtime, which writes
+// the profile at exit.
+extern int CODEGEN_PROFILE;
+
+// emits the counters of the definition and the constructor registering them.
+void initRuleProfile(KOREDefinition *definition, llvm::Module *module);
+
+// emits code at the end of block that counts an application of a rule.
+void countRuleApplication(unsigned ordinal, llvm::Module *module, llvm::BasicBlock *block);
+
+// returns the cycle counter, read at the end of block, or null if cycles are
+// not profiled.
+llvm::Value *startRuleCycles(llvm::Module *module, llvm::BasicBlock *block);
+
+// emits code at the end of block that adds the cycles since start to the
+// cycles spent in a rule, or in its side condition. Does nothing if start is
+// null.
+void stopRuleCycles(unsigned ordinal, bool sideCondition, llvm::Value *start, llvm::Module *module, llvm::BasicBlock *block);
+
+// In AllocStats builds, the generated code reports the terms it allocates and
+// the rule it is applying to the allocation profile of the runtime. The
+// following functions do nothing in other builds.
+
+// emits code at the end of block that attributes the allocations that follow
+// to a rule, and returns the rule they were attributed to before, or null.
+llvm::Value *enterRuleAllocations(unsigned ordinal, llvm::Module *module, llvm::BasicBlock *block);
+
+// emits code at the end of block that attributes the allocations that follow
+// to the rule returned by enterRuleAllocations. Does nothing if previous is
+// null.
+void exitRuleAllocations(llvm::Value *previous, llvm::Module *module, llvm::BasicBlock *block);
+
+// emits code at the end of block that counts the allocation of a term with the
+// given block header.
+void countTermAllocation(llvm::Value *blockHeader, llvm::Module *module, llvm::BasicBlock *block);
+
+}
+
+#endif // RULE_PROFILE_H
@@ -0,0 +1,29 @@
+#ifndef SAFEPOINTS_H
+#define SAFEPOINTS_H
+
+#include "llvm/IR/Module.h"
+
+namespace kllvm {
+
+// Makes it possible to garbage collect while a K function is being evaluated.
+//
+// Every fastcc function of the module that holds a heap pointer across a call
+// which can collect stores that pointer into a frame of a shadow stack, and
+// reloads it from the frame after the call. The frames are linked through the
+// thread local variable gc_frames, and are walked by the collector as roots.
+// The entry of every eval_ function is made a safepoint where a collection is
+// performed if one is due.
+//
+// Values that cannot be relocated by the collector, such as pointers into the
+// middle of a heap object or collections passed by reference, are not stored
+// in a frame. Instead, the calls they are live across increment the thread
+// local counter gc_safepoint_inhibit for their duration, which disables every
+// safepoint reached by the call.
+void addGCSafepoints(llvm::Module *module);
+
+// Emits code before insertBefore that adds delta to gc_safepoint_inhibit.
+void addToSafepointInhibit(int64_t delta, llvm::Instruction *insertBefore);
+
+}
+
+#endif // SAFEPOINTS_H
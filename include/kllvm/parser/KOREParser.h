@@ -11,6 +11,9 @@ class KOREParser {
 public:
   KOREParser(std::string filename) :
 	  scanner(KOREScanner(filename)), loc(location(filename)) {}
+  // parses an open stream, named name in error messages.
+  KOREParser(FILE *in, std::string name) :
+	  scanner(KOREScanner(in)), loc(location(name)) {}
 
   ptr<KOREDefinition> definition(void);
   ptr<KOREPattern> pattern(void);
@@ -3,9 +3,17 @@
 
 #include "kllvm/parser/location.h"
 
+#include <stdexcept>
+
 namespace kllvm {
 namespace parser {
 
+// thrown on malformed input, with the location of the error in its message.
+class ParseError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
 enum class token {
   EMPTY,
   MODULE,
@@ -36,6 +44,8 @@ enum class token {
 class KOREScanner {
 public:
   KOREScanner(std::string filename);
+  // scans an open stream, which is closed by the destructor.
+  KOREScanner(FILE *in);
   ~KOREScanner();
   int scan();
 
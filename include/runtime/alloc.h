@@ -9,11 +9,24 @@ extern const size_t BLOCK_SIZE;
 
 #define YOUNGSPACE_ID 0
 #define OLDSPACE_ID 1
+#define LARGE_OBJECT_ID 2
 #define ALWAYSGCSPACE_ID 3
+#define PERMANENTSPACE_ID 4
 
 char youngspace_collection_id(void);
 char oldspace_collection_id(void);
 size_t youngspace_size(void);
+// returns the number of bytes allocated in the young generation since the last collection,
+// including the objects that survived it.
+size_t youngspace_used(void);
+// returns the number of bytes currently occupied by objects in the old generation,
+// including dead objects not yet collected.
+size_t oldspace_used(void);
+
+struct arena;
+// returns the young and old generation arenas of the calling thread.
+struct arena *youngspace_arena(void);
+struct arena *oldspace_arena(void);
 
 // allocates exactly requested bytes into the young generation
 void* koreAlloc(size_t requested);
@@ -32,6 +45,15 @@ void* koreAllocAlwaysGC(size_t requested);
 // swaps the two semispace of the young generation as part of garbage collection
 // if the swapOld flag is set, it also swaps the two semispaces of the old generation
 void koreAllocSwap(bool swapOld);
+// releases the memory of the semispaces evacuated by a garbage collection, which
+// includes those of the old generation if the releaseOld flag is set
+void koreAllocRelease(bool releaseOld);
+// calls init with the young generation of the calling thread replaced by the
+// permanent space, which is shared by all threads and never collected, so that
+// the objects it allocates are permanent. Only the first call in the process
+// has any effect; the permanent space is read-only after it returns, and a
+// concurrent call waits for it.
+void koreAllocPermanent(void (*init)(void));
 // resizes the last allocation into the young generation
 void* koreResizeLastAlloc(void* oldptr, size_t newrequest, size_t oldrequest);
 // allocator hook for the GMP library
@@ -49,6 +71,21 @@ void* koreAllocInteger(size_t requested);
 void* koreAllocFloating(size_t requested);
 void* koreAllocIntegerOld(size_t requested);
 void* koreAllocFloatingOld(size_t requested);
+// allocates a node of an immer collection of size bytes into the young generation
+void* koreAllocCollectionNode(size_t size);
+
+// In AllocStats builds, the allocations of the program are counted by symbol
+// tag, by kind of token and by the rule being applied when they were made, and
+// written to $KLLVM_ALLOC_PROFILE at exit. See alloc_stats.cpp.
+enum alloc_kind { ALLOC_STRING, ALLOC_INTEGER, ALLOC_LIMBS, ALLOC_FLOAT, ALLOC_COLLECTION, ALLOC_KINDS };
+// called by the generated code with the header of each term it allocates.
+void allocStatsTerm(uint64_t hdr);
+// records the allocation of size bytes for a token of the given kind.
+void allocStatsToken(enum alloc_kind kind, size_t size);
+// called by the generated code with the ordinal of a rule when it starts
+// applying it or evaluating its side condition, and with the ordinal returned
+// when it is done. Returns the ordinal of the rule being applied before.
+uint64_t allocStatsEnterRule(uint64_t ordinal);
 
 #ifdef ALLOC_DBG
 #define MEM_LOG(...) fprintf(stderr, __VA_ARGS__)
@@ -13,6 +13,12 @@ struct arena {
   char *first_collection_block;
   size_t num_blocks;
   size_t num_collection_blocks;
+  // number of blocks of the allocation semispace allocated into since it was
+  // last cleared, including the current one.
+  size_t num_used_blocks;
+  // number of blocks of the collection semispace that were used when it was
+  // last the allocation semispace.
+  size_t num_collection_used_blocks;
   char allocation_semispace_id;
 };
 
@@ -23,9 +29,9 @@ typedef struct {
 } memory_block_header;
 
 // Macro to define a new arena with the given ID. Supports IDs ranging from 0 to
-// 127.
+// 127. Every thread has its own instance of the arena.
 #define REGISTER_ARENA(name, id) \
-  static struct arena name = { .allocation_semispace_id = id }
+  static thread_local struct arena name = { .allocation_semispace_id = id }
 
 #define mem_block_start(ptr) \
   ((char *)(((uintptr_t)(ptr) - 1) & ~(BLOCK_SIZE-1)))
@@ -69,6 +75,15 @@ void arenaSwapAndClear(struct arena *);
 // It is used during garbage collection to effectively collect all of the arena.
 void arenaClear(struct arena *);
 
+// Returns the memory of the blocks of the current collection semispace of the
+// given arena beyond those it used before the last swap to the operating
+// system, keeping the blocks themselves. The blocks it used are likely to be
+// needed again once it is swapped back, so they stay resident; only a
+// semispace that has shrunk gives memory back. Only has an effect on blocks
+// committed from a reservation (see KLLVM_HEAP_RESERVE). It is used after
+// garbage collection, once every live object has been evacuated.
+void arenaRelease(struct arena *);
+
 // Returns the address of the first byte that belongs in the given arena.
 // Returns 0 if nothing has been allocated ever in that arena.
 char *arenaStartPtr(const struct arena *);
@@ -95,7 +110,25 @@ ssize_t ptrDiff(char *, char *);
 // return the total number of allocatable bytes currently in the arena in its active semispace.
 size_t arenaSize(const struct arena *);
 
-// Deallocates all the memory allocated for registered arenas.
+// return the number of bytes allocated in the arena since it was last cleared,
+// including the unused ends of its blocks.
+size_t arenaUsed(const struct arena *);
+
+// The superblocks and reservations that the blocks of the arenas of a thread
+// are taken from.
+struct block_source;
+
+// Returns the block source of the calling thread.
+struct block_source *arenaBlockSource(void);
+
+// Makes the calling thread take the blocks of the arenas it allocates into from
+// the given block source, or from its own if it is null. The helper threads of
+// a parallel collection use this to allocate into the arenas of the thread
+// being collected.
+void arenaUseBlockSource(struct block_source *);
+
+// Deallocates all the memory allocated by the calling thread for registered
+// arenas, for the region space and for the large object space.
 void freeAllMemory(void);
 
 }
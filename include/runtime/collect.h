@@ -1,10 +1,14 @@
 #ifndef RUNTIME_COLLECT_H
 #define RUNTIME_COLLECT_H
 
+#include <atomic>
 #include <type_traits>
 #include <iterator>
 #include <vector>
 #include "runtime/header.h"
+#include "runtime/arena.h"
+#include "runtime/largeobject.h"
+#include "runtime/region.h"
 
 struct block;
 using block_iterator = std::vector<block **>::iterator;
@@ -23,10 +27,15 @@ using map_impl = map::iterator::tree_t;
 using set_node = set::iterator::node_t;
 using set_impl = set::iterator::tree_t;
 
+// The state of a collection is local to the thread whose heap is being
+// collected, and is copied by the helper threads of a parallel collection.
 extern "C" {
-  extern size_t numBytesLiveAtCollection[1 << AGE_WIDTH];
+  extern thread_local size_t numBytesLiveAtCollection[1 << AGE_WIDTH];
   bool during_gc(void);
-  extern bool collect_old;
+  extern thread_local bool collect_old;
+  // the IDs of the semispaces of the young and old generations that are being
+  // evacuated by the current collection.
+  extern thread_local char gc_young_collection_id, gc_old_collection_id;
   size_t get_size(uint64_t, uint16_t);
   void migrate_once(block **);
   void migrate_list(void *l);
@@ -35,6 +44,209 @@ extern "C" {
   void migrate_collection_node(void **nodePtr);
   void setKoreMemoryFunctionsForGMP(void);
   void koreCollect(void**, uint8_t, layoutitem *);
+  // collects both generations, whatever the policy. Called without roots, it
+  // empties the heap of everything but the objects held by the runtime.
+  void koreCollectAll(void);
+  // Decides at the start of a collection whether the old generation is
+  // collected too. See policy.cpp for the available policies.
+  bool shouldCollectOldGen(void);
+  // Reports the end of a collection that took the given number of nanoseconds
+  // to the collection policies, and returns the number of bytes the young
+  // generation may occupy before the next one: the survivors of this
+  // collection and the nursery.
+  size_t collectionDone(bool collectedOld, uint64_t pause);
+  // Returns the number of bytes that can be allocated in the young generation
+  // before the first collection.
+  size_t initialNurserySize(void);
+  uint64_t gcNanoseconds(void);
+  void migrate_child(void* currBlock, layoutitem *args, unsigned i, bool ptr);
+  void migrateRoots(void);
+
+  // A frame of the shadow stack of roots held by K functions while they are
+  // being evaluated. Frames are pushed and popped by the generated code; see
+  // Safepoints.cpp. The categories of the roots are given by layout, as for
+  // the children of a block. Null roots are skipped.
+  struct gc_frame {
+    gc_frame *prev;
+    uint64_t nroots;
+    layoutitem *layout;
+    void *roots[];
+  };
+  extern thread_local gc_frame *gc_frames;
+  // safepoints in K functions only collect while this is zero. It starts at
+  // one and is decremented while take_steps rewrites, and it is incremented
+  // around code that holds pointers the collector does not know about.
+  extern thread_local uint64_t gc_safepoint_inhibit;
+  // performs a collection at a safepoint in a K function.
+  void koreCollectSafepoint(void);
+
+  // true while a collection is being performed by more than one thread.
+  extern thread_local bool gc_parallel;
+  // true if the sequential collector scans copied objects in depth-first
+  // rather than breadth-first order.
+  extern bool gc_depth_first;
+  // returns the number of threads used to perform a collection. This is read
+  // from the KLLVM_GC_THREADS environment variable and defaults to 1. It is
+  // always 1 when the old generation is collected by mark_region, with a
+  // warning if more threads were requested.
+  unsigned gcThreads(void);
+  // allocates space for the copy of an object during collection, either into
+  // the young or the old generation. Behaves like koreAlloc/koreAllocOld
+  // unless a parallel collection is in progress, in which case it allocates
+  // from a block of memory local to the calling thread.
+  void* gcAlloc(size_t requested, bool old);
+  // allocates space for the copy of a string token during collection.
+  // rounds up to the nearest 8 bytes and always allocates at least 16 bytes
+  void* gcAllocToken(size_t requested, bool old);
+  // evacuates the roots and scans everything reachable from them using
+  // gcThreads() threads.
+  void parallelEvacuate(void** roots, uint8_t nroots, layoutitem *typeInfo);
+  // records an object allocated in or marked in the region space during a
+  // collection, or any object copied by a depth-first collection, whose
+  // children still have to be migrated.
+  void pushGrayObject(void *);
+
+  // The phase of the collection performed by a thread, recorded with each
+  // sample of the sampling profiler.
+  enum gc_phase_kind : uint8_t { GC_NONE, GC_ROOTS, GC_EVACUATE, GC_SWEEP };
+  extern thread_local uint8_t gc_phase;
+  // starts the sampling profiler if KLLVM_PROFILE_SAMPLES names a file to
+  // write the samples to. See sampler.cpp.
+  void initSampler(void);
+  // records where the stack of the calling thread ends, which stops the walk
+  // of its frames when it is sampled. Called by initSampler for the
+  // thread that starts the profiler, and by each thread the runtime runs on.
+  void initSamplerThread(void);
+
+  // installs the handler of SIGUSR2 that requests a heap snapshot if
+  // KLLVM_HEAP_SNAPSHOT is set. See heap_snapshot.cpp.
+  void initHeapSnapshots(void);
+  // writes a snapshot of the heap of the calling thread if one was requested
+  // or the heap grew past the threshold. Called at the end of a collection
+  // with its roots.
+  void heapSnapshotAfterCollection(void **roots, uint8_t nroots, layoutitem *typeInfo);
+
+  // Statistics about the run, written as JSON at exit if KLLVM_STATS is set.
+  // See stats.cpp.
+  enum stats_phase { STATS_INIT, STATS_PARSE, STATS_REWRITE, STATS_PRINT, STATS_PHASES };
+  void initStats(void);
+  // ends the current phase of the run of the main thread and starts the given
+  // one.
+  void statsPhase(enum stats_phase phase);
+  // records a collection, which took pause nanoseconds, together with the
+  // number of bytes allocated in the young generation since the previous
+  // collection and the number of bytes it promoted to the old generation.
+  void statsCollection(bool collectedOld, uint64_t pause, size_t allocated, size_t promoted);
+  // returns the number of bytes allocated in the young generation of the
+  // calling thread since its last collection.
+  size_t youngAllocatedSinceCollection(void);
+  // returns the number of bytes that can be allocated in the young generation
+  // of the calling thread between two collections.
+  size_t nurseryBytes(void);
+
+  // set when a status report is requested by SIGUSR1 or by the heartbeat.
+  // Checked by finished_rewriting and at the end of each collection.
+  extern std::atomic<int> status_requested;
+  // true if status reports are enabled. The collector then keeps
+  // current_configuration, the configuration stored by the step function of
+  // the calling thread, up to date. It is null when the thread is not
+  // rewriting.
+  extern bool status_enabled;
+  extern thread_local block *current_configuration;
+  // writes the status reports that were requested. See stats.cpp.
+  void statusReport(void);
+}
+
+// Saves the shadow stack of roots, the safepoint inhibit count and the
+// configuration being rewritten by the calling thread, and restores them when
+// it is destroyed. An exception thrown through the generated code, by a hook
+// or by a handler for a function that is stuck, skips the code that would pop
+// its frames and restore the count, so one of these must be live around any
+// call into the interpreter whose exceptions are caught.
+class gc_state_guard {
+public:
+  gc_state_guard()
+    : frames(gc_frames), inhibit(gc_safepoint_inhibit),
+      configuration(current_configuration) { }
+
+  ~gc_state_guard() {
+    gc_frames = frames;
+    gc_safepoint_inhibit = inhibit;
+    current_configuration = configuration;
+  }
+
+  gc_state_guard(const gc_state_guard &) = delete;
+  gc_state_guard &operator=(const gc_state_guard &) = delete;
+
+private:
+  gc_frame *frames;
+  uint64_t inhibit;
+  block *configuration;
+};
+
+static inline bool is_large_object(void *ptr) {
+  return getArenaSemispaceIDOfObject(ptr) == LARGE_OBJECT_ID;
+}
+
+// Returns true if the object at the given address belongs to a space that is
+// being collected.
+static inline bool is_collected_object(void *ptr) {
+  char id = getArenaSemispaceIDOfObject(ptr);
+  if (id == gc_young_collection_id) {
+    return true;
+  }
+  if (id == LARGE_OBJECT_ID) {
+    return collect_old || !large_object_of(ptr)->old;
+  }
+  if (mark_region) {
+    return collect_old && id == OLDSPACE_ID;
+  }
+  return id == gc_old_collection_id;
+}
+
+// Returns true if the old generation object at the given address is marked in
+// place rather than copied when it is found live.
+static inline bool is_marked_in_place(void *ptr) {
+  return mark_region && !regionIsEvacuating(ptr);
+}
+
+// Header stored into an object while another thread is copying it during a
+// parallel collection. A young object with a layout of zero and a length of
+// LENGTH_MASK cannot exist, so this never collides with a real header.
+#define FWD_PTR_BUSY (FWD_PTR_BIT | LENGTH_MASK)
+
+// Reads the header of an object that may need to be migrated. If another
+// thread is in the middle of copying it, waits until the forwarding address
+// has been published.
+static inline uint64_t gc_load_header(blockheader *h) {
+  if (!gc_parallel) {
+    return h->hdr;
+  }
+  uint64_t hdr;
+  while ((hdr = __atomic_load_n(&h->hdr, __ATOMIC_ACQUIRE)) == FWD_PTR_BUSY) {
+    __builtin_ia32_pause();
+  }
+  return hdr;
+}
+
+// Claims the object whose header was read as hdr for copying by the calling
+// thread. Returns false if another thread claimed it first, in which case the
+// forwarding address has been published by the time this function returns.
+static inline bool gc_claim(blockheader *h, uint64_t hdr) {
+  if (!gc_parallel) {
+    return true;
+  }
+  if (__atomic_compare_exchange_n(&h->hdr, &hdr, FWD_PTR_BUSY, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return true;
+  }
+  gc_load_header(h);
+  return false;
+}
+
+// Marks the object whose original header was hdr as forwarded. Must be called
+// after the forwarding address has been written.
+static inline void gc_publish(blockheader *h, uint64_t hdr) {
+  __atomic_store_n(&h->hdr, hdr | FWD_PTR_BIT, __ATOMIC_RELEASE);
 }
 
 #ifdef GC_DBG
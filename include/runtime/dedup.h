@@ -0,0 +1,55 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <cstddef>
+
+#include "runtime/header.h"
+
+extern "C" {
+
+// Deduplication of immutable values promoted to the old generation. It is
+// enabled by setting the KLLVM_GC_DEDUP environment variable to 1.
+//
+// While enabled, the collector keeps a table of the string tokens and integers
+// it has copied into the old generation, keyed on their contents. When an equal
+// value is about to be copied into the old generation, it is forwarded to the
+// existing copy instead. Bytes and String share a representation, but Bytes
+// values may be modified in place by hooks such as BYTES.update, so only tokens
+// that are children of a term whose argument is of a sort other than Bytes are
+// deduplicated. Tokens referenced directly by roots are not.
+
+extern bool gc_dedup;
+
+// Only values of at most this many bytes are deduplicated.
+#define DEDUP_MAX_LEN 256
+
+// Returns the sort of argument i of the symbol with the given tag.
+const char *dedupArgumentSort(uint32_t tag, unsigned i);
+// Returns true if tokens of the given sort, which may be null if it is not
+// known, can be deduplicated.
+bool dedupImmutableSort(const char *sort);
+
+// Returns the copy in the old generation of a token equal to the given one, or
+// 0 if there is none.
+string *dedupFindToken(string *);
+// Records the given token, which has just been copied into the old generation.
+void dedupAddToken(string *);
+
+// Returns the copy in the old generation of an integer equal to the given one,
+// or 0 if there is none.
+mpz_hdr *dedupFindInteger(mpz_hdr *);
+// Records the given integer, which has just been copied into the old
+// generation.
+void dedupAddInteger(mpz_hdr *);
+
+// Forgets every recorded value. Must be called at the start of every
+// collection of the old generation, since it may move or free them.
+void dedupReset(void);
+
+// Returns the number of bytes that deduplication avoided copying since the
+// last call.
+size_t dedupBytesSaved(void);
+
+}
+
+#endif // DEDUP_H
@@ -4,6 +4,8 @@
 #include <cstdint>
 #include <cstddef>
 #include <limits>
+#include <string>
+#include <unordered_map>
 
 #include <gmp.h>
 #include <mpfr.h>
@@ -38,6 +40,15 @@
 #define is_leaf_block(block) (((uintptr_t)block) & 1)
 #define is_variable_block(block) ((((uintptr_t)block) & 3) == 3)
 
+// A SortInt is either a pointer to the mpz_t of an mpz_hdr or, if its least
+// significant bit is set, an integer between SMALL_INT_MIN and SMALL_INT_MAX
+// shifted left by one bit. Integers in that range can still be represented by
+// an mpz_hdr, so the representation of a given integer is not unique.
+#define is_small_int(i) (((uintptr_t)(i)) & 1)
+#define small_int_value(i) (((intptr_t)(i)) >> 1)
+#define fits_small_int(v) ((v) >= SMALL_INT_MIN && (v) <= SMALL_INT_MAX)
+#define make_small_int(v) ((mpz_ptr)((((uintptr_t)(v)) << 1) | 1))
+
 extern "C" {
   // llvm: blockheader = type { i64 } 
   typedef struct blockheader {
@@ -136,9 +147,7 @@ struct kore_alloc_heap {
     if (during_gc()) {
       return ::operator new(size);
     } else {
-      string *result = (string *)koreAllocToken(size + sizeof(blockheader));
-      set_len(result, size);
-      return result->data;
+      return koreAllocCollectionNode(size);
     }
   }
 
@@ -193,10 +202,37 @@ typedef list *SortList;
 typedef map *SortMap;
 typedef set *SortSet;
 
+// A read-only mpz_t with the value of a SortInt in either representation. It
+// can be passed to any function that does not modify that argument, and must
+// not be used after it goes out of scope.
+class int_view {
+  mp_limb_t limb;
+  __mpz_struct small;
+  mpz_ptr ptr;
+
+public:
+  explicit int_view(SortInt i) {
+    if (!is_small_int(i)) {
+      ptr = i;
+      return;
+    }
+    int64_t value = small_int_value(i);
+    limb = value < 0 ? -(mp_limb_t)value : value;
+    mpz_roinit_n(&small, &limb, value < 0 ? -1 : value > 0);
+    ptr = &small;
+  }
+  int_view(const int_view &) = delete;
+  int_view &operator=(const int_view &) = delete;
+
+  operator mpz_ptr() const { return ptr; }
+  mpz_ptr operator->() const { return ptr; }
+};
+
 
 extern "C" {
 
   block *parseConfiguration(const char *filename);
+  block *parseConfigurationFromString(const char *data, size_t size);
   void printConfiguration(const char *filename, block *subject);
   void printStatistics(const char *filename, uint64_t steps);
   string *printConfigurationToString(block *subject);
@@ -262,4 +298,23 @@ extern "C" {
 std::string floatToString(const floating *);
 void init_float2(floating *, std::string);
 
+// as parseConfigurationFromString, but throws kllvm::parser::ParseError rather
+// than terminating the process if the pattern is malformed.
+block *tryParseConfigurationFromString(const char *data, size_t size);
+
+// appends to out an encoding of subject from which deserializeConfiguration
+// constructs an equal term in the heap of the calling thread. Equal terms have
+// equal encodings. The encoding refers to symbols by tag, so it can only be
+// decoded by the same interpreter.
+void serializeConfiguration(block *subject, std::string &out);
+block *deserializeConfiguration(const char *data, size_t size);
+
+// A configuration that may contain KORE variables. Its largest variable-free
+// subterms are constructed on the heap once, when it is parsed.
+struct configuration_template;
+configuration_template *parseConfigurationTemplate(const char *filename);
+// constructs the configuration with each variable replaced by the KORE
+// pattern bound to its name. Terminates the process if a variable is unbound.
+block *instantiateConfigurationTemplate(configuration_template *, std::unordered_map<std::string, std::string> const &bindings);
+
 #endif // RUNTIME_HEADER_H
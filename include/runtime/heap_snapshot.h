@@ -0,0 +1,43 @@
+#ifndef RUNTIME_HEAP_SNAPSHOT_H
+#define RUNTIME_HEAP_SNAPSHOT_H
+
+#include <cstdint>
+
+// The format of the heap snapshots written by interpreters when
+// KLLVM_HEAP_SNAPSHOT is set (see runtime/collect/heap_snapshot.cpp) and read
+// by llvm-kompile-heap-stats. A snapshot starts with the eight bytes of
+// HEAP_SNAPSHOT_MAGIC, followed by records made of a byte giving their type
+// and of unsigned integers encoded in LEB128:
+//
+//   HEAP_OBJECT <id> <kind> <tag> <size in bytes> <number of edges> <id>...
+//   HEAP_ROOT <root kind> <id>
+//   HEAP_SYMBOL <tag> <length> <bytes of the name of the symbol>
+//   HEAP_END
+//
+// Objects are numbered from zero in the order in which they are found, and
+// their records may appear in any order. An object is referenced by an edge or
+// a root before or after its own record. The tag of an object is only
+// meaningful for terms, and the names of the tags of the terms of the snapshot
+// are given at the end.
+
+#define HEAP_SNAPSHOT_MAGIC "KLLVMHS1"
+
+enum heap_record : uint8_t { HEAP_OBJECT, HEAP_ROOT, HEAP_SYMBOL, HEAP_END };
+
+// Tokens are string tokens, the limbs of integers and floats, and the
+// contents of string buffers. A collection is made of several nodes, which
+// may be shared with other collections.
+enum heap_object_kind : uint8_t {
+  HEAP_TERM, HEAP_TOKEN, HEAP_INTEGER, HEAP_FLOAT, HEAP_BUFFER, HEAP_LIMBS,
+  HEAP_COLLECTION_NODE, HEAP_OBJECT_KINDS
+};
+
+// The roots passed to the collection after which the snapshot was taken, the
+// roots held by K functions being evaluated, those of the enumerators
+// registered with registerGCRootsEnumerator, and those held by the runtime
+// itself.
+enum heap_root_kind : uint8_t {
+  ROOT_COLLECTION, ROOT_FUNCTION, ROOT_ENUMERATOR, ROOT_RUNTIME, HEAP_ROOT_KINDS
+};
+
+#endif // RUNTIME_HEAP_SNAPSHOT_H
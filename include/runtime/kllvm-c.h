@@ -0,0 +1,80 @@
+#ifndef KLLVM_C_H
+#define KLLVM_C_H
+
+/*
+ * C interface to an interpreter generated with "llvm-kompile ... library".
+ *
+ * Each thread that calls this interface has its own heap and holds at most
+ * one configuration, the current configuration, which kllvm_load replaces
+ * and kllvm_step rewrites. No function of this interface terminates the
+ * process: failures are reported as a kllvm_status, with a description
+ * available from kllvm_last_error. After a failure other than
+ * KLLVM_ERROR_NO_CONFIGURATION, the thread has no current configuration.
+ *
+ * The interface is versioned by KLLVM_C_API_VERSION, which is incremented
+ * whenever a function is added or changes meaning.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KLLVM_C_API_VERSION 1
+
+typedef enum {
+  KLLVM_OK = 0,
+  /* the input is not a well-formed KORE pattern. */
+  KLLVM_ERROR_PARSE = 1,
+  /* a K function was applied to arguments that none of its rules match. */
+  KLLVM_ERROR_STUCK_FUNCTION = 2,
+  /* a builtin function failed, for instance on an invalid argument. */
+  KLLVM_ERROR_HOOK = 3,
+  /* the thread has no current configuration. */
+  KLLVM_ERROR_NO_CONFIGURATION = 4,
+} kllvm_status;
+
+/* returns the KLLVM_C_API_VERSION the interpreter was built with. */
+int kllvm_version(void);
+
+/* prepares the calling thread to use the interpreter. Must be called on each
+ * thread before any other function of this interface except kllvm_version. */
+kllvm_status kllvm_init(void);
+
+/* makes the KORE pattern in data, of size bytes, the current configuration. */
+kllvm_status kllvm_load(const char *data, size_t size);
+
+/* rewrites the current configuration by at most depth steps, or until no
+ * rule applies if depth is negative. If steps is not null, the number of
+ * steps taken is stored into it. */
+kllvm_status kllvm_step(int64_t depth, int64_t *steps);
+
+/* returns whether the last call to kllvm_step on this thread stopped because
+ * no rule applied to the current configuration. */
+bool kllvm_is_stuck(void);
+
+/* stores the current configuration, printed as a KORE pattern, into a buffer
+ * of *size bytes allocated with malloc, which the caller must free. The
+ * buffer is not null-terminated. */
+kllvm_status kllvm_get_kore(char **data, size_t *size);
+
+/* stores the exit code of the current configuration, as computed by the
+ * getExitCode function of the definition, into exit_code. */
+kllvm_status kllvm_get_exit_code(int32_t *exit_code);
+
+/* discards the current configuration and empties the heap of the calling
+ * thread. */
+void kllvm_reset(void);
+
+/* returns a description of the last failure on this thread, valid until the
+ * next call to this interface. */
+const char *kllvm_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KLLVM_C_H */
@@ -0,0 +1,58 @@
+#ifndef LARGEOBJECT_H
+#define LARGEOBJECT_H
+
+#include <cstddef>
+
+#include "runtime/arena.h"
+
+extern "C" {
+
+// The large object space holds every object too large to fit in a block of an
+// arena or of the region space. Each object is placed in its own mapping,
+// which starts with a large_object header aligned to BLOCK_SIZE, so that
+// getArenaSemispaceIDOfObject returns LARGE_OBJECT_ID for it.
+//
+// Large objects are never copied by the garbage collector. Instead, they are
+// marked when found live and unmapped by largeObjectSweep when they are not.
+// Like the objects of the young generation, a large object is promoted when it
+// survives a collection after the first one it survived, so that the young
+// objects it points to, which are at least as old as it is, are promoted by
+// the same collection. Old large objects are only collected together with the
+// old generation, and the collection of the young generation does not trace
+// through them.
+
+typedef struct large_object {
+  memory_block_header header;
+  struct large_object *next;
+  // number of bytes mapped for this object, including this header.
+  size_t size;
+  // whether the object survived a collection while young.
+  bool survived;
+  bool old;
+  bool marked;
+} large_object;
+
+#define large_object_of(ptr) ((large_object *)mem_block_start(ptr))
+
+// Allocates the requested number of bytes in the large object space.
+void *largeObjectAlloc(size_t);
+
+// Marks the large object at the given address as live. Returns true if it was
+// not marked before. Safe to call concurrently from several garbage collection
+// threads.
+bool largeObjectMark(void *);
+
+// Unmaps every young large object that was not marked since the last sweep and,
+// if the old generation was collected too, every such old large object. Ages
+// the surviving young objects and clears their marks.
+void largeObjectSweep(bool collectOld);
+
+// Returns the number of bytes currently mapped for old large objects.
+size_t largeObjectOldSize(void);
+
+// Unmaps every large object.
+void largeObjectFreeAll(void);
+
+}
+
+#endif // LARGEOBJECT_H
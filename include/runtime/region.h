@@ -0,0 +1,76 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <cstddef>
+
+#include "runtime/arena.h"
+
+extern "C" {
+
+// The region space is an alternative, non-moving implementation of the old
+// generation. It is enabled by setting the KLLVM_OLD_GEN environment variable
+// to "mark-region", in which case koreAllocOld and koreAllocTokenOld allocate
+// from it instead of from the oldspace arena.
+//
+// Memory is divided into blocks of BLOCK_SIZE bytes. During a collection of
+// the old generation, live objects are marked in place by setting the
+// FWD_PTR_BIT of their header. The following sweep turns every run of dead
+// objects of at least REGION_LINE_SIZE bytes into a hole that is reused by the
+// bump allocator, releases empty blocks, and selects sparsely occupied blocks
+// whose live objects are evacuated (copied) during the next full collection.
+//
+// Every block can always be traversed linearly: the unused part of a hole is
+// filled with a sentinel object whenever the allocator moves on from it.
+//
+// Unlike Immix, there is no line mark bitmap: the marks live in the object
+// headers, and the sweep finds holes by walking the objects of each block.
+// Holes therefore start and end exactly at object boundaries rather than at
+// line boundaries, so no space is lost to partly used lines, but the sweep
+// takes time proportional to the number of objects rather than of lines. A run
+// of dead objects shorter than REGION_LINE_SIZE is not reused until its block
+// is evacuated, and a hole too small for the allocation that reaches it is
+// skipped until the next sweep; this is the fragmentation that evacuation of
+// sparse blocks bounds.
+
+extern bool mark_region;
+
+// Holes smaller than this many bytes are not reused by the allocator.
+#define REGION_LINE_SIZE 256
+
+typedef struct region_block {
+  memory_block_header header;
+  // number of bytes found live by the last sweep.
+  size_t live;
+  // if set, the live objects of this block are copied out of it during the
+  // next collection of the old generation and the block is then released.
+  bool evacuate;
+} region_block;
+
+#define region_block_of(ptr) ((region_block *)mem_block_start(ptr))
+
+// Allocates the requested number of bytes in the region space.
+void *regionAlloc(size_t);
+
+// Returns true if the object at the given address will be evacuated, rather
+// than marked in place, if it is live at the next collection of the old
+// generation. The address must belong to the region space.
+bool regionIsEvacuating(void *);
+
+// Clears the marks of all live objects, rebuilds the list of holes and selects
+// the blocks to evacuate at the next collection. Must be called at the end of
+// every collection of the old generation.
+void regionSweep(void);
+
+// Returns the number of bytes currently reserved by the region space.
+size_t regionSize(void);
+
+// Returns the number of bytes found live by the last sweep plus the number of
+// bytes allocated since.
+size_t regionUsed(void);
+
+// Deallocates all the memory of the region space.
+void regionFreeAll(void);
+
+}
+
+#endif // REGION_H
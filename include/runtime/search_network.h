@@ -0,0 +1,89 @@
+#ifndef SEARCH_NETWORK_H
+#define SEARCH_NETWORK_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The connections between the processes of a distributed search, over which
+// they exchange messages, together with the detection of the end of the
+// search.
+//
+// Every process is given the addresses of all of them, in the same order,
+// and its own index in the list. An address is either unix:<path>, for a Unix
+// domain socket, or <host>:<port>, for TCP. Each process listens on its own
+// address and connects to every process before it in the list, so that each
+// pair of processes shares a connection. Messages are queued when they are
+// sent, and written as the sockets accept them while the process polls the
+// network, so that two processes sending to each other never block.
+//
+// The end of the search is detected with Safra's algorithm. A token travels
+// around the processes in the order of their indices, adding up the number of
+// messages each has sent minus the number it has received, and noting whether
+// any has received a message since the token last left it. A process only
+// passes the token on while it is idle. Once process 0 gets the token back
+// from a round in which no process received a message, and the messages sent
+// and received add up to zero, every process is idle and no message is in
+// flight, so the search is over.
+class search_network {
+public:
+  // connects to the other processes, waiting for them to start listening.
+  search_network(const std::vector<std::string> &addresses, unsigned self);
+  ~search_network();
+
+  search_network(const search_network &) = delete;
+  search_network &operator=(const search_network &) = delete;
+
+  unsigned size() const { return peers.size(); }
+  unsigned self() const { return id; }
+
+  // queues a message with the given tag for another process.
+  void send(unsigned to, uint8_t tag, const std::string &payload);
+
+  // writes and reads as much as the sockets allow, and calls deliver on every
+  // message received. If the process is idle and received nothing, it waits a
+  // little for messages, and takes part in detecting the end of the search.
+  // Returns false once the search is over, after which no message is
+  // delivered.
+  bool poll(bool idle, const std::function<void(unsigned from, uint8_t tag, std::string &payload)> &deliver);
+
+  // ends the search before every process is idle. Only process 0 may call it.
+  void stop();
+
+  // once the search is over, sends payload to process 0. At process 0, returns
+  // the payloads of all the processes in the order of their indices.
+  std::vector<std::string> gather(const std::string &payload);
+
+private:
+  struct peer {
+    int fd;
+    std::string out;
+    std::string in;
+  };
+
+  std::vector<peer> peers;
+  unsigned id;
+  std::string unixPath;
+  // the messages sent minus the messages received, and whether one was
+  // received since the token last left this process.
+  int64_t count;
+  bool black;
+  // the token, while this process holds it.
+  bool hasToken;
+  int64_t tokenCount;
+  bool tokenBlack;
+  // whether process 0 has sent the token around at least once.
+  bool tokenSent;
+  bool done;
+  std::vector<std::string> gathered;
+  size_t numGathered;
+
+  void queue(unsigned to, uint8_t kind, uint8_t tag, const std::string &payload);
+  void passToken();
+  void finish();
+  bool exchange(int timeout, const std::function<void(unsigned, uint8_t, std::string &)> &deliver);
+  bool receive(unsigned from, const std::function<void(unsigned, uint8_t, std::string &)> &deliver);
+};
+
+#endif // SEARCH_NETWORK_H
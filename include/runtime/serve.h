@@ -0,0 +1,36 @@
+#ifndef RUNTIME_SERVE_H
+#define RUNTIME_SERVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// The framing shared by the "server" and "fork-server" mains. Strings are
+// sent as their length in bytes as a 64-bit integer followed by their bytes,
+// and a response is the exit code of the final configuration as a 32-bit
+// integer followed by the configuration as a string. Integers are in native
+// byte order.
+
+// Reads or writes exactly size bytes, retrying after interruptions. Returns
+// false at the end of the input or on an error.
+bool readAll(int fd, void *buf, size_t size);
+bool writeAll(int fd, const void *buf, size_t size);
+
+// Reads a length-prefixed string. Returns false if it is incomplete.
+bool readString(int fd, std::string &result);
+
+bool writeResponse(int fd, int32_t exitCode, const char *data, uint64_t size);
+
+// Returns the size in bytes of the response at the start of data, or 0 if it
+// holds no complete response.
+size_t responseSize(const std::string &data);
+
+// Listens on a Unix domain socket at path, replacing any file already there,
+// and calls serve with each connection in turn, closing it afterwards. A
+// client that disconnects early does not kill the process. Only returns if
+// the socket cannot be set up or a connection cannot be accepted, in which
+// case it prints an error and returns 1.
+int serveSocket(const char *path, const std::function<void(int)> &serve);
+
+#endif // RUNTIME_SERVE_H
@@ -0,0 +1,35 @@
+#ifndef RUNTIME_SIZE_H
+#define RUNTIME_SIZE_H
+
+#include <cstdint>
+
+// parses a number of bytes with an optional K, M or G suffix (in either case)
+// for kibibytes, mebibytes or gibibytes, such as the value of KLLVM_HEAP_RESERVE.
+// Returns false, leaving result unchanged, if str is not such a number or its
+// value does not fit in 64 bits.
+inline bool parseSize(const char *str, uint64_t &result) {
+  if (*str < '0' || *str > '9') {
+    return false;
+  }
+  uint64_t size = 0;
+  for (; *str >= '0' && *str <= '9'; str++) {
+    unsigned digit = *str - '0';
+    if (size > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    size = size * 10 + digit;
+  }
+  unsigned shift = 0;
+  switch (*str) {
+  case 'G': case 'g': shift = 30; str++; break;
+  case 'M': case 'm': shift = 20; str++; break;
+  case 'K': case 'k': shift = 10; str++; break;
+  }
+  if (*str || size > UINT64_MAX >> shift) {
+    return false;
+  }
+  result = size << shift;
+  return true;
+}
+
+#endif // RUNTIME_SIZE_H
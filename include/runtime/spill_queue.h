@@ -0,0 +1,78 @@
+#ifndef SPILL_QUEUE_H
+#define SPILL_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+// A first-in first-out queue of byte strings that keeps only a bounded number
+// of bytes in memory. Each string is stored as a record made of its length as
+// a 64-bit integer followed by its bytes. Records are appended to segments,
+// which are consumed and freed in order. While the memory budget of the queue
+// allows it, segments are kept in memory; beyond that, records go to segment
+// files that are mapped into memory only while they are written or read.
+// Segment files are unlinked as soon as they are created, so they disappear
+// with the process.
+//
+// Several queues can share a budget. A queue is not safe to use from several
+// threads at once.
+
+// The number of bytes of records that the queues sharing it may keep in
+// memory, and the number they currently do.
+struct spill_budget {
+  size_t limit;
+  size_t used;
+};
+
+class spill_queue {
+public:
+  // segment files are created in directory, and hold at least segmentSize
+  // bytes each.
+  spill_queue(spill_budget *budget, std::string directory, size_t segmentSize = 64 * 1024 * 1024);
+  ~spill_queue();
+
+  spill_queue(const spill_queue &) = delete;
+  spill_queue &operator=(const spill_queue &) = delete;
+
+  void push(const std::string &record);
+  // removes the oldest string into record, or returns false if the queue is
+  // empty.
+  bool pop(std::string &record);
+
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+  // returns the number of segment files created so far.
+  size_t segmentFiles() const { return files; }
+
+  void swap(spill_queue &other);
+
+private:
+  struct segment {
+    std::string memory;
+    // the segment file, or -1 for a segment in memory.
+    int fd;
+    // the mapping of the segment file, if it is mapped, and its length.
+    char *data;
+    size_t mapped;
+    // whether records may still be appended to the segment file.
+    bool writable;
+    // the number of bytes of records in the segment, and the number consumed.
+    size_t size;
+    size_t pos;
+  };
+
+  spill_budget *budget;
+  std::string directory;
+  size_t segmentSize;
+  std::deque<segment> segments;
+  size_t count;
+  size_t files;
+
+  bool fits(const segment &s, bool inMemory, size_t recordSize) const;
+  void openFile(segment &s, size_t recordSize);
+  void finishWriting(segment &s);
+  void release(segment &s);
+};
+
+#endif // SPILL_QUEUE_H
@@ -1,6 +1,7 @@
 #include "kllvm/codegen/CreateTerm.h"
 #include "kllvm/codegen/Util.h"
 #include "kllvm/codegen/Debug.h"
+#include "kllvm/codegen/RuleProfile.h"
 
 #include <gmp.h>
 #include <iomanip>
@@ -50,7 +51,7 @@ target triple = "x86_64-unknown-linux-gnu"
 ; list: %list
 ; set: %set
 ; array: %list
-; integer: %mpz *
+; integer: %mpz *, or a small integer tagged in its least significant bit
 ; float: %floating *
 ; string: %string *
 ; bytes: %string *
@@ -257,12 +258,18 @@ llvm::Value *CreateTerm::createToken(ValueType sort, std::string contents) {
   case SortCategory::Set:
     assert (false && "cannot create tokens of collection category");
   case SortCategory::Int: {
+    mpz_t value;
+    const char * dataStart = contents.at(0) == '+' ? contents.c_str() + 1 : contents.c_str();
+    mpz_init_set_str(value, dataStart, 10);
+    long small = mpz_fits_slong_p(value) ? mpz_get_si(value) : SMALL_INT_MAX + 1;
+    if (fits_small_int(small)) {
+      mpz_clear(value);
+      llvm::Constant *tagged = llvm::ConstantInt::get(llvm::Type::getInt64Ty(Ctx), (uint64_t)make_small_int(small));
+      return llvm::ConstantExpr::getIntToPtr(tagged, llvm::PointerType::getUnqual(getTypeByName(Module, INT_STRUCT)));
+    }
     llvm::Constant *global = Module->getOrInsertGlobal("int_" + contents, getTypeByName(Module, INT_WRAPPER_STRUCT));
     llvm::GlobalVariable *globalVar = llvm::dyn_cast<llvm::GlobalVariable>(global);
     if (!globalVar->hasInitializer()) {
-      mpz_t value;
-      const char * dataStart = contents.at(0) == '+' ? contents.c_str() + 1 : contents.c_str();
-      mpz_init_set_str(value, dataStart, 10);
       size_t size = mpz_size(value);
       int sign = mpz_sgn(value);
       llvm::ArrayType *limbsType = llvm::ArrayType::get(llvm::Type::getInt64Ty(Ctx), size);
@@ -279,8 +286,8 @@ llvm::Value *CreateTerm::createToken(ValueType sort, std::string contents) {
       globalVar->setInitializer(llvm::ConstantStruct::get(
         getTypeByName(Module, INT_WRAPPER_STRUCT), hdr,
         llvm::ConstantStruct::get(getTypeByName(Module, INT_STRUCT), numLimbs, mp_size, llvm::ConstantExpr::getPointerCast(limbsVar, llvm::Type::getInt64PtrTy(Ctx)))));
-      mpz_clear(value);
     }
+    mpz_clear(value);
     std::vector<llvm::Constant *> Idxs = {llvm::ConstantInt::get(llvm::Type::getInt64Ty(Ctx), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(Ctx), 1)};
     return llvm::ConstantExpr::getInBoundsGetElementPtr(getTypeByName(Module, INT_WRAPPER_STRUCT), globalVar, Idxs);
   }
@@ -758,9 +765,14 @@ llvm::Value *CreateTerm::notInjectionCase(KORECompositePattern *constructor, llv
   KORESymbolDeclaration *symbolDecl = Definition->getSymbolDeclarations().at(symbol->getName());
   llvm::StructType *BlockType = getBlockType(Module, Definition, symbol);
   llvm::Value *BlockHeader = getBlockHeader(Module, Definition, symbol, BlockType);
+  // the children are evaluated after the block is allocated, so it is not yet
+  // initialized at the safepoints of their evaluation. addGCSafepoints never
+  // makes a pointer derived from an allocation a root, and inhibits those
+  // safepoints instead.
   llvm::Value *Block = allocateTerm(BlockType, CurrentBlock);
   llvm::Value *BlockHeaderPtr = llvm::GetElementPtrInst::CreateInBounds(BlockType, Block, {llvm::ConstantInt::get(llvm::Type::getInt64Ty(Ctx), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(Ctx), 0)}, symbol->getName(), CurrentBlock);
   new llvm::StoreInst(BlockHeader, BlockHeaderPtr, CurrentBlock);
+  countTermAllocation(BlockHeader, Module, CurrentBlock);
   int idx = 2;
   for (auto &child : constructor->getArguments()) {
     llvm::Value *ChildValue;
@@ -929,6 +941,8 @@ bool makeFunction(std::string name, KOREPattern *pattern, KOREDefinition *defini
     }
     llvm::StringMap<llvm::Value *> subst;
     llvm::BasicBlock *block = llvm::BasicBlock::Create(Module->getContext(), "entry", applyRule);
+    llvm::Value *startCycles = startRuleCycles(Module, block);
+    llvm::Value *previousRule = enterRuleAllocations(axiom->getOrdinal(), Module, block);
     int i = 0;
     for (auto val = applyRule->arg_begin(); val != applyRule->arg_end(); ++val, ++i) {
       subst.insert({paramNames[i], val});
@@ -943,6 +957,9 @@ bool makeFunction(std::string name, KOREPattern *pattern, KOREDefinition *defini
       new llvm::StoreInst(retval, tempAlloc, creator.getCurrentBlock());
       retval = tempAlloc;
     }
+    // the cycles of the steps that follow a big step are not the rule's.
+    stopRuleCycles(axiom->getOrdinal(), postfix == ".sc", startCycles, Module, creator.getCurrentBlock());
+    exitRuleAllocations(previousRule, Module, creator.getCurrentBlock());
     if (bigStep) {
       llvm::Type *blockType = getValueType({SortCategory::Symbol, 0}, Module);
       llvm::Function *step = getOrInsertFunction(Module, "step", llvm::FunctionType::get(blockType, {blockType}, false));
@@ -1010,6 +1027,8 @@ std::string makeApplyRuleFunction(KOREAxiomDeclaration *axiom, KOREDefinition *d
     applyRule->setCallingConv(llvm::CallingConv::Fast);
     llvm::StringMap<llvm::Value *> subst;
     llvm::BasicBlock *block = llvm::BasicBlock::Create(Module->getContext(), "entry", applyRule);
+    llvm::Value *startCycles = startRuleCycles(Module, block);
+    llvm::Value *previousRule = enterRuleAllocations(axiom->getOrdinal(), Module, block);
     int i = 0;
     for (auto val = applyRule->arg_begin(); val != applyRule->arg_end(); ++val, ++i) {
       subst.insert({paramNames[i], val});
@@ -1040,6 +1059,8 @@ std::string makeApplyRuleFunction(KOREAxiomDeclaration *axiom, KOREDefinition *d
       args.push_back(arg);
       types.push_back(arg->getType());
     }
+    stopRuleCycles(axiom->getOrdinal(), false, startCycles, Module, creator.getCurrentBlock());
+    exitRuleAllocations(previousRule, Module, creator.getCurrentBlock());
     llvm::Type *blockType = getValueType({SortCategory::Symbol, 0}, Module);
     llvm::Function *step = getOrInsertFunction(Module, "step_" + std::to_string(axiom->getOrdinal()), llvm::FunctionType::get(blockType, types, false));
     auto retval = llvm::CallInst::Create(step, args, "", creator.getCurrentBlock());
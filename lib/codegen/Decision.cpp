@@ -1,6 +1,7 @@
 #include "kllvm/codegen/Decision.h"
 #include "kllvm/codegen/CreateTerm.h"
 #include "kllvm/codegen/Debug.h"
+#include "kllvm/codegen/RuleProfile.h"
 #include "kllvm/codegen/Util.h"
 
 #include "llvm/IR/CFG.h"
@@ -358,6 +359,11 @@ void LeafNode::codegen(Decision *d) {
   if (beginNode(d, name)) {
     return;
   }
+  if (d->Predicate) {
+    llvm::ReturnInst::Create(d->Ctx, llvm::ConstantInt::getTrue(d->Ctx), d->CurrentBlock);
+    setCompleted();
+    return;
+  }
   if (d->FailPattern) {
     auto call = llvm::CallInst::Create(getOrInsertFunction(d->Module, "addMatchSuccess", llvm::Type::getVoidTy(d->Ctx)), {}, "", d->CurrentBlock);
     setDebugLoc(call);
@@ -365,6 +371,10 @@ void LeafNode::codegen(Decision *d) {
     setCompleted();
     return;
   }
+  // the leaves of step functions call apply_rule_<ordinal>.
+  if (!name.compare(0, 11, "apply_rule_")) {
+    countRuleApplication(std::stoul(name.substr(11)), d->Module, d->CurrentBlock);
+  }
   std::vector<llvm::Value *> args;
   std::vector<llvm::Type *> types;
   for (auto arg : bindings) {
@@ -528,6 +538,7 @@ void abortWhenStuck(llvm::BasicBlock *CurrentBlock, llvm::Module *Module, KORESy
     llvm::Value *Block = allocateTerm(BlockType, CurrentBlock);
     llvm::Value *BlockHeaderPtr = llvm::GetElementPtrInst::CreateInBounds(BlockType, Block, {llvm::ConstantInt::get(llvm::Type::getInt64Ty(Ctx), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(Ctx), 0)}, symbol->getName(), CurrentBlock);
     new llvm::StoreInst(BlockHeader, BlockHeaderPtr, CurrentBlock);
+    countTermAllocation(BlockHeader, Module, CurrentBlock);
     for (int idx = 0; idx < symbol->getArguments().size(); idx++) {
       auto cat = dynamic_cast<KORECompositeSort *>(symbol->getArguments()[idx].get())->getCategory(d);
       auto type = getParamType(cat, Module);
@@ -629,6 +640,7 @@ std::pair<std::vector<llvm::Value *>, llvm::BasicBlock *> stepFunctionHeader(uns
     i++;
   }
   auto arr = module->getOrInsertGlobal("gc_roots", llvm::ArrayType::get(llvm::Type::getInt8PtrTy(module->getContext()), 256));
+  llvm::dyn_cast<llvm::GlobalVariable>(arr)->setThreadLocal(true);
   std::vector<llvm::Value *> rootPtrs;
   for (unsigned i = 0; i < nroots; i++) {
     auto ptr = llvm::GetElementPtrInst::CreateInBounds(llvm::dyn_cast<llvm::PointerType>(arr->getType())->getElementType(), arr, {llvm::ConstantInt::get(llvm::Type::getInt64Ty(module->getContext()), 0), llvm::ConstantInt::get(llvm::Type::getInt64Ty(module->getContext()), i)}, "", collect);
@@ -748,6 +760,11 @@ void makeStepFunction(KOREDefinition *definition, llvm::Module *module, Decision
   auto result = stepFunctionHeader(0, module, definition, block, stuck, {val}, {{SortCategory::Symbol, 0}});
   auto collectedVal = result.first[0];
   collectedVal->setName("_1");
+  // lets the status reports of the runtime find the configuration being
+  // rewritten.
+  auto current = module->getOrInsertGlobal("current_configuration", blockType);
+  llvm::dyn_cast<llvm::GlobalVariable>(current)->setThreadLocal(true);
+  new llvm::StoreInst(collectedVal, current, result.second);
   Decision codegen(definition, result.second, fail, jump, choiceBuffer, choiceDepth, module, {SortCategory::Symbol, 0}, nullptr, nullptr, nullptr, resultBuffer, resultCount, resultCapacity);
   codegen.store(std::make_pair(collectedVal->getName().str(), collectedVal->getType()), collectedVal);
   if (search) {
@@ -801,6 +818,39 @@ void makeMatchReasonFunction(KOREDefinition *definition, llvm::Module *module, K
   codegen(dt);
 }
 
+void makeSearchPatternFunction(KOREDefinition *definition, llvm::Module *module, DecisionNode *dt) {
+  auto blockType = getValueType({SortCategory::Symbol, 0}, module);
+  auto boolType = llvm::Type::getInt1Ty(module->getContext());
+  llvm::FunctionType *funcType = llvm::FunctionType::get(boolType, {blockType}, false);
+  std::string name = "search_pattern";
+  llvm::Function *matchFunc = getOrInsertFunction(module, name, funcType);
+  auto debugType = getDebugType({SortCategory::Symbol, 0}, "SortGeneratedTopCell{}");
+  resetDebugLoc();
+  initDebugFunction(name, name, getDebugFunctionType(getBoolDebugType(), {debugType}), definition, matchFunc);
+  auto val = matchFunc->arg_begin();
+  llvm::BasicBlock *block = llvm::BasicBlock::Create(module->getContext(), "entry", matchFunc);
+  initDebugParam(matchFunc, 0, "subject", {SortCategory::Symbol, 0}, "SortGeneratedTopCell{}");
+  if (!dt) {
+    llvm::ReturnInst::Create(module->getContext(), llvm::ConstantInt::getTrue(module->getContext()), block);
+    return;
+  }
+  llvm::BasicBlock *stuck = llvm::BasicBlock::Create(module->getContext(), "stuck", matchFunc);
+  llvm::BasicBlock *pre_stuck = llvm::BasicBlock::Create(module->getContext(), "pre_stuck", matchFunc);
+  llvm::BasicBlock *fail = llvm::BasicBlock::Create(module->getContext(), "fail", matchFunc);
+
+  llvm::AllocaInst *choiceBuffer, *choiceDepth;
+  llvm::IndirectBrInst *jump;
+  initChoiceBuffer(dt, module, block, pre_stuck, fail, &choiceBuffer, &choiceDepth, &jump);
+
+  llvm::BranchInst::Create(stuck, pre_stuck);
+  val->setName("_1");
+  Decision codegen(definition, block, fail, jump, choiceBuffer, choiceDepth, module, {SortCategory::Symbol, 0}, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, true);
+  codegen.store(std::make_pair(val->getName().str(), val->getType()), val);
+  llvm::ReturnInst::Create(module->getContext(), llvm::ConstantInt::getFalse(module->getContext()), stuck);
+
+  codegen(dt);
+}
+
 
 
 // TODO: actually collect the return value of this function. Right now it
@@ -2,6 +2,7 @@
 #include "kllvm/codegen/CreateTerm.h"
 #include "kllvm/codegen/Util.h"
 #include "kllvm/codegen/Debug.h"
+#include "kllvm/codegen/Safepoints.h"
 
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
@@ -310,6 +311,15 @@ static std::pair<llvm::Value *, llvm::BasicBlock *> getEval(KOREDefinition *def,
 static void emitEvaluateFunctionSymbol(KOREDefinition *def, llvm::Module *mod) {
   emitDataForSymbol("evaluateFunctionSymbol", llvm::Type::getInt8PtrTy(mod->getContext()), nullptr,
       def, mod, true, getEval);
+  // evaluateFunctionSymbol is called by the runtime while it holds pointers
+  // into the heap, so the functions it evaluates must not collect.
+  llvm::Function *func = mod->getFunction("evaluateFunctionSymbol");
+  addToSafepointInhibit(1, func->getEntryBlock().getTerminator());
+  for (auto &block : *func) {
+    if (auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator())) {
+      addToSafepointInhibit(-1, ret);
+    }
+  }
 }
 
 static void emitGetTagForFreshSort(KOREDefinition *definition, llvm::Module *module) {
@@ -0,0 +1,158 @@
+#include "kllvm/codegen/RuleProfile.h"
+#include "kllvm/codegen/Util.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+namespace kllvm {
+
+int CODEGEN_PROFILE;
+
+static std::string SOURCE_ATT = "org'Stop'kframework'Stop'attributes'Stop'Source";
+static std::string LOCATION_ATT = "org'Stop'kframework'Stop'attributes'Stop'Location";
+static std::string PROFILE_TABLE = "kllvm_rule_profile";
+
+// the fields of an entry of the table: the number of applications, the cycles
+// spent in the rule and the cycles spent in its side condition.
+static const unsigned COUNT_FIELD = 0, CYCLES_FIELD = 1, CONDITION_CYCLES_FIELD = 2;
+
+static std::string stringAttribute(KOREAxiomDeclaration *axiom, const std::string &name) {
+  return axiom->getAttributes().count(name) ? axiom->getStringAttribute(name) : "";
+}
+
+// returns the source location of an axiom as <file>:<line>:<column>, as
+// printed by llvm-kompile-compute-loc, or an empty string if it has none.
+static std::string sourceLocation(KOREAxiomDeclaration *axiom) {
+  // the attributes are Source(<file>) and
+  // Location(<line>,<column>,<end line>,<end column>).
+  std::string source = stringAttribute(axiom, SOURCE_ATT);
+  std::string location = stringAttribute(axiom, LOCATION_ATT);
+  if (source.size() < 8 || location.size() < 10) {
+    return "";
+  }
+  size_t first_comma = location.find_first_of(',');
+  size_t second_comma = location.find_first_of(',', first_comma + 1);
+  return source.substr(7, source.length() - 8) + ":" + location.substr(9, first_comma - 9) + ":"
+      + location.substr(first_comma + 1, second_comma - first_comma - 1);
+}
+
+static llvm::Constant *getStringPtr(llvm::Module *module, const std::string &str) {
+  llvm::LLVMContext &Ctx = module->getContext();
+  auto Str = llvm::ConstantDataArray::getString(Ctx, str, true);
+  auto globalVar = new llvm::GlobalVariable(*module, Str->getType(), true, llvm::GlobalValue::PrivateLinkage, Str, "rule_profile_str");
+  llvm::Constant *zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(Ctx), 0);
+  auto indices = std::vector<llvm::Constant *>{zero, zero};
+  return llvm::ConstantExpr::getInBoundsGetElementPtr(Str->getType(), globalVar, indices);
+}
+
+// returns a pointer to the first element of a constant array of strings.
+static llvm::Constant *getStringArray(llvm::Module *module, const std::vector<llvm::Constant *> &strings, const std::string &name) {
+  llvm::LLVMContext &Ctx = module->getContext();
+  auto type = llvm::ArrayType::get(llvm::Type::getInt8PtrTy(Ctx), strings.size());
+  auto globalVar = new llvm::GlobalVariable(*module, type, true, llvm::GlobalValue::PrivateLinkage, llvm::ConstantArray::get(type, strings), name);
+  llvm::Constant *zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(Ctx), 0);
+  auto indices = std::vector<llvm::Constant *>{zero, zero};
+  return llvm::ConstantExpr::getInBoundsGetElementPtr(type, globalVar, indices);
+}
+
+void initRuleProfile(KOREDefinition *definition, llvm::Module *module) {
+  if (!CODEGEN_PROFILE) {
+    return;
+  }
+  llvm::LLVMContext &Ctx = module->getContext();
+  unsigned numRules = 0;
+  for (auto axiom : definition->getAxioms()) {
+    numRules = std::max(numRules, axiom->getOrdinal() + 1);
+  }
+  std::vector<llvm::Constant *> labels, locations;
+  for (unsigned ordinal = 0; ordinal < numRules; ordinal++) {
+    KOREAxiomDeclaration *axiom = definition->getAxiomByOrdinal(ordinal);
+    labels.push_back(getStringPtr(module, stringAttribute(axiom, "label")));
+    locations.push_back(getStringPtr(module, sourceLocation(axiom)));
+  }
+
+  auto i64 = llvm::Type::getInt64Ty(Ctx);
+  auto entryType = llvm::StructType::get(Ctx, {i64, i64, i64});
+  auto tableType = llvm::ArrayType::get(entryType, numRules);
+  auto table = new llvm::GlobalVariable(*module, tableType, false, llvm::GlobalValue::InternalLinkage, llvm::ConstantAggregateZero::get(tableType), PROFILE_TABLE);
+
+  auto i8Ptr = llvm::Type::getInt8PtrTy(Ctx);
+  auto i8PtrPtr = llvm::PointerType::getUnqual(i8Ptr);
+  auto registerType = llvm::FunctionType::get(llvm::Type::getVoidTy(Ctx), {i8Ptr, i8PtrPtr, i8PtrPtr, i64}, false);
+  auto ctor = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(Ctx), false), llvm::GlobalValue::InternalLinkage, "kllvm_register_rule_profile", module);
+  auto block = llvm::BasicBlock::Create(Ctx, "entry", ctor);
+  llvm::CallInst::Create(getOrInsertFunction(module, "registerRuleProfile", registerType),
+      {llvm::ConstantExpr::getBitCast(table, i8Ptr), getStringArray(module, labels, "rule_profile_labels"),
+       getStringArray(module, locations, "rule_profile_locations"), llvm::ConstantInt::get(i64, numRules)},
+      "", block);
+  llvm::ReturnInst::Create(Ctx, block);
+  llvm::appendToGlobalCtors(*module, ctor, 0);
+}
+
+// adds value to a field of the entry of a rule in the table.
+static void addToEntry(unsigned ordinal, unsigned field, llvm::Value *value, llvm::Module *module, llvm::BasicBlock *block) {
+  llvm::LLVMContext &Ctx = module->getContext();
+  llvm::GlobalVariable *table = module->getNamedGlobal(PROFILE_TABLE);
+  auto ptr = llvm::GetElementPtrInst::CreateInBounds(table->getValueType(), table,
+      {llvm::ConstantInt::get(llvm::Type::getInt64Ty(Ctx), 0), llvm::ConstantInt::get(llvm::Type::getInt64Ty(Ctx), ordinal),
+       llvm::ConstantInt::get(llvm::Type::getInt32Ty(Ctx), field)},
+      "", block);
+  auto old = new llvm::LoadInst(llvm::Type::getInt64Ty(Ctx), ptr, "", block);
+  auto sum = llvm::BinaryOperator::Create(llvm::Instruction::Add, old, value, "", block);
+  new llvm::StoreInst(sum, ptr, block);
+}
+
+void countRuleApplication(unsigned ordinal, llvm::Module *module, llvm::BasicBlock *block) {
+  if (!CODEGEN_PROFILE) {
+    return;
+  }
+  addToEntry(ordinal, COUNT_FIELD, llvm::ConstantInt::get(llvm::Type::getInt64Ty(module->getContext()), 1), module, block);
+}
+
+llvm::Value *startRuleCycles(llvm::Module *module, llvm::BasicBlock *block) {
+  if (CODEGEN_PROFILE < 2) {
+    return nullptr;
+  }
+  return llvm::CallInst::Create(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::readcyclecounter), {}, "", block);
+}
+
+void stopRuleCycles(unsigned ordinal, bool sideCondition, llvm::Value *start, llvm::Module *module, llvm::BasicBlock *block) {
+  if (!start) {
+    return;
+  }
+  auto now = llvm::CallInst::Create(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::readcyclecounter), {}, "", block);
+  auto cycles = llvm::BinaryOperator::Create(llvm::Instruction::Sub, now, start, "", block);
+  addToEntry(ordinal, sideCondition ? CONDITION_CYCLES_FIELD : CYCLES_FIELD, cycles, module, block);
+}
+
+llvm::Value *enterRuleAllocations(unsigned ordinal, llvm::Module *module, llvm::BasicBlock *block) {
+#ifdef ALLOC_STATS
+  auto i64 = llvm::Type::getInt64Ty(module->getContext());
+  auto enter = getOrInsertFunction(module, "allocStatsEnterRule", llvm::FunctionType::get(i64, {i64}, false));
+  return llvm::CallInst::Create(enter, {llvm::ConstantInt::get(i64, ordinal)}, "", block);
+#else
+  return nullptr;
+#endif
+}
+
+void exitRuleAllocations(llvm::Value *previous, llvm::Module *module, llvm::BasicBlock *block) {
+  if (!previous) {
+    return;
+  }
+  auto i64 = llvm::Type::getInt64Ty(module->getContext());
+  auto enter = getOrInsertFunction(module, "allocStatsEnterRule", llvm::FunctionType::get(i64, {i64}, false));
+  llvm::CallInst::Create(enter, {previous}, "", block);
+}
+
+void countTermAllocation(llvm::Value *blockHeader, llvm::Module *module, llvm::BasicBlock *block) {
+#ifdef ALLOC_STATS
+  auto &Ctx = module->getContext();
+  auto hdr = llvm::ExtractValueInst::Create(blockHeader, {0}, "", block);
+  auto count = getOrInsertFunction(module, "allocStatsTerm", llvm::FunctionType::get(llvm::Type::getVoidTy(Ctx), {llvm::Type::getInt64Ty(Ctx)}, false));
+  llvm::CallInst::Create(count, {hdr}, "", block);
+#endif
+}
+
+}
@@ -0,0 +1,630 @@
+#include "kllvm/codegen/Safepoints.h"
+#include "kllvm/codegen/Util.h"
+#include "kllvm/ast/AST.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace kllvm {
+
+static std::string MAP_STRUCT = "map";
+static std::string LIST_STRUCT = "list";
+static std::string SET_STRUCT = "set";
+static std::string INT_WRAPPER_STRUCT = "mpz_hdr";
+static std::string INT_STRUCT = "mpz";
+static std::string FLOAT_WRAPPER_STRUCT = "floating_hdr";
+static std::string FLOAT_STRUCT = "floating";
+static std::string BUFFER_STRUCT = "stringbuffer";
+static std::string BLOCKHEADER_STRUCT = "blockheader";
+static std::string LAYOUTITEM_STRUCT = "layoutitem";
+
+static llvm::GlobalVariable *getThreadLocal(llvm::Module *module, std::string name, llvm::Type *type) {
+  auto var = llvm::dyn_cast<llvm::GlobalVariable>(module->getOrInsertGlobal(name, type));
+  var->setThreadLocal(true);
+  return var;
+}
+
+void addToSafepointInhibit(int64_t delta, llvm::Instruction *insertBefore) {
+  llvm::Module *module = insertBefore->getModule();
+  llvm::Type *i64 = llvm::Type::getInt64Ty(module->getContext());
+  auto inhibit = getThreadLocal(module, "gc_safepoint_inhibit", i64);
+  auto old = new llvm::LoadInst(i64, inhibit, "", insertBefore);
+  auto updated = llvm::BinaryOperator::CreateAdd(old, llvm::ConstantInt::get(i64, delta, true), "", insertBefore);
+  new llvm::StoreInst(updated, inhibit, insertBefore);
+}
+
+static bool isStruct(llvm::Type *type, std::string const &name) {
+  auto structType = llvm::dyn_cast<llvm::StructType>(type);
+  return structType && structType->hasName() && structType->getName() == name;
+}
+
+static bool containsPointer(llvm::Type *type) {
+  if (type->isPointerTy()) {
+    return true;
+  }
+  if (auto structType = llvm::dyn_cast<llvm::StructType>(type)) {
+    for (auto elem : structType->elements()) {
+      if (containsPointer(elem)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (auto arrayType = llvm::dyn_cast<llvm::ArrayType>(type)) {
+    return containsPointer(arrayType->getElementType());
+  }
+  return type->isVectorTy() && type->getScalarType()->isPointerTy();
+}
+
+static SortCategory getCollectionCategory(llvm::Type *type) {
+  if (isStruct(type, MAP_STRUCT)) {
+    return SortCategory::Map;
+  } else if (isStruct(type, LIST_STRUCT)) {
+    return SortCategory::List;
+  } else if (isStruct(type, SET_STRUCT)) {
+    return SortCategory::Set;
+  }
+  return SortCategory::Uncomputed;
+}
+
+// Strips the address computations off a pointer, returning the pointer they
+// are derived from.
+static llvm::Value *getBase(llvm::Value *val) {
+  while (true) {
+    if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(val)) {
+      val = gep->getPointerOperand();
+    } else if (auto cast = llvm::dyn_cast<llvm::BitCastOperator>(val)) {
+      val = cast->getOperand(0);
+    } else {
+      return val;
+    }
+  }
+}
+
+static llvm::Function *getCallee(llvm::CallInst *call) {
+#if __clang_major__ >= 11
+  llvm::Value *callee = call->getCalledOperand();
+#else
+  llvm::Value *callee = call->getCalledValue();
+#endif
+  return llvm::dyn_cast<llvm::Function>(callee->stripPointerCasts());
+}
+
+// Returns true if a collection can happen during the call: calls to K
+// functions and to the collector itself.
+static bool isSafepoint(llvm::CallInst *call) {
+  llvm::Function *callee = getCallee(call);
+  if (!callee) {
+    return true;
+  }
+  if (callee->isIntrinsic()) {
+    return false;
+  }
+  return call->getCallingConv() == llvm::CallingConv::Fast
+    || callee->getName() == "koreCollect"
+    || callee->getName() == "koreCollectSafepoint";
+}
+
+// Returns true if nothing but the result of the call is used after it.
+static bool isTailPosition(llvm::CallInst *call) {
+  auto ret = llvm::dyn_cast<llvm::ReturnInst>(call->getNextNode());
+  if (!ret) {
+    return false;
+  }
+  llvm::Value *val = ret->getReturnValue();
+  return !val || val == call;
+}
+
+// Returns true if the address of stack memory can be read through ptr by
+// another function.
+static bool escapes(llvm::Value *ptr, std::set<llvm::Value *> &visited) {
+  if (!visited.insert(ptr).second) {
+    return false;
+  }
+  for (auto user : ptr->users()) {
+    if (llvm::isa<llvm::LoadInst>(user)) {
+      continue;
+    }
+    if (auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+      if (store->getValueOperand() == ptr) {
+        return true;
+      }
+      continue;
+    }
+    if (llvm::isa<llvm::GetElementPtrInst>(user) || llvm::isa<llvm::BitCastInst>(user)
+        || llvm::isa<llvm::PHINode>(user) || llvm::isa<llvm::SelectInst>(user)) {
+      if (escapes(user, visited)) {
+        return true;
+      }
+      continue;
+    }
+    return true;
+  }
+  return false;
+}
+
+namespace {
+
+// How a value that is live across a safepoint is treated by the collector.
+enum class Root {
+  // the value does not point into the heap.
+  None,
+  // the value is stored in the frame and relocated by the collector.
+  Relocatable,
+  // the value points into the heap but cannot be relocated.
+  Unknown,
+};
+
+struct Candidate {
+  llvm::Value *val;
+  Root kind;
+  SortCategory cat;
+  // the value is stored into the frame right after this instruction, or
+  // right after the frame is pushed for arguments.
+  llvm::Instruction *spillAfter;
+  llvm::BasicBlock *block;
+  int index;
+  std::vector<llvm::CallInst *> liveAcross;
+};
+
+class SafepointFunction {
+public:
+  SafepointFunction(llvm::Function *func, unsigned ordinal)
+    : Func(func), Module(func->getParent()), Ctx(func->getContext()), Ordinal(ordinal) {}
+
+  void run();
+
+private:
+  llvm::Function *Func;
+  llvm::Module *Module;
+  llvm::LLVMContext &Ctx;
+  unsigned Ordinal;
+
+  llvm::DenseMap<llvm::Instruction *, int> Index;
+  std::map<llvm::BasicBlock *, std::vector<llvm::CallInst *>> Safepoints;
+  std::vector<llvm::CallInst *> TailCalls;
+  std::vector<Candidate> Candidates;
+  llvm::CallInst *Poll = nullptr;
+
+  void promoteAllocas();
+  void insertPoll();
+  void setLocation(llvm::Instruction *inst);
+  Root classify(llvm::Value *val, SortCategory &cat);
+  void addCandidate(llvm::Value *val, llvm::Instruction *spillAfter, llvm::BasicBlock *block, int index);
+  std::vector<llvm::CallInst *> getLiveAcross(llvm::Value *val, llvm::BasicBlock *defBlock, int defIndex);
+  bool stackEscapes();
+};
+
+}
+
+void SafepointFunction::promoteAllocas() {
+  std::vector<llvm::AllocaInst *> allocas;
+  for (auto &inst : Func->getEntryBlock()) {
+    if (auto alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst)) {
+      if (llvm::isAllocaPromotable(alloca)) {
+        allocas.push_back(alloca);
+      }
+    }
+  }
+  if (!allocas.empty()) {
+    llvm::DominatorTree DT(*Func);
+    llvm::PromoteMemToReg(allocas, DT);
+  }
+}
+
+void SafepointFunction::setLocation(llvm::Instruction *inst) {
+  if (auto scope = Func->getSubprogram()) {
+    inst->setDebugLoc(llvm::DILocation::get(Ctx, 0, 0, scope));
+  }
+}
+
+// Collects at the entry of the function if a collection is due and
+// safepoints are not inhibited.
+void SafepointFunction::insertPoll() {
+  llvm::BasicBlock &entry = Func->getEntryBlock();
+  auto first = entry.begin();
+  while (llvm::isa<llvm::AllocaInst>(&*first)) {
+    ++first;
+  }
+  llvm::BasicBlock *body = entry.splitBasicBlock(first, "body");
+  entry.getTerminator()->eraseFromParent();
+  auto check = llvm::BasicBlock::Create(Ctx, "checkSafepoint", Func, body);
+  auto collect = llvm::BasicBlock::Create(Ctx, "safepoint", Func, body);
+
+  llvm::Type *i64 = llvm::Type::getInt64Ty(Ctx);
+  auto inhibit = new llvm::LoadInst(i64, getThreadLocal(Module, "gc_safepoint_inhibit", i64), "", &entry);
+  auto enabled = new llvm::ICmpInst(entry, llvm::CmpInst::ICMP_EQ, inhibit, llvm::ConstantInt::get(i64, 0));
+  llvm::BranchInst::Create(check, body, enabled, &entry);
+
+  auto collection = getOrInsertFunction(Module, "is_collection", llvm::FunctionType::get(llvm::Type::getInt1Ty(Ctx), {}, false));
+  auto isCollection = llvm::CallInst::Create(collection, {}, "", check);
+  setLocation(isCollection);
+  llvm::BranchInst::Create(collect, body, isCollection, check);
+
+  auto safepoint = getOrInsertFunction(Module, "koreCollectSafepoint", llvm::FunctionType::get(llvm::Type::getVoidTy(Ctx), {}, false));
+  Poll = llvm::CallInst::Create(safepoint, {}, "", collect);
+  setLocation(Poll);
+  llvm::BranchInst::Create(body, collect);
+}
+
+Root SafepointFunction::classify(llvm::Value *val, SortCategory &cat) {
+  if (!containsPointer(val->getType())) {
+    return Root::None;
+  }
+  llvm::Value *base = getBase(val);
+  if (llvm::isa<llvm::Constant>(base)) {
+    return Root::None;
+  }
+  if (auto alloca = llvm::dyn_cast<llvm::AllocaInst>(base)) {
+    llvm::Type *type = alloca->getAllocatedType();
+    cat = getCollectionCategory(type);
+    if (cat != SortCategory::Uncomputed) {
+      // the collection is relocated in place on the stack.
+      return val == base ? Root::Relocatable : Root::Unknown;
+    }
+    if (!containsPointer(type) || alloca->getName() == "choiceBuffer") {
+      return Root::None;
+    }
+    return Root::Unknown;
+  }
+  if (auto call = llvm::dyn_cast<llvm::CallInst>(base)) {
+    llvm::Function *callee = getCallee(call);
+    if (callee && callee->getName().startswith("koreAlloc")) {
+      // a term is allocated before its children are evaluated, so it may be
+      // only partly initialized at a safepoint, and must not be scanned.
+      return Root::Unknown;
+    }
+  }
+  if (val != base || !val->getType()->isPointerTy()) {
+    return Root::Unknown;
+  }
+  llvm::Type *pointee = val->getType()->getPointerElementType();
+  if (isStruct(pointee, INT_STRUCT)) {
+    cat = SortCategory::Int;
+    return Root::Relocatable;
+  } else if (isStruct(pointee, FLOAT_STRUCT)) {
+    cat = SortCategory::Float;
+    return Root::Relocatable;
+  } else if (isStruct(pointee, BUFFER_STRUCT)) {
+    cat = SortCategory::StringBuffer;
+    return Root::Relocatable;
+  }
+  auto structType = llvm::dyn_cast<llvm::StructType>(pointee);
+  if (structType && !structType->isOpaque() && structType->getNumElements()
+      && isStruct(structType->getElementType(0), BLOCKHEADER_STRUCT)
+      && !isStruct(pointee, INT_WRAPPER_STRUCT) && !isStruct(pointee, FLOAT_WRAPPER_STRUCT)) {
+    cat = SortCategory::Symbol;
+    return Root::Relocatable;
+  }
+  return Root::Unknown;
+}
+
+// Returns the safepoints across which val is live, given that it is defined at
+// position defIndex of defBlock.
+std::vector<llvm::CallInst *> SafepointFunction::getLiveAcross(llvm::Value *val, llvm::BasicBlock *defBlock, int defIndex) {
+  std::set<llvm::BasicBlock *> liveIn, liveOut;
+  std::map<llvm::BasicBlock *, int> lastUse;
+  std::vector<llvm::BasicBlock *> worklist;
+  auto reach = [&](llvm::BasicBlock *block) {
+    if (block != defBlock && liveIn.insert(block).second) {
+      worklist.push_back(block);
+    }
+  };
+  for (auto &use : val->uses()) {
+    auto user = llvm::dyn_cast<llvm::Instruction>(use.getUser());
+    if (!user) {
+      continue;
+    }
+    if (auto phi = llvm::dyn_cast<llvm::PHINode>(user)) {
+      llvm::BasicBlock *pred = phi->getIncomingBlock(use);
+      liveOut.insert(pred);
+      reach(pred);
+    } else {
+      llvm::BasicBlock *block = user->getParent();
+      auto iter = lastUse.find(block);
+      if (iter == lastUse.end() || iter->second < Index[user]) {
+        lastUse[block] = Index[user];
+      }
+      reach(block);
+    }
+  }
+  while (!worklist.empty()) {
+    llvm::BasicBlock *block = worklist.back();
+    worklist.pop_back();
+    for (auto pred : llvm::predecessors(block)) {
+      liveOut.insert(pred);
+      reach(pred);
+    }
+  }
+  std::set<llvm::BasicBlock *> blocks = liveOut;
+  for (auto &entry : lastUse) {
+    blocks.insert(entry.first);
+  }
+  std::vector<llvm::CallInst *> result;
+  for (auto block : blocks) {
+    auto iter = Safepoints.find(block);
+    if (iter == Safepoints.end()) {
+      continue;
+    }
+    for (auto call : iter->second) {
+      int index = Index[call];
+      if (block == defBlock && index <= defIndex) {
+        continue;
+      }
+      auto use = lastUse.find(block);
+      if (liveOut.count(block) || (use != lastUse.end() && use->second > index)) {
+        result.push_back(call);
+      }
+    }
+  }
+  return result;
+}
+
+void SafepointFunction::addCandidate(llvm::Value *val, llvm::Instruction *spillAfter, llvm::BasicBlock *block, int index) {
+  SortCategory cat = SortCategory::Uncomputed;
+  Root kind = classify(val, cat);
+  if (kind == Root::None) {
+    return;
+  }
+  if (kind == Root::Relocatable && llvm::isa<llvm::AllocaInst>(val)) {
+    // a collection on the stack becomes a root once it is initialized.
+    kind = Root::Unknown;
+    for (auto inst = spillAfter->getNextNode(); inst; inst = inst->getNextNode()) {
+      auto store = llvm::dyn_cast<llvm::StoreInst>(inst);
+      if (store && store->getPointerOperand() == val) {
+        kind = Root::Relocatable;
+        spillAfter = store;
+        index = Index[store];
+        break;
+      }
+      auto call = llvm::dyn_cast<llvm::CallInst>(inst);
+      if (call && isSafepoint(call)) {
+        break;
+      }
+    }
+  }
+  auto liveAcross = getLiveAcross(val, block, index);
+  if (!liveAcross.empty()) {
+    Candidates.push_back({val, kind, cat, spillAfter, block, index, liveAcross});
+  }
+}
+
+bool SafepointFunction::stackEscapes() {
+  std::set<llvm::Value *> visited;
+  for (auto &block : *Func) {
+    for (auto &inst : block) {
+      if (llvm::isa<llvm::AllocaInst>(&inst) && escapes(&inst, visited)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void SafepointFunction::run() {
+  promoteAllocas();
+  if (Func->getName().startswith("eval_")) {
+    insertPoll();
+  }
+  for (auto &block : *Func) {
+    int index = 0;
+    for (auto &inst : block) {
+      Index[&inst] = index++;
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        if (isTailPosition(call)) {
+          TailCalls.push_back(call);
+        } else if (isSafepoint(call)) {
+          Safepoints[&block].push_back(call);
+        }
+      }
+    }
+  }
+  if (Safepoints.empty()) {
+    return;
+  }
+
+  llvm::BasicBlock *entry = &Func->getEntryBlock();
+  for (auto &arg : Func->args()) {
+    addCandidate(&arg, nullptr, entry, -1);
+  }
+  for (auto &block : *Func) {
+    for (auto &inst : block) {
+      if (!inst.getType()->isVoidTy()) {
+        addCandidate(&inst, &inst, &block, Index[&inst]);
+      }
+    }
+  }
+
+  // a safepoint is inhibited while a value that cannot be relocated is live
+  // across it.
+  std::set<llvm::CallInst *> inhibited;
+  for (auto &candidate : Candidates) {
+    if (candidate.kind == Root::Unknown) {
+      inhibited.insert(candidate.liveAcross.begin(), candidate.liveAcross.end());
+    }
+  }
+  if (Poll && inhibited.count(Poll)) {
+    // koreCollectSafepoint would collect anyway, since the poll has already
+    // checked gc_safepoint_inhibit, so an inhibited poll is removed.
+    inhibited.erase(Poll);
+    auto &calls = Safepoints[Poll->getParent()];
+    calls.erase(std::find(calls.begin(), calls.end(), Poll));
+    for (auto &candidate : Candidates) {
+      auto &across = candidate.liveAcross;
+      across.erase(std::remove(across.begin(), across.end(), Poll), across.end());
+    }
+    Poll->eraseFromParent();
+    Poll = nullptr;
+  }
+  std::vector<Candidate *> roots;
+  for (auto &candidate : Candidates) {
+    if (candidate.kind != Root::Relocatable) {
+      continue;
+    }
+    for (auto call : candidate.liveAcross) {
+      if (!inhibited.count(call)) {
+        roots.push_back(&candidate);
+        break;
+      }
+    }
+  }
+
+  // every use of a root that may follow a safepoint reads it from the frame.
+  // Uses between the definition and the first safepoint keep the value.
+  std::vector<std::vector<llvm::Use *>> reloads(roots.size());
+  for (unsigned i = 0; i < roots.size(); i++) {
+    Candidate *root = roots[i];
+    int firstSafepoint = INT_MAX;
+    for (auto call : Safepoints[root->block]) {
+      int index = Index[call];
+      if (index > root->index && index < firstSafepoint && !inhibited.count(call)) {
+        firstSafepoint = index;
+      }
+    }
+    for (auto &use : root->val->uses()) {
+      auto user = llvm::cast<llvm::Instruction>(use.getUser());
+      if (auto phi = llvm::dyn_cast<llvm::PHINode>(user)) {
+        if (phi->getIncomingBlock(use) == root->block && firstSafepoint == INT_MAX) {
+          continue;
+        }
+      } else if (user->getParent() == root->block && Index[user] <= firstSafepoint) {
+        continue;
+      }
+      reloads[i].push_back(&use);
+    }
+  }
+
+  for (auto call : inhibited) {
+    addToSafepointInhibit(1, call);
+    addToSafepointInhibit(-1, call->getNextNode());
+  }
+  if (roots.empty()) {
+    return;
+  }
+  bool canTailCall = Func->getCallingConv() == llvm::CallingConv::Fast && !stackEscapes();
+
+  // the frame: { i8 *prev, i64 nroots, %layoutitem *layout, [nroots x i8 *] roots }
+  llvm::Type *i8Ptr = llvm::Type::getInt8PtrTy(Ctx);
+  llvm::Type *i32 = llvm::Type::getInt32Ty(Ctx);
+  llvm::Type *i64 = llvm::Type::getInt64Ty(Ctx);
+  llvm::StructType *layoutItem = getTypeByName(Module, LAYOUTITEM_STRUCT);
+  auto frameType = llvm::StructType::get(Ctx, {i8Ptr, i64, llvm::PointerType::getUnqual(layoutItem), llvm::ArrayType::get(i8Ptr, roots.size())});
+  auto frame = new llvm::AllocaInst(frameType, 0, "gc_frame", &*entry->begin());
+  auto pushPoint = &*entry->begin();
+  while (llvm::isa<llvm::AllocaInst>(pushPoint)) {
+    pushPoint = pushPoint->getNextNode();
+  }
+
+  std::vector<llvm::Constant *> elements;
+  for (unsigned i = 0; i < roots.size(); i++) {
+    elements.push_back(llvm::ConstantStruct::get(layoutItem, llvm::ConstantInt::get(i64, i * 8), llvm::ConstantInt::get(llvm::Type::getInt16Ty(Ctx), (int)roots[i]->cat)));
+  }
+  auto layoutArr = llvm::ConstantArray::get(llvm::ArrayType::get(layoutItem, elements.size()), elements);
+  auto layout = llvm::dyn_cast<llvm::GlobalVariable>(Module->getOrInsertGlobal("gc_frame_layout_" + std::to_string(Ordinal), layoutArr->getType()));
+  layout->setInitializer(layoutArr);
+  layout->setConstant(true);
+  layout->setLinkage(llvm::GlobalValue::PrivateLinkage);
+  llvm::Constant *zero = llvm::ConstantInt::get(i64, 0);
+  auto layoutPtr = llvm::ConstantExpr::getInBoundsGetElementPtr(layoutArr->getType(), layout, std::vector<llvm::Constant *>{zero, zero});
+
+  auto frames = getThreadLocal(Module, "gc_frames", i8Ptr);
+  auto field = [&](std::vector<unsigned> indices, llvm::Instruction *insertBefore) {
+    std::vector<llvm::Value *> idxs{llvm::ConstantInt::get(i32, 0)};
+    for (auto idx : indices) {
+      idxs.push_back(llvm::ConstantInt::get(i32, idx));
+    }
+    return llvm::GetElementPtrInst::CreateInBounds(frameType, frame, idxs, "", insertBefore);
+  };
+  auto prev = new llvm::LoadInst(i8Ptr, frames, "", pushPoint);
+  new llvm::StoreInst(prev, field({0}, pushPoint), pushPoint);
+  new llvm::StoreInst(llvm::ConstantInt::get(i64, roots.size()), field({1}, pushPoint), pushPoint);
+  new llvm::StoreInst(layoutPtr, field({2}, pushPoint), pushPoint);
+  std::vector<llvm::Value *> slots;
+  for (unsigned i = 0; i < roots.size(); i++) {
+    auto slot = field({3, i}, pushPoint);
+    new llvm::StoreInst(llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(i8Ptr)), slot, pushPoint);
+    slots.push_back(slot);
+  }
+  new llvm::StoreInst(new llvm::BitCastInst(frame, i8Ptr, "", pushPoint), frames, pushPoint);
+
+  for (unsigned i = 0; i < roots.size(); i++) {
+    Candidate *root = roots[i];
+    llvm::Instruction *insertBefore;
+    if (!root->spillAfter) {
+      insertBefore = pushPoint;
+    } else if (llvm::isa<llvm::PHINode>(root->spillAfter)) {
+      insertBefore = &*root->block->getFirstInsertionPt();
+    } else {
+      insertBefore = root->spillAfter->getNextNode();
+    }
+    new llvm::StoreInst(new llvm::BitCastInst(root->val, i8Ptr, "", insertBefore), slots[i], insertBefore);
+
+    std::map<llvm::BasicBlock *, llvm::Value *> phiReloads;
+    for (auto use : reloads[i]) {
+      auto user = llvm::cast<llvm::Instruction>(use->getUser());
+      llvm::Instruction *reloadBefore = user;
+      llvm::BasicBlock *pred = nullptr;
+      if (auto phi = llvm::dyn_cast<llvm::PHINode>(user)) {
+        pred = phi->getIncomingBlock(*use);
+        if (phiReloads.count(pred)) {
+          use->set(phiReloads[pred]);
+          continue;
+        }
+        reloadBefore = pred->getTerminator();
+      }
+      auto load = new llvm::LoadInst(i8Ptr, slots[i], "", reloadBefore);
+      auto reloaded = new llvm::BitCastInst(load, root->val->getType(), "", reloadBefore);
+      if (pred) {
+        phiReloads[pred] = reloaded;
+      }
+      use->set(reloaded);
+    }
+  }
+
+  // the frame is popped before returning, and before calls in tail position
+  // so that they can still be compiled as tail calls.
+  auto pop = [&](llvm::Instruction *insertBefore) {
+    auto prev = new llvm::LoadInst(i8Ptr, field({0}, insertBefore), "", insertBefore);
+    new llvm::StoreInst(prev, frames, insertBefore);
+  };
+  std::set<llvm::Instruction *> popped;
+  for (auto call : TailCalls) {
+    pop(call);
+    popped.insert(call->getNextNode());
+    if (canTailCall && call->getCallingConv() == llvm::CallingConv::Fast && getCallee(call)) {
+      call->setTailCall();
+    }
+  }
+  for (auto &block : *Func) {
+    if (auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator())) {
+      if (!popped.count(ret)) {
+        pop(ret);
+      }
+    }
+  }
+}
+
+void addGCSafepoints(llvm::Module *module) {
+  unsigned ordinal = 0;
+  for (auto &func : *module) {
+    if (!func.isDeclaration() && func.getCallingConv() == llvm::CallingConv::Fast) {
+      SafepointFunction(&func, ordinal++).run();
+    }
+  }
+}
+
+}
@@ -1,15 +1,16 @@
 #include "kllvm/ast/AST.h"
 #include "kllvm/parser/KOREScanner.h"
 #include "kllvm/parser/KOREParser.h"
-#include <iostream>
+#include <sstream>
 
 namespace kllvm {
 namespace parser {
 
 void KOREParser::error(
       const location &loc, const std::string &err_message) {
-  std::cerr << "Syntax error at " << loc << ": " << err_message << "\n";
-  exit(-1);
+  std::ostringstream Out;
+  Out << "Syntax error at " << loc << ": " << err_message;
+  throw ParseError(Out.str());
 }
 
 static std::string str(token tok) {
@@ -14,7 +14,9 @@ object Matching {
     val defn = new TextToKore().parse(filename)
     outputFolder.mkdirs()
     val allAxioms = Parser.getAxioms(defn).zipWithIndex
-    val axioms = Parser.parseTopAxioms(allAxioms)
+    val (patternAxioms, ruleAxioms) = allAxioms.partition(a => Parser.hasAtt(a._1.att, "search-pattern"))
+    val axioms = Parser.parseTopAxioms(ruleAxioms)
+    val patterns = Parser.parseTopAxioms(patternAxioms)
     val symlib = Parser.parseSymbols(defn, heuristic)
     val (dt, dtSearch, matrix) = if (axioms.isEmpty) {
       (Failure(), Failure(), null)
@@ -50,6 +52,15 @@ object Matching {
         Generator.mkDecisionTree(symlib, defn, funcAxioms.getOrElse(f, IndexedSeq()), symlib.signatures(f)._1, f, kem)
       }
     })
+    val searchPatternPath = new File(outputFolder, "search-pattern.yaml")
+    if (patterns.nonEmpty) {
+      val patternMatrix = Generator.genClauseMatrix(symlib, defn, patterns, Seq(patterns.head.rewrite.sort))
+      patternMatrix.compile.serializeToYaml(searchPatternPath)
+    } else {
+      // the code generator matches search results against the patterns in
+      // this file if it exists, so remove one left by an earlier compilation.
+      searchPatternPath.delete()
+    }
     val path = new File(outputFolder, "dt.yaml")
     val pathSearch = new File(outputFolder, "dt-search.yaml")
     dt.serializeToYaml(path)
@@ -4,10 +4,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <mutex>
+#include <utility>
 
 #include "runtime/alloc.h"
 #include "runtime/header.h"
 #include "runtime/arena.h"
+#include "runtime/largeobject.h"
+#include "runtime/region.h"
 
 extern "C" {
 
@@ -15,6 +19,18 @@ REGISTER_ARENA(youngspace, YOUNGSPACE_ID);
 REGISTER_ARENA(oldspace, OLDSPACE_ID);
 REGISTER_ARENA(alwaysgcspace, ALWAYSGCSPACE_ID);
 
+// objects shared by the heaps of all threads, such as the empty collections.
+// It is only allocated into by koreAllocPermanent, once.
+static struct arena permanentspace = { .allocation_semispace_id = PERMANENTSPACE_ID };
+
+struct arena *youngspace_arena() {
+  return &youngspace;
+}
+
+struct arena *oldspace_arena() {
+  return &oldspace;
+}
+
 char *youngspace_ptr() {
   return arenaStartPtr(&youngspace);
 }
@@ -43,25 +59,47 @@ size_t youngspace_size(void) {
   return arenaSize(&youngspace);
 }
 
-bool youngspaceAlmostFull(size_t threshold) {
-  char *nextBlock = *(char **)youngspace.block_start;
-  if (nextBlock) {
-    // not on the last block, so short circuit and assume that we can keep allocating for now.
-    return false;
+size_t oldspace_used(void) {
+  size_t used = largeObjectOldSize();
+  if (mark_region) {
+    return used + regionUsed();
   }
-  ptrdiff_t freeBytes = youngspace.block_end - youngspace.block;
-  size_t totalBytes = youngspace.num_blocks * (BLOCK_SIZE - sizeof(memory_block_header));
-  return (totalBytes - freeBytes) * 100 > threshold * 95;
+  char *start = oldspace_ptr();
+  return start ? used + ptrDiff(*old_alloc_ptr(), start) : used;
+}
+
+size_t youngspace_used(void) {
+  return arenaUsed(&youngspace);
+}
+
+bool youngspaceAlmostFull(size_t threshold) {
+  return arenaUsed(&youngspace) * 100 > threshold * 95;
 }
 
 void koreAllocSwap(bool swapOld) {
   arenaSwapAndClear(&youngspace);
   arenaClear(&alwaysgcspace);
-  if (swapOld) {
+  if (swapOld && !mark_region) {
     arenaSwapAndClear(&oldspace);
   }
 }
 
+void koreAllocRelease(bool releaseOld) {
+  arenaRelease(&youngspace);
+  if (releaseOld && !mark_region) {
+    arenaRelease(&oldspace);
+  }
+}
+
+void koreAllocPermanent(void (*init)(void)) {
+  static std::once_flag once;
+  std::call_once(once, [init] {
+    std::swap(youngspace, permanentspace);
+    init();
+    std::swap(youngspace, permanentspace);
+  });
+}
+
 void setKoreMemoryFunctionsForGMP() {
    mp_set_memory_functions(koreAllocMP, koreReallocMP, koreFree);
 }
@@ -70,18 +108,28 @@ __attribute__ ((always_inline)) void* koreAlloc(size_t requested) {
   return arenaAlloc(&youngspace, requested);
 }
 
-__attribute__ ((always_inline)) void* koreAllocToken(size_t requested) {
+static inline void* allocToken(size_t requested) {
   size_t size = (requested + 7) & ~7;
   return arenaAlloc(&youngspace, size < 16 ? 16 : size);
 }
 
+__attribute__ ((always_inline)) void* koreAllocToken(size_t requested) {
+#ifdef ALLOC_STATS
+  allocStatsToken(ALLOC_STRING, requested);
+#endif
+  return allocToken(requested);
+}
+
 __attribute__ ((always_inline)) void* koreAllocOld(size_t requested) {
+  if (mark_region) {
+    return regionAlloc(requested);
+  }
   return arenaAlloc(&oldspace, requested);
 }
 
 __attribute__ ((always_inline)) void* koreAllocTokenOld(size_t requested) {
   size_t size = (requested + 7) & ~7;
-  return arenaAlloc(&oldspace, size < 16 ? 16 : size);
+  return koreAllocOld(size < 16 ? 16 : size);
 }
 
 __attribute__ ((always_inline)) void* koreAllocAlwaysGC(size_t requested) {
@@ -106,13 +154,19 @@ void* koreResizeLastAlloc(void* oldptr, size_t newrequest, size_t last_size) {
 }
 
 void* koreAllocMP(size_t requested) {
-  string* _new = (string *) koreAllocToken(sizeof(string) + requested);
+#ifdef ALLOC_STATS
+  allocStatsToken(ALLOC_LIMBS, sizeof(string) + requested);
+#endif
+  string* _new = (string *) allocToken(sizeof(string) + requested);
   set_len(_new, requested);
   return _new->data;
 }
 
 void* koreReallocMP(void* ptr, size_t old_size, size_t new_size) {
-  string* _new = (string *) koreAllocToken(sizeof(string) + new_size);
+#ifdef ALLOC_STATS
+  allocStatsToken(ALLOC_LIMBS, sizeof(string) + new_size);
+#endif
+  string* _new = (string *) allocToken(sizeof(string) + new_size);
   size_t min = old_size > new_size ? new_size : old_size;
   memcpy(_new->data, ptr, min);
   set_len(_new, new_size);
@@ -122,12 +176,18 @@ void* koreReallocMP(void* ptr, size_t old_size, size_t new_size) {
 void koreFree(void* ptr, size_t size) {}
 
 __attribute__ ((always_inline)) void* koreAllocInteger(size_t requested) {
+#ifdef ALLOC_STATS
+  allocStatsToken(ALLOC_INTEGER, sizeof(mpz_hdr));
+#endif
   mpz_hdr *result = (mpz_hdr *) koreAlloc(sizeof(mpz_hdr));
   set_len(result, sizeof(mpz_hdr) - sizeof(blockheader));
   return &result->i;
 }
 
 __attribute__ ((always_inline)) void* koreAllocFloating(size_t requested) {
+#ifdef ALLOC_STATS
+  allocStatsToken(ALLOC_FLOAT, sizeof(floating_hdr));
+#endif
   floating_hdr *result = (floating_hdr *) koreAlloc(sizeof(floating_hdr));
   set_len(result, sizeof(floating_hdr) - sizeof(blockheader));
   return &result->f;
@@ -145,4 +205,13 @@ __attribute__ ((always_inline)) void* koreAllocFloatingOld(size_t requested) {
   return &result->f;
 }
 
+void* koreAllocCollectionNode(size_t size) {
+#ifdef ALLOC_STATS
+  allocStatsToken(ALLOC_COLLECTION, size + sizeof(blockheader));
+#endif
+  string *result = (string *)allocToken(size + sizeof(blockheader));
+  set_len(result, size);
+  return result->data;
+}
+
 }
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "runtime/alloc.h"
+#include "runtime/header.h"
+
+// The allocation profile of AllocStats builds. Each thread counts its own
+// allocations, and the counts of all threads are added up at exit.
+
+struct alloc_count {
+  uint64_t objects, bytes;
+
+  void add(uint64_t size) {
+    objects++;
+    bytes += size;
+  }
+};
+
+struct alloc_stats {
+  // indexed by tag, and by rule ordinal plus one, with zero for allocations
+  // made outside of any rule.
+  std::vector<alloc_count> tags, rules;
+  alloc_count kinds[ALLOC_KINDS];
+};
+
+static const char *KIND_NAMES[ALLOC_KINDS] = {"string", "integer", "integer limbs", "float", "collection node"};
+static const uint64_t NO_RULE = UINT64_MAX;
+
+static std::mutex statsLock;
+static std::vector<alloc_stats *> allStats;
+static thread_local alloc_stats *threadStats = nullptr;
+static thread_local uint64_t currentRule = NO_RULE;
+
+static void writeAllocStats(void);
+
+static alloc_stats &stats(void) {
+  if (!threadStats) {
+    threadStats = new alloc_stats();
+    std::lock_guard<std::mutex> guard(statsLock);
+    if (allStats.empty()) {
+      atexit(writeAllocStats);
+    }
+    allStats.push_back(threadStats);
+  }
+  return *threadStats;
+}
+
+static alloc_count &countAt(std::vector<alloc_count> &counts, uint64_t index) {
+  if (index >= counts.size()) {
+    counts.resize(index + 1, alloc_count{0, 0});
+  }
+  return counts[index];
+}
+
+static void record(alloc_stats &s, alloc_count &count, uint64_t size) {
+  count.add(size);
+  countAt(s.rules, currentRule + 1).add(size);
+}
+
+// writes the counts sorted by bytes, skipping those that are zero.
+static void writeCounts(FILE *file, const std::vector<alloc_count> &counts, const char *header, const std::function<std::string(uint64_t)> &name) {
+  std::vector<uint64_t> order;
+  for (uint64_t i = 0; i < counts.size(); i++) {
+    if (counts[i].objects) {
+      order.push_back(i);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+    return counts[a].bytes > counts[b].bytes;
+  });
+  fprintf(file, "# %s\tobjects\tbytes\n", header);
+  for (uint64_t i : order) {
+    fprintf(file, "%s\t%" PRIu64 "\t%" PRIu64 "\n", name(i).c_str(), counts[i].objects, counts[i].bytes);
+  }
+}
+
+// Writes to the file named by KLLVM_ALLOC_PROFILE, or to
+// alloc-profile.<pid>.txt, the number of objects and bytes allocated for the
+// terms of each symbol, for each kind of token, and by each rule, each as a
+// tab-separated table sorted by bytes. Rules are given by ordinal, which
+// llvm-kompile-compute-loc accepts, with - for allocations made outside of
+// any rule, such as while parsing the input.
+static void writeAllocStats(void) {
+  const char *env = getenv("KLLVM_ALLOC_PROFILE");
+  std::string filename = env ? env : "alloc-profile." + std::to_string(getpid()) + ".txt";
+  FILE *file = fopen(filename.c_str(), "w");
+  if (!file) {
+    perror(filename.c_str());
+    return;
+  }
+  alloc_stats total = alloc_stats();
+  {
+    std::lock_guard<std::mutex> guard(statsLock);
+    for (alloc_stats *s : allStats) {
+      for (uint64_t i = 0; i < s->tags.size(); i++) {
+        countAt(total.tags, i).objects += s->tags[i].objects;
+        countAt(total.tags, i).bytes += s->tags[i].bytes;
+      }
+      for (uint64_t i = 0; i < s->rules.size(); i++) {
+        countAt(total.rules, i).objects += s->rules[i].objects;
+        countAt(total.rules, i).bytes += s->rules[i].bytes;
+      }
+      for (int k = 0; k < ALLOC_KINDS; k++) {
+        total.kinds[k].objects += s->kinds[k].objects;
+        total.kinds[k].bytes += s->kinds[k].bytes;
+      }
+    }
+  }
+  writeCounts(file, total.tags, "symbol", [](uint64_t tag) {
+    return std::string(getSymbolNameForTag(tag));
+  });
+  fprintf(file, "\n");
+  writeCounts(file, std::vector<alloc_count>(total.kinds, total.kinds + ALLOC_KINDS), "token", [](uint64_t kind) {
+    return std::string(KIND_NAMES[kind]);
+  });
+  fprintf(file, "\n");
+  writeCounts(file, total.rules, "rule", [](uint64_t rule) {
+    return rule ? std::to_string(rule - 1) : std::string("-");
+  });
+  fclose(file);
+}
+
+extern "C" {
+
+void allocStatsTerm(uint64_t hdr) {
+  alloc_stats &s = stats();
+  record(s, countAt(s.tags, tag_hdr(hdr)), size_hdr(hdr));
+}
+
+void allocStatsToken(enum alloc_kind kind, size_t size) {
+  if (during_gc()) {
+    return;
+  }
+  size = (size + 7) & ~7;
+  alloc_stats &s = stats();
+  record(s, s.kinds[kind], size < 16 ? 16 : size);
+}
+
+uint64_t allocStatsEnterRule(uint64_t ordinal) {
+  uint64_t previous = currentRule;
+  currentRule = ordinal;
+  return previous;
+}
+
+}
@@ -3,10 +3,15 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "runtime/arena.h"
 #include "runtime/header.h"
 #include "runtime/alloc.h"
+#include "runtime/largeobject.h"
+#include "runtime/region.h"
+#include "runtime/size.h"
  
 const size_t BLOCK_SIZE = 1024 * 1024;
 
@@ -26,6 +31,8 @@ void arenaReset(struct arena *Arena) {
   Arena->first_collection_block = 0;
   Arena->num_blocks = 0;
   Arena->num_collection_blocks = 0;
+  Arena->num_used_blocks = 0;
+  Arena->num_collection_used_blocks = 0;
   Arena->allocation_semispace_id = id;
 }
 
@@ -43,38 +50,152 @@ __attribute__ ((always_inline)) char getArenaSemispaceIDOfObject(void *ptr) {
   return mem_block_header(ptr)->semispace;
 }
 
-static void* first_superblock_ptr = 0;
-static void* superblock_ptr = 0;
-static char** next_superblock_ptr = 0;
-static unsigned blocks_left = 0;
+// The reserved backing store. If KLLVM_HEAP_RESERVE is set to a number of
+// bytes (optionally followed by K, M or G), a contiguous range of that much
+// virtual address space is reserved for each semispace of each thread the
+// first time it needs a block, and blocks are committed from it in order. The
+// blocks of a semispace are therefore adjacent in memory as long as its
+// reservation is not exhausted, which makes ptrDiff constant time, and its
+// memory can be returned to the operating system after a collection by
+// arenaRelease. Blocks are taken from superblocks again once a reservation
+// runs out.
+//
+// The superblocks and reservations of a thread form its block source. A thread
+// normally takes blocks from its own, but the helper threads of a parallel
+// collection take them from the block source of the thread being collected
+// (see arenaUseBlockSource).
+
+struct reservation {
+  char *start;
+  char *committed;
+  char *end;
+};
+
+struct block_source {
+  void* first_superblock_ptr;
+  void* superblock_ptr;
+  char** next_superblock_ptr;
+  unsigned blocks_left;
+  reservation reservations[256];
+};
+
+static thread_local block_source ownSource;
+static thread_local block_source *adoptedSource = 0;
+
+static block_source *currentSource() {
+  return adoptedSource ? adoptedSource : &ownSource;
+}
+
+struct block_source *arenaBlockSource(void) {
+  return &ownSource;
+}
+
+void arenaUseBlockSource(struct block_source *source) {
+  adoptedSource = source;
+}
 
 static void* megabyte_malloc() {
-  if (blocks_left == 0) {
-    blocks_left = 15;
-    if (int result = posix_memalign(&superblock_ptr, BLOCK_SIZE, BLOCK_SIZE * 15)) {
+  block_source *src = currentSource();
+  if (src->blocks_left == 0) {
+    src->blocks_left = 15;
+    if (int result = posix_memalign(&src->superblock_ptr, BLOCK_SIZE, BLOCK_SIZE * 15)) {
       errno = result;
       perror("posix_memalign");
     }
-    if (!first_superblock_ptr) {
-      first_superblock_ptr = superblock_ptr;
+    if (!src->first_superblock_ptr) {
+      src->first_superblock_ptr = src->superblock_ptr;
     }
-    if (next_superblock_ptr) {
-      *next_superblock_ptr = (char *)superblock_ptr;
+    if (src->next_superblock_ptr) {
+      *src->next_superblock_ptr = (char *)src->superblock_ptr;
     }
-    memory_block_header *hdr = (memory_block_header *)superblock_ptr;
-    next_superblock_ptr = &hdr->next_superblock;
+    memory_block_header *hdr = (memory_block_header *)src->superblock_ptr;
+    src->next_superblock_ptr = &hdr->next_superblock;
     hdr->next_superblock = 0;
   }
-  blocks_left--;
-  void* result = superblock_ptr;
-  superblock_ptr = (char *)superblock_ptr + BLOCK_SIZE;
+  src->blocks_left--;
+  void* result = src->superblock_ptr;
+  src->superblock_ptr = (char *)src->superblock_ptr + BLOCK_SIZE;
+  return result;
+}
+
+static size_t heapReserveSize() {
+  const char *env = getenv("KLLVM_HEAP_RESERVE");
+  if (!env) {
+    return 0;
+  }
+  uint64_t size;
+  // a reservation holds whole blocks, so the size must round up to one.
+  if (!parseSize(env, size) || size > SIZE_MAX - (BLOCK_SIZE - 1)) {
+    fprintf(stderr, "Invalid KLLVM_HEAP_RESERVE: %s\n", env);
+    abort();
+  }
+  return (size + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+}
+
+static const size_t reserve_size = heapReserveSize();
+
+static reservation *reservationOf(char semispace) {
+  return &currentSource()->reservations[(unsigned char)semispace];
+}
+
+static void reserve(reservation *r) {
+  char *mapping = (char *)mmap(NULL, reserve_size + BLOCK_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED) {
+    perror("mmap");
+    abort();
+  }
+  char *start = (char *)(((uintptr_t)mapping + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1));
+  if (start != mapping) {
+    munmap(mapping, start - mapping);
+  }
+  munmap(start + reserve_size, mapping + BLOCK_SIZE - start);
+#ifdef MADV_HUGEPAGE
+  madvise(start, reserve_size, MADV_HUGEPAGE);
+#endif
+  r->start = r->committed = start;
+  r->end = start + reserve_size;
+}
+
+// Commits the next block of the reservation of the given semispace, or returns
+// 0 if it is exhausted.
+static void *reservedBlock(char semispace) {
+  reservation *r = reservationOf(semispace);
+  if (!r->start) {
+    reserve(r);
+  }
+  if (r->committed == r->end) {
+    return 0;
+  }
+  char *result = r->committed;
+  if (mprotect(result, BLOCK_SIZE, PROT_READ | PROT_WRITE)) {
+    perror("mprotect");
+    abort();
+  }
+  r->committed += BLOCK_SIZE;
   return result;
 }
 
+// Returns true if the block containing the given address was committed from a
+// reservation.
+static bool isReserved(char *ptr) {
+  char *block = mem_block_start(ptr);
+  reservation *r = reservationOf(((memory_block_header *)block)->semispace);
+  return block >= r->start && block < r->committed;
+}
+
+static void *allocBlock(char semispace) {
+  if (reserve_size) {
+    if (void *result = reservedBlock(semispace)) {
+      return result;
+    }
+  }
+  return megabyte_malloc();
+}
+
 static void freshBlock(struct arena *Arena) {
     char *nextBlock;
     if (Arena->block_start == 0) {
-      nextBlock = (char *)megabyte_malloc();
+      nextBlock = (char *)allocBlock(Arena->allocation_semispace_id);
       Arena->first_block = nextBlock;
       memory_block_header *nextHeader = (memory_block_header *)nextBlock;
       nextHeader->next_block = 0;
@@ -91,7 +212,7 @@ static void freshBlock(struct arena *Arena) {
       }
       if (!nextBlock) {
         MEM_LOG("Allocating new block for the first time in arena %d\n", Arena->allocation_semispace_id);
-        nextBlock = (char *)megabyte_malloc();
+        nextBlock = (char *)allocBlock(Arena->allocation_semispace_id);
         *(char **)Arena->block_start = nextBlock;
         memory_block_header *nextHeader = (memory_block_header *)nextBlock;
         nextHeader->next_block = 0;
@@ -101,6 +222,7 @@ static void freshBlock(struct arena *Arena) {
     }
     Arena->block = nextBlock + sizeof(memory_block_header);
     Arena->block_start = nextBlock;
+    Arena->num_used_blocks++;
     Arena->block_end = nextBlock + BLOCK_SIZE;
     MEM_LOG("New block at %p (remaining %zd)\n", Arena->block, BLOCK_SIZE - sizeof(memory_block_header));
 }
@@ -109,7 +231,7 @@ static __attribute__ ((noinline))
 void *doAllocSlow(size_t requested, struct arena *Arena) {
   MEM_LOG("Block at %p too small, %zd remaining but %zd needed\n", Arena->block, Arena->block_end-Arena->block, requested);
   if (requested > BLOCK_SIZE - sizeof(memory_block_header)) {
-    return malloc(requested);
+    return largeObjectAlloc(requested);
   } else {
     freshBlock(Arena);
     void* result = Arena->block;
@@ -146,6 +268,7 @@ __attribute__ ((always_inline)) void arenaSwapAndClear(struct arena *Arena) {
   size_t tmp2 = Arena->num_blocks;
   Arena->num_blocks = Arena->num_collection_blocks;
   Arena->num_collection_blocks = tmp2;
+  Arena->num_collection_used_blocks = Arena->num_used_blocks;
   Arena->allocation_semispace_id = ~Arena->allocation_semispace_id;
   arenaClear(Arena);
 }
@@ -154,6 +277,37 @@ __attribute__ ((always_inline)) void arenaClear(struct arena *Arena) {
   Arena->block = Arena->first_block ? Arena->first_block + sizeof(memory_block_header) : 0;
   Arena->block_start = Arena->first_block;
   Arena->block_end = Arena->first_block ? Arena->first_block + BLOCK_SIZE : 0;
+  Arena->num_used_blocks = Arena->first_block ? 1 : 0;
+}
+
+void arenaRelease(struct arena *Arena) {
+  if (!reserve_size) {
+    return;
+  }
+  static const size_t page = sysconf(_SC_PAGESIZE);
+  char *block = Arena->first_collection_block;
+  // the blocks used before the swap are kept: the semispace will need about as
+  // many again when it is next allocated into, and releasing them would only
+  // make every collection fault them back in.
+  for (size_t i = 0; block && i < Arena->num_collection_used_blocks; i++) {
+    block = *(char **)block;
+  }
+  while (block) {
+    if (isReserved(block + 1)) {
+      // the first page holds the block header, which is still needed to link
+      // the blocks of the semispace. MADV_FREE lets the kernel take the pages
+      // lazily, under memory pressure, rather than zeroing them on next use.
+      // Kernels older than 4.5 reject it, and get MADV_DONTNEED instead.
+      int result = -1;
+#ifdef MADV_FREE
+      result = madvise(block + page, BLOCK_SIZE - page, MADV_FREE);
+#endif
+      if (result) {
+        madvise(block + page, BLOCK_SIZE - page, MADV_DONTNEED);
+      }
+    }
+    block = *(char **)block;
+  }
 }
 
 __attribute__ ((always_inline)) char *arenaStartPtr(const struct arena *Arena) {
@@ -183,6 +337,13 @@ ssize_t ptrDiff(char *ptr1, char *ptr2) {
   if (mem_block_start(ptr1) == mem_block_start(ptr2)) {
     return ptr1 - ptr2;
   }
+  if (reserve_size && isReserved(ptr1) && isReserved(ptr2)
+      && mem_block_header(ptr1)->semispace == mem_block_header(ptr2)->semispace) {
+    // the blocks between the two pointers are adjacent, so only their headers
+    // have to be skipped.
+    ssize_t blocks = (mem_block_start(ptr1) - mem_block_start(ptr2)) / (ssize_t)BLOCK_SIZE;
+    return ptr1 - ptr2 - blocks * (ssize_t)sizeof(memory_block_header);
+  }
   memory_block_header *hdr = mem_block_header(ptr2);
   ssize_t result = 0;
   while (hdr != mem_block_header(ptr1) && hdr->next_block) {
@@ -209,19 +370,27 @@ ssize_t ptrDiff(char *ptr1, char *ptr2) {
   }
 }
 
+size_t arenaUsed(const struct arena *Arena) {
+  return Arena->num_used_blocks * (BLOCK_SIZE - sizeof(memory_block_header)) - (Arena->block_end - Arena->block);
+}
+
 size_t arenaSize(const struct arena *Arena) {
   return (Arena->num_blocks > Arena->num_collection_blocks ? Arena->num_blocks : Arena->num_collection_blocks) * (BLOCK_SIZE - sizeof(memory_block_header));
 }
 
 void freeAllMemory() {
-  memory_block_header *superblock = (memory_block_header *)first_superblock_ptr;
+  memory_block_header *superblock = (memory_block_header *)ownSource.first_superblock_ptr;
   while (superblock) {
     memory_block_header* next_superblock = (memory_block_header *)superblock->next_superblock;
     free(superblock);
     superblock = next_superblock;
   }
-  first_superblock_ptr = 0;
-  superblock_ptr = 0;
-  next_superblock_ptr = 0;
-  blocks_left = 0;
+  regionFreeAll();
+  largeObjectFreeAll();
+  for (auto &r : ownSource.reservations) {
+    if (r.start) {
+      munmap(r.start, reserve_size);
+    }
+  }
+  ownSource = block_source{};
 }
@@ -0,0 +1,97 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "runtime/alloc.h"
+#include "runtime/header.h"
+#include "runtime/largeobject.h"
+
+extern "C" {
+
+static thread_local large_object *first_object = 0;
+static thread_local size_t old_size = 0;
+
+// offset of an object from the start of its mapping.
+static const size_t OBJECT_OFFSET = (sizeof(large_object) + 15) & ~15;
+
+void *largeObjectAlloc(size_t requested) {
+  static const size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (OBJECT_OFFSET + requested + page - 1) & ~(page - 1);
+  // map an extra block so that the header can be aligned to BLOCK_SIZE, then
+  // return the unused parts on either side to the system.
+  char *mapping = (char *)mmap(NULL, size + BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) {
+    perror("mmap");
+    abort();
+  }
+  char *start = (char *)(((uintptr_t)mapping + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1));
+  if (start != mapping) {
+    munmap(mapping, start - mapping);
+  }
+  char *end = mapping + size + BLOCK_SIZE;
+  if (end != start + size) {
+    munmap(start + size, end - (start + size));
+  }
+  large_object *object = (large_object *)start;
+  object->header.next_block = 0;
+  object->header.next_superblock = 0;
+  object->header.semispace = LARGE_OBJECT_ID;
+  object->next = first_object;
+  object->size = size;
+  object->survived = false;
+  object->old = false;
+  object->marked = false;
+  first_object = object;
+  MEM_LOG("Allocating large object at %p (size %zd)\n", start + OBJECT_OFFSET, requested);
+  return start + OBJECT_OFFSET;
+}
+
+bool largeObjectMark(void *ptr) {
+  return !__atomic_exchange_n(&large_object_of(ptr)->marked, true, __ATOMIC_RELAXED);
+}
+
+void largeObjectSweep(bool collectOld) {
+  large_object **prev = &first_object;
+  large_object *object = first_object;
+  while (object) {
+    large_object *next = object->next;
+    if (object->marked) {
+      object->marked = false;
+      if (!object->old && object->survived) {
+        object->old = true;
+        old_size += object->size;
+      }
+      object->survived = true;
+      prev = &object->next;
+    } else if (object->old && !collectOld) {
+      prev = &object->next;
+    } else {
+      MEM_LOG("Freeing large object at %p\n", (char *)object + OBJECT_OFFSET);
+      if (object->old) {
+        old_size -= object->size;
+      }
+      *prev = next;
+      munmap(object, object->size);
+    }
+    object = next;
+  }
+}
+
+size_t largeObjectOldSize(void) {
+  return old_size;
+}
+
+void largeObjectFreeAll(void) {
+  large_object *object = first_object;
+  while (object) {
+    large_object *next = object->next;
+    munmap(object, object->size);
+    object = next;
+  }
+  first_object = 0;
+  old_size = 0;
+}
+
+}
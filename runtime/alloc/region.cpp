@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "runtime/alloc.h"
+#include "runtime/collect.h"
+#include "runtime/header.h"
+#include "runtime/largeobject.h"
+#include "runtime/region.h"
+
+extern "C" {
+
+// a block whose live bytes are less than this fraction of its capacity is a
+// candidate for evacuation.
+static const size_t EVACUATE_OCCUPANCY_DIVISOR = 4;
+
+static bool useMarkRegion() {
+  const char *env = getenv("KLLVM_OLD_GEN");
+  return env && strcmp(env, "mark-region") == 0;
+}
+
+bool mark_region = useMarkRegion();
+
+struct hole {
+  char *start;
+  char *end;
+};
+
+static thread_local region_block *first_block = 0;
+static thread_local size_t num_blocks = 0;
+static thread_local std::vector<hole> holes;
+static thread_local size_t next_hole = 0;
+static thread_local char *cursor = 0;
+static thread_local char *limit = 0;
+// bytes found live by the last sweep and bytes allocated since.
+static thread_local size_t live_bytes = 0;
+static thread_local size_t allocated_bytes = 0;
+
+static char *blockStart(region_block *block) {
+  return (char *)(block + 1);
+}
+
+static char *blockEnd(region_block *block) {
+  return (char *)block + BLOCK_SIZE;
+}
+
+// Writes a sentinel object covering the given range so that it is skipped by a
+// linear traversal of the block. Uses the same encoding as freshBlock.
+static void fillHole(char *start, char *end) {
+  size_t size = end - start;
+  if (size == 8) {
+    *(uint64_t *)start = NOT_YOUNG_OBJECT_BIT;
+  } else if (size) {
+    *(uint64_t *)start = size - 8;
+  }
+}
+
+static region_block *freshRegionBlock() {
+  void *ptr;
+  if (int result = posix_memalign(&ptr, BLOCK_SIZE, BLOCK_SIZE)) {
+    errno = result;
+    perror("posix_memalign");
+    abort();
+  }
+  region_block *block = (region_block *)ptr;
+  block->header.next_block = (char *)first_block;
+  block->header.next_superblock = 0;
+  block->header.semispace = OLDSPACE_ID;
+  block->live = 0;
+  block->evacuate = false;
+  first_block = block;
+  num_blocks++;
+  MEM_LOG("Allocating new region block at %p\n", block);
+  return block;
+}
+
+static __attribute__ ((noinline))
+void *regionAllocSlow(size_t requested) {
+  if (requested > BLOCK_SIZE - sizeof(region_block)) {
+    return largeObjectAlloc(requested);
+  }
+  allocated_bytes += requested;
+  fillHole(cursor, limit);
+  cursor = limit = 0;
+  while (next_hole < holes.size()) {
+    hole h = holes[next_hole++];
+    if ((size_t)(h.end - h.start) >= requested) {
+      cursor = h.start;
+      limit = h.end;
+      break;
+    }
+  }
+  if (!cursor) {
+    region_block *block = freshRegionBlock();
+    cursor = blockStart(block);
+    limit = blockEnd(block);
+  }
+  void *result = cursor;
+  cursor += requested;
+  return result;
+}
+
+__attribute__ ((always_inline))
+void *regionAlloc(size_t requested) {
+  if (cursor + requested > limit) {
+    return regionAllocSlow(requested);
+  }
+  allocated_bytes += requested;
+  void *result = cursor;
+  cursor += requested;
+  return result;
+}
+
+bool regionIsEvacuating(void *ptr) {
+  return region_block_of(ptr)->evacuate;
+}
+
+// Clears the marks in a block, records its runs of dead objects and returns the
+// number of live bytes in it.
+static size_t sweepBlock(region_block *block, std::vector<hole> &dead) {
+  size_t live = 0;
+  char *ptr = blockStart(block);
+  char *end = blockEnd(block);
+  char *deadStart = 0;
+  while (ptr < end) {
+    uint64_t hdr = *(uint64_t *)ptr;
+    size_t size = get_size(hdr, layout_hdr(hdr));
+    if (hdr & FWD_PTR_BIT) {
+      *(uint64_t *)ptr = hdr & ~FWD_PTR_BIT;
+      live += size;
+      if (deadStart) {
+        dead.push_back({deadStart, ptr});
+        deadStart = 0;
+      }
+    } else if (!deadStart) {
+      deadStart = ptr;
+    }
+    ptr += size;
+  }
+  if (deadStart) {
+    dead.push_back({deadStart, end});
+  }
+  return live;
+}
+
+void regionSweep(void) {
+  fillHole(cursor, limit);
+  cursor = limit = 0;
+  holes.clear();
+  next_hole = 0;
+  live_bytes = allocated_bytes = 0;
+
+  const size_t capacity = BLOCK_SIZE - sizeof(region_block);
+  std::vector<region_block *> blocks;
+  std::vector<std::pair<size_t, size_t>> deadRanges;
+  std::vector<hole> dead;
+  region_block **prev = &first_block;
+  region_block *block = first_block;
+  while (block) {
+    region_block *next = (region_block *)block->header.next_block;
+    size_t firstDead = dead.size();
+    // the live objects of blocks being evacuated have all been copied out.
+    size_t live = block->evacuate ? 0 : sweepBlock(block, dead);
+    if (live == 0) {
+      dead.resize(firstDead);
+      *prev = next;
+      num_blocks--;
+      free(block);
+    } else {
+      block->live = live;
+      live_bytes += live;
+      blocks.push_back(block);
+      deadRanges.push_back({firstDead, dead.size()});
+      prev = (region_block **)&block->header.next_block;
+    }
+    block = next;
+  }
+
+  // choose the sparsest blocks for evacuation, as long as their live objects
+  // fit into the holes of the remaining blocks.
+  size_t available = 0;
+  for (size_t i = 0; i < blocks.size(); i++) {
+    available += capacity - blocks[i]->live;
+  }
+  std::vector<size_t> order(blocks.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return blocks[a]->live < blocks[b]->live;
+  });
+  for (size_t i : order) {
+    region_block *block = blocks[i];
+    size_t blockFree = capacity - block->live;
+    block->evacuate = block->live < capacity / EVACUATE_OCCUPANCY_DIVISOR
+        && available >= blockFree + block->live;
+    if (block->evacuate) {
+      available -= blockFree + block->live;
+    }
+  }
+
+  for (size_t i = 0; i < blocks.size(); i++) {
+    for (size_t j = deadRanges[i].first; j < deadRanges[i].second; j++) {
+      hole h = dead[j];
+      fillHole(h.start, h.end);
+      if (!blocks[i]->evacuate && (size_t)(h.end - h.start) >= REGION_LINE_SIZE) {
+        holes.push_back(h);
+      }
+    }
+  }
+  MEM_LOG("Swept region space: %zd blocks, %zd holes\n", num_blocks, holes.size());
+}
+
+size_t regionSize(void) {
+  return num_blocks * (BLOCK_SIZE - sizeof(region_block));
+}
+
+size_t regionUsed(void) {
+  return live_bytes + allocated_bytes;
+}
+
+void regionFreeAll(void) {
+  region_block *block = first_block;
+  while (block) {
+    region_block *next = (region_block *)block->header.next_block;
+    free(block);
+    block = next;
+  }
+  first_block = 0;
+  num_blocks = 0;
+  holes.clear();
+  next_hole = 0;
+  cursor = limit = 0;
+  live_bytes = allocated_bytes = 0;
+}
+
+}
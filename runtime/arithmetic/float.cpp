@@ -73,14 +73,14 @@ SortFloat hook_FLOAT_floor(SortFloat a) {
 }
 
 SortFloat hook_FLOAT_round(SortFloat a, SortInt prec, SortInt exp) {
-  if (!mpz_fits_ulong_p(prec)) {
+  if (!mpz_fits_ulong_p(int_view(prec))) {
     throw std::invalid_argument("Precision out of range");
   }
-  unsigned long uprec = mpz_get_ui(prec);
-  if (!mpz_fits_ulong_p(exp)) {
+  unsigned long uprec = mpz_get_ui(int_view(prec));
+  if (!mpz_fits_ulong_p(int_view(exp))) {
     throw std::invalid_argument("Exponent out of range");
   }
-  unsigned long uexp = mpz_get_ui(exp);
+  unsigned long uexp = mpz_get_ui(int_view(exp));
   floating result[1];
   mpfr_enter(uprec, uexp, result);
   int t = mpfr_set(result->f, a->f, MPFR_RNDN);
@@ -99,17 +99,17 @@ mpz_ptr hook_FLOAT_float2int(SortFloat a) {
 }
 
 SortFloat hook_FLOAT_int2float(SortInt a, SortInt prec, SortInt exp) {
-  if (!mpz_fits_ulong_p(prec)) {
+  if (!mpz_fits_ulong_p(int_view(prec))) {
     throw std::invalid_argument("Precision out of range");
   }
-  unsigned long uprec = mpz_get_ui(prec);
-  if (!mpz_fits_ulong_p(exp)) {
+  unsigned long uprec = mpz_get_ui(int_view(prec));
+  if (!mpz_fits_ulong_p(int_view(exp))) {
     throw std::invalid_argument("Exponent out of range");
   }
-  unsigned long uexp = mpz_get_ui(exp);
+  unsigned long uexp = mpz_get_ui(int_view(exp));
   floating result[1];
   mpfr_enter(uprec, uexp, result);
-  int t = mpfr_set_z(result->f, a, MPFR_RNDN);
+  int t = mpfr_set_z(result->f, int_view(a), MPFR_RNDN);
   mpfr_leave(t, result);
   return move_float(result);
 }
@@ -252,14 +252,14 @@ bool hook_FLOAT_isNaN(SortFloat a) {
 }
 
 SortFloat hook_FLOAT_maxValue(SortInt prec, SortInt exp) {
-  if (!mpz_fits_ulong_p(prec)) {
+  if (!mpz_fits_ulong_p(int_view(prec))) {
     throw std::invalid_argument("Precision out of range");
   }
-  unsigned long uprec = mpz_get_ui(prec);
-  if (!mpz_fits_ulong_p(exp)) {
+  unsigned long uprec = mpz_get_ui(int_view(prec));
+  if (!mpz_fits_ulong_p(int_view(exp))) {
     throw std::invalid_argument("Exponent out of range");
   }
-  unsigned long uexp = mpz_get_ui(exp);
+  unsigned long uexp = mpz_get_ui(int_view(exp));
   floating result[1];
   mpfr_enter(uprec, uexp, result);
   mpfr_set_inf(result->f, 1);
@@ -269,14 +269,14 @@ SortFloat hook_FLOAT_maxValue(SortInt prec, SortInt exp) {
 }
 
 SortFloat hook_FLOAT_minValue(SortInt prec, SortInt exp) {
-  if (!mpz_fits_ulong_p(prec)) {
+  if (!mpz_fits_ulong_p(int_view(prec))) {
     throw std::invalid_argument("Precision out of range");
   }
-  unsigned long uprec = mpz_get_ui(prec);
-  if (!mpz_fits_ulong_p(exp)) {
+  unsigned long uprec = mpz_get_ui(int_view(prec));
+  if (!mpz_fits_ulong_p(int_view(exp))) {
     throw std::invalid_argument("Exponent out of range");
   }
-  unsigned long uexp = mpz_get_ui(exp);
+  unsigned long uexp = mpz_get_ui(int_view(exp));
   floating result[1];
   mpfr_enter(uprec, uexp, result);
   mpfr_set_zero(result->f, 1);
@@ -412,10 +412,10 @@ SortFloat hook_FLOAT_pow(SortFloat a, SortFloat b) {
 }
 
 SortFloat hook_FLOAT_root(SortFloat a, SortInt b) {
-  if (!mpz_fits_ulong_p(b)) {
+  if (!mpz_fits_ulong_p(int_view(b))) {
     throw std::invalid_argument("Root out of range");
   }
-  unsigned long root = mpz_get_ui(b);
+  unsigned long root = mpz_get_ui(int_view(b));
   floating result[1];
   mpfr_enter(a, result);
   int t = mpfr_rootn_ui(result->f, a->f, root, MPFR_RNDN);
@@ -444,19 +444,19 @@ bool hook_FLOAT_sign(SortFloat a) {
 }
 
 SortFloat hook_FLOAT_rat2float(SortInt numerator, SortInt denominator, SortInt prec, SortInt exp) {
-  if (!mpz_fits_ulong_p(prec)) {
+  if (!mpz_fits_ulong_p(int_view(prec))) {
     throw std::invalid_argument("Precision out of range");
   }
-  unsigned long uprec = mpz_get_ui(prec);
-  if (!mpz_fits_ulong_p(exp)) {
+  unsigned long uprec = mpz_get_ui(int_view(prec));
+  if (!mpz_fits_ulong_p(int_view(exp))) {
     throw std::invalid_argument("Exponent out of range");
   }
-  unsigned long uexp = mpz_get_ui(exp);
+  unsigned long uexp = mpz_get_ui(int_view(exp));
 
   mpq_t rat;
   mpq_init(rat);
-  mpz_set(mpq_numref(rat), numerator);
-  mpz_set(mpq_denref(rat), denominator);
+  mpz_set(mpq_numref(rat), int_view(numerator));
+  mpz_set(mpq_denref(rat), int_view(denominator));
   mpq_canonicalize(rat);
 
   floating result[1];
@@ -10,178 +10,275 @@ extern "C" {
 mpz_ptr move_int(mpz_t);
 void add_hash64(void *, uint64_t);
 
-SortInt hook_INT_tmod(SortInt a, SortInt b) {
+// returns v as a SortInt, in the small representation whenever it fits.
+static SortInt int_from_si(int64_t v) {
+  if (fits_small_int(v)) {
+    return make_small_int(v);
+  }
   mpz_t result;
-  if (mpz_sgn(b) == 0) {
+  mpz_init_set_si(result, v);
+  return move_int(result);
+}
+
+#define both_small(a, b) (is_small_int(a) && is_small_int(b))
+
+SortInt hook_INT_tmod(SortInt a, SortInt b) {
+  int_view va(a), vb(b);
+  if (mpz_sgn(vb) == 0) {
     throw std::invalid_argument("Modulus by zero");
   }
+  if (both_small(a, b)) {
+    return make_small_int(small_int_value(a) % small_int_value(b));
+  }
+  mpz_t result;
   mpz_init(result);
-  mpz_tdiv_r(result, a, b);
+  mpz_tdiv_r(result, va, vb);
   return move_int(result);
 }
 
 SortInt hook_INT_emod(SortInt a, SortInt b) {
-  mpz_t result;
-  if (mpz_sgn(b) == 0) {
+  int_view va(a), vb(b);
+  if (mpz_sgn(vb) == 0) {
     throw std::invalid_argument("Modulus by zero");
   }
+  if (both_small(a, b)) {
+    int64_t bv = small_int_value(b);
+    int64_t r = small_int_value(a) % bv;
+    return make_small_int(r >= 0 ? r : r + (bv < 0 ? -bv : bv));
+  }
+  mpz_t result;
   mpz_init(result);
-  mpz_tdiv_r(result, a, b);
+  mpz_tdiv_r(result, va, vb);
   if (mpz_sgn(result) >= 0) {
     return move_int(result);
   }
   mpz_t absb;
   mpz_init(absb);
-  mpz_abs(absb, b);
+  mpz_abs(absb, vb);
   mpz_add(result, result, absb);
   mpz_clear(absb);
   return move_int(result);
 }
 
 SortInt hook_INT_add(SortInt a, SortInt b) {
+  // the sum of two small integers cannot overflow an int64_t.
+  if (both_small(a, b)) {
+    return int_from_si(small_int_value(a) + small_int_value(b));
+  }
+  int_view va(a), vb(b);
   mpz_t result;
   mpz_init(result);
-  mpz_add(result, a, b);
+  mpz_add(result, va, vb);
   return move_int(result);
 }
 
 bool hook_INT_le(SortInt a, SortInt b) {
-  return mpz_cmp(a, b) <= 0;
+  if (both_small(a, b)) {
+    return small_int_value(a) <= small_int_value(b);
+  }
+  return mpz_cmp(int_view(a), int_view(b)) <= 0;
 }
 
 bool hook_INT_eq(SortInt a, SortInt b) {
-  return mpz_cmp(a, b) == 0;
+  if (both_small(a, b)) {
+    return small_int_value(a) == small_int_value(b);
+  }
+  return mpz_cmp(int_view(a), int_view(b)) == 0;
 }
 
 bool hook_INT_ne(SortInt a, SortInt b) {
-  return mpz_cmp(a, b) != 0;
+  if (both_small(a, b)) {
+    return small_int_value(a) != small_int_value(b);
+  }
+  return mpz_cmp(int_view(a), int_view(b)) != 0;
 }
 
 SortInt hook_INT_and(SortInt a, SortInt b) {
+  if (both_small(a, b)) {
+    return make_small_int(small_int_value(a) & small_int_value(b));
+  }
+  int_view va(a), vb(b);
   mpz_t result;
   mpz_init(result);
-  mpz_and(result, a, b);
+  mpz_and(result, va, vb);
   return move_int(result);
 }
 
 SortInt hook_INT_mul(SortInt a, SortInt b) {
+  int64_t product;
+  if (both_small(a, b) && !__builtin_mul_overflow(small_int_value(a), small_int_value(b), &product)) {
+    return int_from_si(product);
+  }
+  int_view va(a), vb(b);
   mpz_t result;
   mpz_init(result);
-  mpz_mul(result, a, b);
+  mpz_mul(result, va, vb);
   return move_int(result);
 }
 
 SortInt hook_INT_sub(SortInt a, SortInt b) {
+  if (both_small(a, b)) {
+    return int_from_si(small_int_value(a) - small_int_value(b));
+  }
+  int_view va(a), vb(b);
   mpz_t result;
   mpz_init(result);
-  mpz_sub(result, a, b);
+  mpz_sub(result, va, vb);
   return move_int(result);
 }
 
 SortInt hook_INT_tdiv(SortInt a, SortInt b) {
-  mpz_t result;
-  if (mpz_sgn(b) == 0) {
+  int_view va(a), vb(b);
+  if (mpz_sgn(vb) == 0) {
     throw std::invalid_argument("Division by zero");
   }
+  if (both_small(a, b)) {
+    return int_from_si(small_int_value(a) / small_int_value(b));
+  }
+  mpz_t result;
   mpz_init(result);
-  mpz_tdiv_q(result, a, b);
+  mpz_tdiv_q(result, va, vb);
   return move_int(result);
 }
 
 SortInt hook_INT_ediv(SortInt a, SortInt b) {
-  mpz_t result;
-  if (mpz_sgn(b) == 0) {
+  int_view va(a), vb(b);
+  if (mpz_sgn(vb) == 0) {
     throw std::invalid_argument("Division by zero");
   }
+  if (both_small(a, b)) {
+    int64_t av = small_int_value(a), bv = small_int_value(b);
+    int64_t q = av / bv;
+    if (av % bv < 0) {
+      q += bv > 0 ? -1 : 1;
+    }
+    return int_from_si(q);
+  }
+  mpz_t result;
   mpz_init(result);
-  if (mpz_sgn(b) >= 0) {
-    mpz_fdiv_q(result, a, b);
+  if (mpz_sgn(vb) >= 0) {
+    mpz_fdiv_q(result, va, vb);
   } else {
-    mpz_cdiv_q(result, a, b);
+    mpz_cdiv_q(result, va, vb);
   }
   return move_int(result);
 }
 
 SortInt hook_INT_shl(SortInt a, SortInt b) {
-  mpz_t result;
-  if (!mpz_fits_ulong_p(b)) {
+  int_view va(a), vb(b);
+  if (!mpz_fits_ulong_p(vb)) {
     throw std::invalid_argument("Shift amount out of range");
   }
+  unsigned long blong = mpz_get_ui(vb);
+  if (is_small_int(a) && blong < 64) {
+    int64_t av = small_int_value(a);
+    int64_t shifted = (int64_t)((uint64_t)av << blong);
+    if ((shifted >> blong) == av && fits_small_int(shifted)) {
+      return make_small_int(shifted);
+    }
+  }
+  mpz_t result;
   mpz_init(result);
-  unsigned long blong = mpz_get_ui(b);
-  mpz_mul_2exp(result, a, blong);
+  mpz_mul_2exp(result, va, blong);
   return move_int(result);
 }
 
 bool hook_INT_lt(SortInt a, SortInt b) {
-  return mpz_cmp(a, b) < 0;
+  if (both_small(a, b)) {
+    return small_int_value(a) < small_int_value(b);
+  }
+  return mpz_cmp(int_view(a), int_view(b)) < 0;
 }
 
 bool hook_INT_ge(SortInt a, SortInt b) {
-  return mpz_cmp(a, b) >= 0;
+  if (both_small(a, b)) {
+    return small_int_value(a) >= small_int_value(b);
+  }
+  return mpz_cmp(int_view(a), int_view(b)) >= 0;
 }
 
 SortInt hook_INT_shr(SortInt a, SortInt b) {
+  int_view va(a), vb(b);
+  if (both_small(a, b) && small_int_value(b) >= 0) {
+    int64_t bv = small_int_value(b);
+    return make_small_int(small_int_value(a) >> (bv < 63 ? bv : 63));
+  }
   mpz_t result;
   mpz_init(result);
-  if (!mpz_fits_ulong_p(b)) {
-    if (mpz_sgn(b) < 0) {
+  if (!mpz_fits_ulong_p(vb)) {
+    if (mpz_sgn(vb) < 0) {
       throw std::invalid_argument("Negative shift amount");
     }
-    if (mpz_sgn(a) < 0) {
+    if (mpz_sgn(va) < 0) {
       mpz_set_si(result, -1);
     }
     return move_int(result);
   }
-  unsigned long blong = mpz_get_ui(b);
-  mpz_fdiv_q_2exp(result, a, blong);
+  unsigned long blong = mpz_get_ui(vb);
+  mpz_fdiv_q_2exp(result, va, blong);
   return move_int(result);
 }
 
 bool hook_INT_gt(SortInt a, SortInt b) {
-  return mpz_cmp(a, b) > 0;
+  if (both_small(a, b)) {
+    return small_int_value(a) > small_int_value(b);
+  }
+  return mpz_cmp(int_view(a), int_view(b)) > 0;
 }
 
 SortInt hook_INT_pow(SortInt a, SortInt b) {
+  int_view va(a), vb(b);
   mpz_t result;
-  if (!mpz_fits_ulong_p(b)) {
+  if (!mpz_fits_ulong_p(vb)) {
     throw std::invalid_argument("Exponent out of range");
   }
   mpz_init(result);
-  unsigned long blong = mpz_get_ui(b);
-  mpz_pow_ui(result, a, blong);
+  unsigned long blong = mpz_get_ui(vb);
+  mpz_pow_ui(result, va, blong);
   return move_int(result);
 }
 
 SortInt hook_INT_powmod(SortInt a, SortInt b, SortInt mod) {
+  int_view va(a), vb(b), vmod(mod);
   mpz_t result;
   mpz_init(result);
-  if (mpz_sgn(b) < 0) {
-    mpz_gcd(result, a, mod);
+  if (mpz_sgn(vb) < 0) {
+    mpz_gcd(result, va, vmod);
     if (mpz_cmp_ui(result, 1) != 0) {
       mpz_clear(result);
       throw std::invalid_argument("Modular inverse not defined");
     }
   }
-  mpz_powm(result, a, b, mod);
+  mpz_powm(result, va, vb, vmod);
   return move_int(result);
 }
 
 SortInt hook_INT_xor(SortInt a, SortInt b) {
+  if (both_small(a, b)) {
+    return make_small_int(small_int_value(a) ^ small_int_value(b));
+  }
+  int_view va(a), vb(b);
   mpz_t result;
   mpz_init(result);
-  mpz_xor(result, a, b);
+  mpz_xor(result, va, vb);
   return move_int(result);
 }
 
 SortInt hook_INT_or(SortInt a, SortInt b) {
+  if (both_small(a, b)) {
+    return make_small_int(small_int_value(a) | small_int_value(b));
+  }
+  int_view va(a), vb(b);
   mpz_t result;
   mpz_init(result);
-  mpz_ior(result, a, b);
+  mpz_ior(result, va, vb);
   return move_int(result);
 }
 
 SortInt hook_INT_not(SortInt a) {
+  if (is_small_int(a)) {
+    return make_small_int(~small_int_value(a));
+  }
   mpz_t result;
   mpz_init(result);
   mpz_com(result, a);
@@ -189,6 +286,10 @@ SortInt hook_INT_not(SortInt a) {
 }
 
 SortInt hook_INT_abs(SortInt a) {
+  if (is_small_int(a)) {
+    int64_t av = small_int_value(a);
+    return int_from_si(av < 0 ? -av : av);
+  }
   mpz_t result;
   mpz_init(result);
   mpz_abs(result, a);
@@ -196,35 +297,32 @@ SortInt hook_INT_abs(SortInt a) {
 }
 
 SortInt hook_INT_max(SortInt a, SortInt b) {
-  mpz_t result;
-  mpz_init(result);
-  if (mpz_cmp(a, b) >= 0) {
-    mpz_set(result, a);
-  } else {
-    mpz_set(result, b);
+  if (both_small(a, b)) {
+    return small_int_value(a) >= small_int_value(b) ? a : b;
   }
+  int_view va(a), vb(b);
+  mpz_t result;
+  mpz_init_set(result, mpz_cmp(va, vb) >= 0 ? va : vb);
   return move_int(result);
 }
 
 SortInt hook_INT_min(SortInt a, SortInt b) {
-  mpz_t result;
-  mpz_init(result);
-  if (mpz_cmp(a, b) <= 0) {
-    mpz_set(result, a);
-  } else {
-    mpz_set(result, b);
+  if (both_small(a, b)) {
+    return small_int_value(a) <= small_int_value(b) ? a : b;
   }
+  int_view va(a), vb(b);
+  mpz_t result;
+  mpz_init_set(result, mpz_cmp(va, vb) <= 0 ? va : vb);
   return move_int(result);
 }
 
 SortInt hook_INT_log2(SortInt a) {
-  mpz_t result;
-  if (mpz_sgn(a) <= 0) {
+  int_view va(a);
+  if (mpz_sgn(va) <= 0) {
     throw std::invalid_argument("Logarithm of nonpositive integer");
   }
-  mpz_init(result);
-  size_t log = mpz_sizeinbase(a, 2) - 1;
-  mpz_set_ui(result, log);
+  mpz_t result;
+  mpz_init_set_ui(result, mpz_sizeinbase(va, 2) - 1);
   return move_int(result);
 }
 
@@ -272,29 +370,30 @@ void extract(mpz_t result, mpz_t i, size_t off, size_t len) {
 }
 
 SortInt hook_INT_bitRange(SortInt i, SortInt off, SortInt len) {
+  int_view vi(i), voff(off), vlen(len);
   mpz_t result;
-  if (mpz_sgn(len) == 0) {
+  if (mpz_sgn(vlen) == 0) {
     mpz_init(result);
     return move_int(result);
   }
-  if (!mpz_fits_ulong_p(len)) {
+  if (!mpz_fits_ulong_p(vlen)) {
     throw std::invalid_argument("Length out of range");
   }
-  unsigned long lenlong = mpz_get_ui(len);
-  if (!mpz_fits_ulong_p(off)) {
-    if (mpz_sgn(off) < 0) {
+  unsigned long lenlong = mpz_get_ui(vlen);
+  if (!mpz_fits_ulong_p(voff)) {
+    if (mpz_sgn(voff) < 0) {
       throw std::invalid_argument("Negative offset");
     }
     mpz_init(result);
-    if (mpz_sgn(i) < 0) {
+    if (mpz_sgn(vi) < 0) {
       mpz_set_ui(result, 1);
       mpz_mul_2exp(result, result, lenlong);
       mpz_sub_ui(result, result, 1);
     }
     return move_int(result);
   }
-  unsigned long offlong = mpz_get_ui(off);
-  extract(result, i, offlong, lenlong);
+  unsigned long offlong = mpz_get_ui(voff);
+  extract(result, vi, offlong, lenlong);
   return move_int(result);
 }
 
@@ -321,51 +420,55 @@ void signed_extract(mpz_t result, mpz_t i, size_t off, size_t len) {
 }
 
 SortInt hook_INT_signExtendBitRange(SortInt i, SortInt off, SortInt len) {
+  int_view vi(i), voff(off), vlen(len);
   mpz_t result;
-  if (!mpz_fits_ulong_p(off)) {
-    if (mpz_sgn(off) < 0) {
+  if (!mpz_fits_ulong_p(voff)) {
+    if (mpz_sgn(voff) < 0) {
       throw std::invalid_argument("Negative offset");
     }
     mpz_init(result);
-    if (mpz_sgn(i) < 0) {
+    if (mpz_sgn(vi) < 0) {
       mpz_set_si(result, -1);
     }
     return move_int(result);
   }
-  if (!mpz_fits_ulong_p(len)) {
+  if (!mpz_fits_ulong_p(vlen)) {
     throw std::invalid_argument("Length out of range");
   }
-  unsigned long offlong = mpz_get_ui(off);
-  unsigned long lenlong = mpz_get_ui(len);
-  signed_extract(result, i, offlong, lenlong);
+  unsigned long offlong = mpz_get_ui(voff);
+  unsigned long lenlong = mpz_get_ui(vlen);
+  signed_extract(result, vi, offlong, lenlong);
   return move_int(result);
 }
 
 int32_t hook_INT_size_int(SortInt t) {
-  return (int32_t)t->_mp_size;
+  return (int32_t)int_view(t)->_mp_size;
 }
 
 uint64_t hook_INT_limb(SortInt t, uint64_t i) {
-  return (uint64_t)t->_mp_d[i];
+  return (uint64_t)int_view(t)->_mp_d[i];
 }
 
-void int_hash(mpz_t i, void *hasher) {
+// hashes the value of the integer, so that both representations of an integer
+// have the same hash.
+void int_hash(SortInt t, void *hasher) {
+  int_view i(t);
   int nlimbs = mpz_size(i);
   for (int j = 0; j < nlimbs; j++) {
-    add_hash64(hasher, i[0]._mp_d[j]);
+    add_hash64(hasher, ((mpz_ptr)i)->_mp_d[j]);
   }
 }
 
 static block * dotK = leaf_block(getTagForSymbolName("dotk{}"));
 
-gmp_randstate_t kllvm_randState;
-bool kllvm_randStateInitialized = false;
+thread_local gmp_randstate_t kllvm_randState;
+thread_local bool kllvm_randStateInitialized = false;
 
 SortK hook_INT_srand(SortInt seed) {
   if (!kllvm_randStateInitialized) {
     gmp_randinit_default(kllvm_randState);
   }
-  gmp_randseed(kllvm_randState, seed);
+  gmp_randseed(kllvm_randState, int_view(seed));
   kllvm_randStateInitialized = true;
   return dotK;
 }
@@ -379,15 +482,15 @@ SortInt hook_INT_rand(SortInt upperBound) {
     gmp_randseed(kllvm_randState, result);
     kllvm_randStateInitialized = true;
   }
-  mpz_urandomm(result, kllvm_randState, upperBound);
+  mpz_urandomm(result, kllvm_randState, int_view(upperBound));
   return move_int(result);
 }
 
-size_t *hook_MINT_export(mpz_t in, uint64_t bits) {
+size_t *hook_MINT_export(SortInt in, uint64_t bits) {
   uint64_t nwords = (bits + 63) / 64;
   mpz_t twos;
   mpz_init(twos);
-  extract(twos, in, 0, nwords * 64);
+  extract(twos, int_view(in), 0, nwords * 64);
   if (nwords == 0) return nullptr;
   uint64_t numb = 8*sizeof(size_t);
   uint64_t count = (mpz_sizeinbase (twos, 2) + numb-1) / numb;
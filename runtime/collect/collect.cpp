@@ -1,13 +1,18 @@
+#include<algorithm>
 #include<cstdbool>
 #include<cstdint>
 #include<cstdio>
 #include<cstdlib>
 #include<cstring>
 #include<cassert>
+#include<mutex>
+#include<vector>
 #include "runtime/alloc.h"
 #include "runtime/header.h"
 #include "runtime/arena.h"
 #include "runtime/collect.h"
+#include "runtime/dedup.h"
+#include "runtime/region.h"
 
 extern "C" {
 
@@ -16,15 +21,19 @@ char **old_alloc_ptr(void);
 char* youngspace_ptr(void);
 char* oldspace_ptr(void);
 
-static bool is_gc = false;
-bool collect_old = false;
-#ifndef GC_DBG
-static uint8_t num_collection_only_young = 0;
-#else
-static char *last_alloc_ptr;
+static thread_local bool is_gc = false;
+thread_local bool collect_old = false;
+static thread_local bool force_collect_old = false;
+thread_local char gc_young_collection_id, gc_old_collection_id;
+#ifdef GC_DBG
+static thread_local char *last_alloc_ptr;
 #endif
 
-size_t numBytesLiveAtCollection[1 << AGE_WIDTH];
+thread_local size_t numBytesLiveAtCollection[1 << AGE_WIDTH];
+thread_local gc_frame *gc_frames = nullptr;
+thread_local uint64_t gc_safepoint_inhibit = 1;
+thread_local uint8_t gc_phase = GC_NONE;
+
 void set_gc_threshold(size_t);
 size_t get_gc_threshold(void);
 bool youngspaceAlmostFull(size_t);
@@ -42,31 +51,72 @@ size_t get_size(uint64_t hdr, uint16_t layout) {
   }
 }
 
+static void migrate_children(block *currBlock, uint16_t layoutInt);
+
+// the sort of the child being migrated by migrate_children, if known, which
+// tells whether it can be deduplicated.
+static thread_local const char *childSort = nullptr;
+
 void migrate(block** blockPtr) {
   block* currBlock = *blockPtr;
   if (is_leaf_block(currBlock)) {
     return;
   }
-  const uint64_t hdr = currBlock->h.hdr;
+  if (is_large_object(currBlock)) {
+    // large objects are marked in place. Their children are migrated the first
+    // time they are found live.
+    if (is_collected_object(currBlock) && largeObjectMark(currBlock)) {
+      migrate_children(currBlock, layout(currBlock));
+    }
+    return;
+  }
+  const uint64_t hdr = gc_load_header(&currBlock->h);
   initialize_migrate();
   uint16_t layout = layout_hdr(hdr);
   size_t lenInBytes = get_size(hdr, layout);
+  if (isInOldGen && is_marked_in_place(currBlock)) {
+    if (!hasForwardingAddress) {
+#ifdef GC_DBG
+      numBytesLiveAtCollection[oldAge] += lenInBytes;
+#endif
+      currBlock->h.hdr = hdr | FWD_PTR_BIT;
+      if (layout) {
+        pushGrayObject(currBlock);
+      }
+    }
+    return;
+  }
   block** forwardingAddress = (block**)(currBlock + 1);
-  if (!hasForwardingAddress) {
-    block *newBlock;
-    if (shouldPromote || (isInOldGen && collect_old)) {
-      newBlock = (block *)koreAllocOld(lenInBytes);
-    } else {
-      newBlock = (block *)koreAlloc(lenInBytes);
+  if (!hasForwardingAddress && gc_claim(&currBlock->h, hdr)) {
+    bool old = shouldPromote || (isInOldGen && collect_old);
+    // variables are compared by address, so they are never shared.
+    bool dedup = old && gc_dedup && !gc_parallel && !layout && !(hdr & VARIABLE_BIT) && len_hdr(hdr) <= DEDUP_MAX_LEN && dedupImmutableSort(childSort);
+    if (dedup) {
+      if (string *canonical = dedupFindToken((string *)currBlock)) {
+        *forwardingAddress = (block *)canonical;
+        gc_publish(&currBlock->h, hdr);
+        *blockPtr = (block *)canonical;
+        return;
+      }
     }
+    block *newBlock = (block *)gcAlloc(lenInBytes, old);
 #ifdef GC_DBG
     numBytesLiveAtCollection[oldAge] += lenInBytes;
 #endif
     memcpy(newBlock, currBlock, lenInBytes);
+    newBlock->h.hdr = hdr;
     migrate_header(newBlock);
+    if (dedup) {
+      dedupAddToken((string *)newBlock);
+    }
     *forwardingAddress = newBlock;
-    currBlock->h.hdr |= FWD_PTR_BIT;
+    gc_publish(&currBlock->h, hdr);
     *blockPtr = newBlock;
+    if (gc_depth_first && layout && !gc_parallel && !(old && mark_region)) {
+      // tokens have no children to scan. Objects promoted into the region
+      // space were already pushed by gcAlloc.
+      pushGrayObject(newBlock);
+    }
   } else {
     *blockPtr = *forwardingAddress;
   }
@@ -79,47 +129,121 @@ void migrate_once(block** blockPtr) {
   if (is_leaf_block(currBlock)) {
     return;
   }
-  if (youngspace_collection_id() == getArenaSemispaceIDOfObject((void *)currBlock) ||
-      oldspace_collection_id() == getArenaSemispaceIDOfObject((void *)currBlock)) {
+  if (is_collected_object(currBlock)) {
     migrate(blockPtr);
   }
 }
 
+// Marks a token of the region space that is referenced only by an object that
+// is being marked in place, such as the limbs of an integer. If the token is in
+// a block being evacuated, it is copied instead and the copy is returned.
+static string *mark_owned_token(string *token) {
+  if (is_large_object(token)) {
+    largeObjectMark(token);
+    return token;
+  }
+  if (is_marked_in_place(token)) {
+    token->h.hdr |= FWD_PTR_BIT;
+    return token;
+  }
+  size_t lenInBytes = get_size(token->h.hdr, 0);
+  string *newToken = (string *)gcAlloc(lenInBytes, true);
+  memcpy(newToken, token, lenInBytes);
+  return newToken;
+}
+
+// Copies a token referenced only by an object that is being copied, such as
+// the limbs of an integer, and returns the copy. Large tokens are marked and
+// kept in place instead.
+static string *copy_owned_token(string *token, size_t size, size_t used, bool old) {
+  if (is_large_object(token)) {
+    largeObjectMark(token);
+    return token;
+  }
+  string *newToken = (string *)gcAllocToken(size, old);
+  memcpy(newToken, token, used);
+  return newToken;
+}
+
 static void migrate_string_buffer(stringbuffer** bufferPtr) {
   stringbuffer* buffer = *bufferPtr;
-  const uint64_t hdr = buffer->h.hdr;
-  const uint64_t cap = len(buffer->contents);
+  const uint64_t hdr = gc_load_header(&buffer->h);
   initialize_migrate();
-  if (!hasForwardingAddress) {
-    stringbuffer *newBuffer;
-    string *newContents;
-    if (shouldPromote || (isInOldGen && collect_old)) {
-      newBuffer = (stringbuffer *)koreAllocOld(sizeof(stringbuffer));
-      newContents = (string *)koreAllocTokenOld(sizeof(string) + cap);
-    } else {
-      newBuffer = (stringbuffer *)koreAlloc(sizeof(stringbuffer));
-      newContents = (string *)koreAllocToken(sizeof(string) + cap);
+  if (isInOldGen && is_marked_in_place(buffer)) {
+    if (!hasForwardingAddress) {
+#ifdef GC_DBG
+      numBytesLiveAtCollection[oldAge] += len(buffer->contents) + sizeof(stringbuffer) + sizeof(string);
+#endif
+      buffer->h.hdr = hdr | FWD_PTR_BIT;
+      buffer->contents = mark_owned_token(buffer->contents);
     }
+    return;
+  }
+  if (!hasForwardingAddress && gc_claim(&buffer->h, hdr)) {
+    const uint64_t cap = len(buffer->contents);
+    bool old = shouldPromote || (isInOldGen && collect_old);
+    stringbuffer *newBuffer = (stringbuffer *)gcAlloc(sizeof(stringbuffer), old);
+    string *newContents = copy_owned_token(buffer->contents, sizeof(string) + cap, sizeof(string) + buffer->strlen, old);
 #ifdef GC_DBG
     numBytesLiveAtCollection[oldAge] += cap + sizeof(stringbuffer) + sizeof(string);
 #endif
-    memcpy(newContents, buffer->contents, sizeof(string) + buffer->strlen);
     memcpy(newBuffer, buffer, sizeof(stringbuffer));
+    newBuffer->h.hdr = hdr;
     migrate_header(newBuffer);
     newBuffer->contents = newContents;
-    *(stringbuffer **)(buffer->contents) = newBuffer;
-    buffer->h.hdr |= FWD_PTR_BIT;
+    // the contents may be kept in place, so the forwarding address is stored
+    // in the old buffer itself.
+    buffer->contents = (string *)newBuffer;
+    gc_publish(&buffer->h, hdr);
   }
-  *bufferPtr = *(stringbuffer **)(buffer->contents);
+  *bufferPtr = (stringbuffer *)buffer->contents;
 }
 
 static void migrate_mpz(mpz_ptr *mpzPtr) {
+  if (is_small_int(*mpzPtr)) {
+    return;
+  }
   mpz_hdr *intgr = struct_base(mpz_hdr, i, *mpzPtr);
-  const uint64_t hdr = intgr->h.hdr;
+  const uint64_t hdr = gc_load_header(&intgr->h);
   initialize_migrate();
-  if (!hasForwardingAddress) {
+  if (isInOldGen && is_marked_in_place(intgr)) {
+    if (!hasForwardingAddress) {
+#ifdef GC_DBG
+      numBytesLiveAtCollection[oldAge] += sizeof(mpz_hdr);
+#endif
+      intgr->h.hdr = hdr | FWD_PTR_BIT;
+      if (intgr->i->_mp_alloc > 0) {
+        string *limbs = struct_base(string, data, intgr->i->_mp_d);
+#ifdef GC_DBG
+        numBytesLiveAtCollection[oldAge] += len(limbs) + sizeof(string);
+#endif
+        intgr->i->_mp_d = (mp_limb_t *)mark_owned_token(limbs)->data;
+      }
+    }
+    return;
+  }
+  if (!hasForwardingAddress && gc_claim(&intgr->h, hdr)) {
+    // integers not created by move_int, such as those in the initial
+    // configuration, become small integers once they survive a collection.
+    long value = mpz_fits_slong_p(intgr->i) ? mpz_get_si(intgr->i) : SMALL_INT_MAX + 1;
+    if (fits_small_int(value)) {
+      *mpzPtr = make_small_int(value);
+      *(mpz_ptr *)(&intgr->i->_mp_d) = *mpzPtr;
+      gc_publish(&intgr->h, hdr);
+      return;
+    }
     mpz_hdr *newIntgr;
     string *newLimbs;
+    bool old = shouldPromote || (isInOldGen && collect_old);
+    bool dedup = old && gc_dedup && !gc_parallel && abs(intgr->i->_mp_size) * sizeof(mp_limb_t) <= DEDUP_MAX_LEN;
+    if (dedup) {
+      if (mpz_hdr *canonical = dedupFindInteger(intgr)) {
+        *(mpz_ptr *)(&intgr->i->_mp_d) = canonical->i;
+        gc_publish(&intgr->h, hdr);
+        *mpzPtr = canonical->i;
+        return;
+      }
+    }
     bool hasLimbs = intgr->i->_mp_alloc > 0;
 #ifdef GC_DBG
     numBytesLiveAtCollection[oldAge] += sizeof(mpz_hdr);
@@ -134,37 +258,42 @@ static void migrate_mpz(mpz_ptr *mpzPtr) {
 
       assert(intgr->i->_mp_alloc * sizeof(mp_limb_t) == lenLimbs);
 
-      if (shouldPromote || (isInOldGen && collect_old)) {
-        newIntgr = struct_base(mpz_hdr, i, koreAllocIntegerOld(0));
-        newLimbs = (string *) koreAllocTokenOld(sizeof(string) + lenLimbs);
-      } else {
-        newIntgr = struct_base(mpz_hdr, i, koreAllocInteger(0));
-        newLimbs = (string *) koreAllocToken(sizeof(string) + lenLimbs);
-      }
-      memcpy(newLimbs, limbs, sizeof(string) + lenLimbs);
+      newIntgr = (mpz_hdr *)gcAlloc(sizeof(mpz_hdr), old);
+      newLimbs = copy_owned_token(limbs, sizeof(string) + lenLimbs, sizeof(string) + lenLimbs, old);
     } else {
-      if (shouldPromote || (isInOldGen && collect_old)) {
-        newIntgr = struct_base(mpz_hdr, i, koreAllocIntegerOld(0));
-      } else {
-        newIntgr = struct_base(mpz_hdr, i, koreAllocInteger(0));
-      }
+      newIntgr = (mpz_hdr *)gcAlloc(sizeof(mpz_hdr), old);
     }
     memcpy(newIntgr, intgr, sizeof(mpz_hdr));
+    newIntgr->h.hdr = hdr;
     migrate_header(newIntgr);
     if (hasLimbs) {
       newIntgr->i->_mp_d = (mp_limb_t *)newLimbs->data;
     }
+    if (dedup) {
+      dedupAddInteger(newIntgr);
+    }
     *(mpz_ptr *)(&intgr->i->_mp_d) = newIntgr->i;
-    intgr->h.hdr |= FWD_PTR_BIT;
+    gc_publish(&intgr->h, hdr);
   }
   *mpzPtr = *(mpz_ptr *)(&intgr->i->_mp_d);
 }
 
 static void migrate_floating(floating **floatingPtr) {
   floating_hdr *flt = struct_base(floating_hdr, f, *floatingPtr);
-  const uint64_t hdr = flt->h.hdr;
+  const uint64_t hdr = gc_load_header(&flt->h);
   initialize_migrate();
-  if (!hasForwardingAddress) {
+  if (isInOldGen && is_marked_in_place(flt)) {
+    if (!hasForwardingAddress) {
+      string *limbs = struct_base(string, data, flt->f.f->_mpfr_d-1);
+#ifdef GC_DBG
+      numBytesLiveAtCollection[oldAge] += sizeof(floating_hdr) + sizeof(string) + len(limbs);
+#endif
+      flt->h.hdr = hdr | FWD_PTR_BIT;
+      flt->f.f->_mpfr_d = (mp_limb_t *)mark_owned_token(limbs)->data+1;
+    }
+    return;
+  }
+  if (!hasForwardingAddress && gc_claim(&flt->h, hdr)) {
     floating_hdr *newFlt;
     string *newLimbs;
     string *limbs = struct_base(string, data, flt->f.f->_mpfr_d-1);
@@ -176,24 +305,22 @@ static void migrate_floating(floating **floatingPtr) {
 
     assert(((flt->f.f->_mpfr_prec + mp_bits_per_limb - 1) / mp_bits_per_limb) * sizeof(mp_limb_t) <= lenLimbs);
 
-    if (shouldPromote || (isInOldGen && collect_old)) {
-      newFlt = struct_base(floating_hdr, f, koreAllocFloatingOld(0));
-      newLimbs = (string *) koreAllocTokenOld(sizeof(string) + lenLimbs);
-    } else {
-      newFlt = struct_base(floating_hdr, f, koreAllocFloating(0));
-      newLimbs = (string *) koreAllocToken(sizeof(string) + lenLimbs);
-    }
-    memcpy(newLimbs, limbs, sizeof(string) + lenLimbs);
+    bool old = shouldPromote || (isInOldGen && collect_old);
+    newFlt = (floating_hdr *)gcAlloc(sizeof(floating_hdr), old);
+    newLimbs = copy_owned_token(limbs, sizeof(string) + lenLimbs, sizeof(string) + lenLimbs, old);
     memcpy(newFlt, flt, sizeof(floating_hdr));
+    newFlt->h.hdr = hdr;
     migrate_header(newFlt);
     newFlt->f.f->_mpfr_d = (mp_limb_t *)newLimbs->data+1;
-    *(floating **)(flt->f.f->_mpfr_d) = &newFlt->f;
-    flt->h.hdr |= FWD_PTR_BIT;
+    // the limbs may be kept in place, so the forwarding address is stored in
+    // the old number itself.
+    *(floating **)(&flt->f.f->_mpfr_d) = &newFlt->f;
+    gc_publish(&flt->h, hdr);
   }
-  *floatingPtr = *(floating **)(flt->f.f->_mpfr_d);
+  *floatingPtr = *(floating **)(&flt->f.f->_mpfr_d);
 }
 
-static void migrate_child(void* currBlock, layoutitem *args, unsigned i, bool ptr) {
+void migrate_child(void* currBlock, layoutitem *args, unsigned i, bool ptr) {
   layoutitem *argData = args + i;
   void *arg = ((char *)currBlock) + argData->offset;
   switch(argData->cat) {
@@ -225,64 +352,104 @@ static void migrate_child(void* currBlock, layoutitem *args, unsigned i, bool pt
   }
 }
 
-static char* evacuate(char* scan_ptr, char** alloc_ptr) {
-  block *currBlock = (block *)scan_ptr;
-  const uint64_t hdr = currBlock->h.hdr;
-  uint16_t layoutInt = layout_hdr(hdr);
+static void migrate_children(block *currBlock, uint16_t layoutInt) {
   if (layoutInt) {
     layout *layoutData = getLayoutData(layoutInt);
+    uint32_t tag = tag_hdr(currBlock->h.hdr);
     for (unsigned i = 0; i < layoutData->nargs; i++) {
+      if (gc_dedup) {
+        childSort = dedupArgumentSort(tag, i);
+      }
       migrate_child(currBlock, layoutData->args, i, false);
     }
+    childSort = nullptr;
   }
-  return movePtr(scan_ptr, get_size(hdr, layoutInt), *alloc_ptr);
 }
 
-// Contains the decision logic for collecting the old generation.
-// For now, we collect the old generation every 50 young generation collections.
-static bool shouldCollectOldGen() {
-#ifdef GC_DBG
-  return true;
-#else
-  if (++num_collection_only_young == 50) {
-    num_collection_only_young = 0;
-    return true;
-  }
+static char* evacuate(char* scan_ptr, char** alloc_ptr) {
+  block *currBlock = (block *)scan_ptr;
+  const uint64_t hdr = currBlock->h.hdr;
+  uint16_t layoutInt = layout_hdr(hdr);
+  migrate_children(currBlock, layoutInt);
+  return movePtr(scan_ptr, get_size(hdr, layoutInt), *alloc_ptr);
+}
 
-  return false;
-#endif
+static bool useDepthFirst() {
+  const char *env = getenv("KLLVM_GC_ORDER");
+  return env && strcmp(env, "depth-first") == 0;
 }
 
-void migrateRoots();
+bool gc_depth_first = useDepthFirst();
 
-void initStaticObjects(void) {
-  map m = map();
-  list l = list();
-  set s = set();
-  setKoreMemoryFunctionsForGMP();
+// The number of objects that the depth-first scan keeps on its stack. Objects
+// copied while the stack is full are scanned in breadth-first order once it
+// has been emptied.
+static const size_t DEPTH_FIRST_STACK_SIZE = 1024;
+static thread_local block *depthFirstStack[DEPTH_FIRST_STACK_SIZE];
+static thread_local size_t depthFirstTop = 0;
+
+// Objects whose children have not been migrated yet, other than those on the
+// depth-first stack. These are objects of the region space that were promoted
+// or marked in place during this collection and, in depth-first mode, copied
+// objects that did not fit on the stack.
+static thread_local std::vector<block *> grayObjects;
+
+void pushGrayObject(void *obj) {
+  if (gc_depth_first && depthFirstTop < DEPTH_FIRST_STACK_SIZE) {
+    depthFirstStack[depthFirstTop++] = (block *)obj;
+  } else {
+    grayObjects.push_back((block *)obj);
+  }
 }
 
-void koreCollect(void** roots, uint8_t nroots, layoutitem *typeInfo) {
-  is_gc = true;
-  collect_old = shouldCollectOldGen();
-  MEM_LOG("Starting garbage collection\n");
-#ifdef GC_DBG
-  if (!last_alloc_ptr) {
-    last_alloc_ptr = youngspace_ptr();
+static void scanGrayObject(block *currBlock) {
+  if (mark_region && collect_old && getArenaSemispaceIDOfObject(currBlock) == OLDSPACE_ID) {
+    // objects promoted during a collection of the old generation must
+    // survive the following sweep.
+    currBlock->h.hdr |= FWD_PTR_BIT;
   }
-  char *current_alloc_ptr = *young_alloc_ptr();
-#endif
-  koreAllocSwap(collect_old);
-#ifdef GC_DBG
-  for (int i = 0; i < 2048; i++) {
-    numBytesLiveAtCollection[i] = 0;
+  size_t top = depthFirstTop;
+  migrate_children(currBlock, layout(currBlock));
+  // the children were pushed in order, so the last one would be scanned
+  // first. Reversing them scans the first child, and copies its children,
+  // first.
+  std::reverse(depthFirstStack + top, depthFirstStack + depthFirstTop);
+}
+
+static void scanGrayObjects() {
+  if (!gc_depth_first) {
+    while (!grayObjects.empty()) {
+      block *currBlock = grayObjects.back();
+      grayObjects.pop_back();
+      scanGrayObject(currBlock);
+    }
+    return;
   }
-#endif
-  char *previous_oldspace_alloc_ptr = *old_alloc_ptr();
-  for (int i = 0; i < nroots; i++) {
-    migrate_child(roots, typeInfo, i, true);
+  // the children of an object are copied next to each other as soon as it is
+  // scanned, and are then scanned before any object copied earlier, as long as
+  // the stack does not overflow.
+  size_t next = 0;
+  while (true) {
+    while (depthFirstTop) {
+      scanGrayObject(depthFirstStack[--depthFirstTop]);
+    }
+    if (next == grayObjects.size()) {
+      break;
+    }
+    scanGrayObject(grayObjects[next++]);
+  }
+  grayObjects.clear();
+}
+
+// Scans every object copied into the young generation and every object
+// promoted into the old generation since the start of the collection,
+// migrating their children until no unscanned object remains.
+static void evacuateAll(char *previous_oldspace_alloc_ptr) {
+  if (gc_depth_first) {
+    MEM_LOG("Scanning copied objects depth-first\n");
+    scanGrayObjects();
+    return;
   }
-  migrateRoots();
   char *scan_ptr = youngspace_ptr();
   if (scan_ptr != *young_alloc_ptr()) {
     MEM_LOG("Evacuating young generation\n");
@@ -290,6 +457,11 @@ void koreCollect(void** roots, uint8_t nroots, layoutitem *typeInfo) {
       scan_ptr = evacuate(scan_ptr, young_alloc_ptr());
     }
   }
+  if (mark_region) {
+    MEM_LOG("Scanning region space\n");
+    scanGrayObjects();
+    return;
+  }
   if (collect_old || !previous_oldspace_alloc_ptr) {
     scan_ptr = oldspace_ptr();
   } else {
@@ -314,6 +486,63 @@ void koreCollect(void** roots, uint8_t nroots, layoutitem *typeInfo) {
       scan_ptr = evacuate(scan_ptr, old_alloc_ptr());
     }
   }
+}
+
+// The empty collections are shared by every thread, so they must not be
+// allocated into the heap of any one of them.
+static void initEmptyCollections(void) {
+  map m = map();
+  list l = list();
+  set s = set();
+}
+
+void initStaticObjects(void) {
+  static std::once_flag stats;
+  std::call_once(stats, initStats);
+  koreAllocPermanent(initEmptyCollections);
+  setKoreMemoryFunctionsForGMP();
+  set_gc_threshold(initialNurserySize());
+  static std::once_flag sampler;
+  std::call_once(sampler, initSampler);
+  initSamplerThread();
+  static std::once_flag heapSnapshots;
+  std::call_once(heapSnapshots, initHeapSnapshots);
+}
+
+void koreCollect(void** roots, uint8_t nroots, layoutitem *typeInfo) {
+  uint64_t start = gcNanoseconds();
+  is_gc = true;
+  collect_old = shouldCollectOldGen() || force_collect_old;
+  if (collect_old && gc_dedup) {
+    dedupReset();
+  }
+  MEM_LOG("Starting garbage collection\n");
+#ifdef GC_DBG
+  if (!last_alloc_ptr) {
+    last_alloc_ptr = youngspace_ptr();
+  }
+  char *current_alloc_ptr = *young_alloc_ptr();
+#endif
+  koreAllocSwap(collect_old);
+  gc_young_collection_id = youngspace_collection_id();
+  gc_old_collection_id = oldspace_collection_id();
+#ifdef GC_DBG
+  for (int i = 0; i < 2048; i++) {
+    numBytesLiveAtCollection[i] = 0;
+  }
+#endif
+  char *previous_oldspace_alloc_ptr = *old_alloc_ptr();
+  gc_phase = GC_ROOTS;
+  if (gcThreads() > 1) {
+    parallelEvacuate(roots, nroots, typeInfo);
+  } else {
+    for (int i = 0; i < nroots; i++) {
+      migrate_child(roots, typeInfo, i, true);
+    }
+    migrateRoots();
+    gc_phase = GC_EVACUATE;
+    evacuateAll(previous_oldspace_alloc_ptr);
+  }
 #ifdef GC_DBG
   ssize_t numBytesAllocedSinceLastCollection = ptrDiff(current_alloc_ptr, last_alloc_ptr);
   assert(numBytesAllocedSinceLastCollection >= 0);
@@ -325,8 +554,34 @@ void koreCollect(void** roots, uint8_t nroots, layoutitem *typeInfo) {
       stderr);
 #endif
   MEM_LOG("Finishing garbage collection\n");
+  gc_phase = GC_SWEEP;
+  if (mark_region && collect_old) {
+    regionSweep();
+  }
+  largeObjectSweep(collect_old);
+  koreAllocRelease(collect_old);
   is_gc = false;
-  set_gc_threshold(youngspace_size());
+  gc_phase = GC_NONE;
+  set_gc_threshold(collectionDone(collect_old, gcNanoseconds() - start));
+  heapSnapshotAfterCollection(roots, nroots, typeInfo);
+  if (status_requested.load(std::memory_order_relaxed)) {
+    statusReport();
+  }
+}
+
+void koreCollectSafepoint() {
+  // polls only call this function after checking gc_safepoint_inhibit, but
+  // check again in case a caller holds values that cannot be relocated.
+  if (gc_safepoint_inhibit) {
+    return;
+  }
+  koreCollect(nullptr, 0, nullptr);
+}
+
+void koreCollectAll() {
+  force_collect_old = true;
+  koreCollect(nullptr, 0, nullptr);
+  force_collect_old = false;
 }
 
 void freeAllKoreMem() {
@@ -0,0 +1,105 @@
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <unordered_set>
+
+#include "runtime/header.h"
+#include "runtime/dedup.h"
+
+static bool useDedup() {
+  const char *env = getenv("KLLVM_GC_DEDUP");
+  return env && strcmp(env, "1") == 0;
+}
+
+static std::string_view tokenContents(const string *token) {
+  return std::string_view(token->data, len(token));
+}
+
+// the limbs of an integer that are in use, followed by its size, which also
+// holds its sign.
+static std::string_view integerContents(const mpz_hdr *intgr) {
+  size_t limbs = abs(intgr->i->_mp_size);
+  return std::string_view((const char *)intgr->i->_mp_d, limbs * sizeof(mp_limb_t));
+}
+
+struct HashToken {
+  size_t operator()(const string *token) const {
+    return std::hash<std::string_view>()(tokenContents(token));
+  }
+};
+
+struct EqToken {
+  bool operator()(const string *a, const string *b) const {
+    return tokenContents(a) == tokenContents(b);
+  }
+};
+
+struct HashInteger {
+  size_t operator()(const mpz_hdr *intgr) const {
+    return std::hash<std::string_view>()(integerContents(intgr)) ^ intgr->i->_mp_size;
+  }
+};
+
+struct EqInteger {
+  bool operator()(const mpz_hdr *a, const mpz_hdr *b) const {
+    return a->i->_mp_size == b->i->_mp_size && integerContents(a) == integerContents(b);
+  }
+};
+
+static thread_local std::unordered_set<string *, HashToken, EqToken> tokens;
+static thread_local std::unordered_set<mpz_hdr *, HashInteger, EqInteger> integers;
+static thread_local size_t bytesSaved = 0;
+
+extern "C" {
+
+bool gc_dedup = useDedup();
+
+// the names of the sorts of the arguments of each symbol, by tag.
+extern const char **sort_table[];
+
+const char *dedupArgumentSort(uint32_t tag, unsigned i) {
+  return sort_table[tag][i];
+}
+
+bool dedupImmutableSort(const char *sort) {
+  return sort && strcmp(sort, "SortBytes{}");
+}
+
+string *dedupFindToken(string *token) {
+  auto it = tokens.find(token);
+  if (it == tokens.end()) {
+    return nullptr;
+  }
+  bytesSaved += sizeof(string) + len(token);
+  return *it;
+}
+
+void dedupAddToken(string *token) {
+  tokens.insert(token);
+}
+
+mpz_hdr *dedupFindInteger(mpz_hdr *intgr) {
+  auto it = integers.find(intgr);
+  if (it == integers.end()) {
+    return nullptr;
+  }
+  bytesSaved += sizeof(mpz_hdr) + (intgr->i->_mp_alloc ? sizeof(string) + intgr->i->_mp_alloc * sizeof(mp_limb_t) : 0);
+  return *it;
+}
+
+void dedupAddInteger(mpz_hdr *intgr) {
+  integers.insert(intgr);
+}
+
+void dedupReset(void) {
+  tokens.clear();
+  integers.clear();
+}
+
+size_t dedupBytesSaved(void) {
+  size_t result = bytesSaved;
+  bytesSaved = 0;
+  return result;
+}
+
+}
@@ -0,0 +1,448 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "runtime/alloc.h"
+#include "runtime/collect.h"
+#include "runtime/header.h"
+#include "runtime/heap_snapshot.h"
+#include "runtime/size.h"
+
+extern std::vector<BlockEnumerator> blockEnumerators;
+
+extern thread_local gmp_randstate_t kllvm_randState;
+extern thread_local bool kllvm_randStateInitialized;
+
+// Heap snapshots, enabled by setting KLLVM_HEAP_SNAPSHOT to the prefix of the
+// files to write them to. A snapshot of the heap of a thread is taken at the
+// end of a collection, when only live objects are left, if SIGUSR2 was
+// received since the previous snapshot, or if the heap has grown past
+// KLLVM_HEAP_SNAPSHOT_THRESHOLD bytes. The threshold then doubles, so that a
+// growing heap is captured at sizes a factor of two apart. The objects are
+// found from the roots of the collection the same way the collector finds
+// them, and written in the format described in heap_snapshot.h to
+// <prefix>.<pid>.<n>.heap.
+
+static const char *snapshotPrefix = nullptr;
+static std::atomic<unsigned long long> snapshotThreshold(0);
+static std::atomic<bool> snapshotRequested(false);
+static std::atomic<unsigned> snapshotCount(0);
+
+static void requestSnapshot(int) {
+  snapshotRequested = true;
+}
+
+class heap_walker {
+public:
+  explicit heap_walker(FILE *file) : file(file) {}
+
+  void roots(void **roots, uint8_t nroots, layoutitem *typeInfo) {
+    std::vector<uint64_t> edges;
+    for (unsigned i = 0; i < nroots; i++) {
+      child(roots, typeInfo + i, true, edges);
+    }
+    writeRoots(ROOT_COLLECTION, edges);
+    for (gc_frame *frame = gc_frames; frame; frame = frame->prev) {
+      for (uint64_t i = 0; i < frame->nroots; i++) {
+        if (frame->roots[i]) {
+          child(frame->roots, frame->layout + i, true, edges);
+        }
+      }
+    }
+    writeRoots(ROOT_FUNCTION, edges);
+    for (auto enumerator : blockEnumerators) {
+      auto range = enumerator();
+      for (block_iterator it = range.first; it != range.second; ++it) {
+        if (!is_leaf_block(**it)) {
+          edges.push_back(found(**it, HEAP_TERM));
+        }
+      }
+    }
+    writeRoots(ROOT_ENUMERATOR, edges);
+    listNodes(list_impl::empty(), edges);
+    edges.push_back(champNodes(set_impl::empty().root, 0, setElements));
+    edges.push_back(champNodes(map_impl::empty().root, 0, mapElements));
+    if (kllvm_randStateInitialized) {
+      edges.push_back(found(struct_base(string, data, kllvm_randState->_mp_seed->_mp_d), HEAP_LIMBS));
+    }
+    writeRoots(ROOT_RUNTIME, edges);
+  }
+
+  // writes the objects found from the roots, and from those objects, until
+  // none are left.
+  void objects(void) {
+    while (!pending.empty()) {
+      auto next = pending.back();
+      pending.pop_back();
+      scan(next.first, next.second);
+    }
+    for (uint32_t tag = 0; tag < tags.size(); tag++) {
+      if (tags[tag]) {
+        const char *name = getSymbolNameForTag(tag);
+        size_t length = strlen(name);
+        putc(HEAP_SYMBOL, file);
+        put(tag);
+        put(length);
+        fwrite(name, 1, length, file);
+      }
+    }
+    putc(HEAP_END, file);
+  }
+
+private:
+  FILE *file;
+  std::unordered_map<void *, uint64_t> ids;
+  // the objects found but not written yet, other than collection nodes, which
+  // are written as soon as their collection is found.
+  std::vector<std::pair<void *, heap_object_kind>> pending;
+  std::vector<bool> written;
+  std::vector<bool> tags;
+
+  void put(uint64_t value) {
+    while (value >= 0x80) {
+      putc((value & 0x7f) | 0x80, file);
+      value >>= 7;
+    }
+    putc(value, file);
+  }
+
+  std::pair<uint64_t, bool> id(void *obj) {
+    auto result = ids.emplace(obj, ids.size());
+    if (result.second) {
+      written.push_back(false);
+    }
+    return {result.first->second, result.second};
+  }
+
+  // returns the id of an object, which is written later if it was not found
+  // before.
+  uint64_t found(void *obj, heap_object_kind kind) {
+    auto result = id(obj);
+    if (result.second) {
+      pending.emplace_back(obj, kind);
+    }
+    return result.first;
+  }
+
+  void writeObject(uint64_t id, heap_object_kind kind, uint32_t tag, uint64_t size, const std::vector<uint64_t> &edges) {
+    written[id] = true;
+    putc(HEAP_OBJECT, file);
+    put(id);
+    put(kind);
+    put(tag);
+    put(size);
+    put(edges.size());
+    for (uint64_t edge : edges) {
+      put(edge);
+    }
+  }
+
+  void writeRoots(heap_root_kind kind, std::vector<uint64_t> &edges) {
+    for (uint64_t edge : edges) {
+      putc(HEAP_ROOT, file);
+      put(kind);
+      put(edge);
+    }
+    edges.clear();
+  }
+
+  // follows the child of an object, or a root, given by a layout item, in the
+  // same way as migrate_child.
+  void child(void *currBlock, layoutitem *argData, bool ptr, std::vector<uint64_t> &edges) {
+    void *arg = ((char *)currBlock) + argData->offset;
+    switch(argData->cat) {
+    case MAP_LAYOUT:
+      edges.push_back(champNodes((ptr ? *(map **)arg : (map *)arg)->impl().root, 0, mapElements));
+      break;
+    case LIST_LAYOUT: {
+      listNodes((ptr ? *(list **)arg : (list *)arg)->impl(), edges);
+      break;
+    }
+    case SET_LAYOUT:
+      edges.push_back(champNodes((ptr ? *(set **)arg : (set *)arg)->impl().root, 0, setElements));
+      break;
+    case STRINGBUFFER_LAYOUT:
+      edges.push_back(found(*(stringbuffer **)arg, HEAP_BUFFER));
+      break;
+    case SYMBOL_LAYOUT:
+    case VARIABLE_LAYOUT: {
+      block *child = *(block **)arg;
+      if (!is_leaf_block(child)) {
+        edges.push_back(found(child, HEAP_TERM));
+      }
+      break;
+    }
+    case INT_LAYOUT: {
+      mpz_ptr i = *(mpz_ptr *)arg;
+      if (!is_small_int(i)) {
+        edges.push_back(found(struct_base(mpz_hdr, i, i), HEAP_INTEGER));
+      }
+      break;
+    }
+    case FLOAT_LAYOUT:
+      edges.push_back(found(struct_base(floating_hdr, f, *(floating **)arg), HEAP_FLOAT));
+      break;
+    case BOOL_LAYOUT:
+    default: //mint
+      break;
+    }
+  }
+
+  void scan(void *obj, heap_object_kind kind) {
+    uint64_t objId = ids[obj];
+    std::vector<uint64_t> edges;
+    switch (kind) {
+    case HEAP_TERM: {
+      block *currBlock = (block *)obj;
+      const uint64_t hdr = currBlock->h.hdr;
+      uint16_t layoutInt = layout_hdr(hdr);
+      if (!layoutInt) {
+        writeObject(objId, HEAP_TOKEN, 0, get_size(hdr, 0), edges);
+        return;
+      }
+      layout *layoutData = getLayoutData(layoutInt);
+      for (unsigned i = 0; i < layoutData->nargs; i++) {
+        child(currBlock, layoutData->args + i, false, edges);
+      }
+      uint32_t tag = tag_hdr(hdr);
+      if (tag >= tags.size()) {
+        tags.resize(tag + 1);
+      }
+      tags[tag] = true;
+      writeObject(objId, HEAP_TERM, tag, get_size(hdr, layoutInt), edges);
+      return;
+    }
+    case HEAP_BUFFER:
+      edges.push_back(found(((stringbuffer *)obj)->contents, HEAP_LIMBS));
+      writeObject(objId, kind, 0, sizeof(stringbuffer), edges);
+      return;
+    case HEAP_INTEGER: {
+      mpz_hdr *intgr = (mpz_hdr *)obj;
+      if (intgr->i->_mp_alloc > 0) {
+        edges.push_back(found(struct_base(string, data, intgr->i->_mp_d), HEAP_LIMBS));
+      }
+      writeObject(objId, kind, 0, sizeof(mpz_hdr), edges);
+      return;
+    }
+    case HEAP_FLOAT: {
+      floating_hdr *flt = (floating_hdr *)obj;
+      edges.push_back(found(struct_base(string, data, flt->f.f->_mpfr_d-1), HEAP_LIMBS));
+      writeObject(objId, kind, 0, sizeof(floating_hdr), edges);
+      return;
+    }
+    default:
+      writeObject(objId, kind, 0, get_size(((string *)obj)->h.hdr, 0), edges);
+      return;
+    }
+  }
+
+  static string *collectionNode(void *node) {
+    return struct_base(string, data, node);
+  }
+
+  // writes a collection node whose record has not been written yet.
+  void writeNode(uint64_t id, void *node, const std::vector<uint64_t> &edges) {
+    writeObject(id, HEAP_COLLECTION_NODE, 0, get_size(collectionNode(node)->h.hdr, 0), edges);
+  }
+
+  // returns the id of the relaxed array of sizes of an inner node of a list,
+  // after writing it if needed.
+  uint64_t relaxedNode(void *relaxed) {
+    auto result = id(collectionNode(relaxed));
+    if (!written[result.first]) {
+      writeNode(result.first, relaxed, {});
+    }
+    return result.first;
+  }
+
+  // the walker of the list being traversed by list_visitor.
+  static thread_local heap_walker *walker;
+
+  struct list_visitor : immer::detail::rbts::visitor_base<list_visitor> {
+    using this_t = list_visitor;
+
+    template <typename Pos>
+    static void visit_inner(Pos &&pos) {
+      auto *node = pos.node();
+      uint64_t nodeId = walker->id(collectionNode(node)).first;
+      if (walker->written[nodeId]) {
+        return;
+      }
+      std::vector<uint64_t> edges;
+      for (size_t i = 0; i < pos.count(); i++) {
+        edges.push_back(walker->id(collectionNode(node->inner()[i])).first);
+      }
+      if (auto relaxed = node->impl.d.data.inner.relaxed) {
+        edges.push_back(walker->relaxedNode(relaxed));
+      }
+      walker->writeNode(nodeId, node, edges);
+      pos.each(this_t{});
+    }
+
+    template <typename Pos>
+    static void visit_leaf(Pos &&pos) {
+      auto *node = pos.node();
+      uint64_t nodeId = walker->id(collectionNode(node)).first;
+      if (walker->written[nodeId]) {
+        return;
+      }
+      std::vector<uint64_t> edges;
+      for (size_t i = 0; i < pos.count(); i++) {
+        block *element = ((block **)node->leaf())[i];
+        if (!is_leaf_block(element)) {
+          edges.push_back(walker->found(element, HEAP_TERM));
+        }
+      }
+      walker->writeNode(nodeId, node, edges);
+    }
+  };
+
+  // writes the nodes of a list, and adds edges to its root and its tail.
+  void listNodes(const list_impl &impl, std::vector<uint64_t> &edges) {
+    walker = this;
+    impl.traverse(list_visitor{});
+    // the root is not visited when all the elements are in the tail.
+    uint64_t rootId = id(collectionNode(impl.root)).first;
+    if (!written[rootId]) {
+      std::vector<uint64_t> rootEdges;
+      if (auto relaxed = impl.root->impl.d.data.inner.relaxed) {
+        rootEdges.push_back(relaxedNode(relaxed));
+      }
+      writeNode(rootId, impl.root, rootEdges);
+    }
+    edges.push_back(rootId);
+    edges.push_back(id(collectionNode(impl.tail)).first);
+  }
+
+  static void mapElements(heap_walker *walker, std::pair<KElem, KElem> *start, std::pair<KElem, KElem> *end, std::vector<uint64_t> &edges) {
+    for (auto it = start; it != end; ++it) {
+      walker->element(it->first.elem, edges);
+      walker->element(it->second.elem, edges);
+    }
+  }
+
+  static void setElements(heap_walker *walker, KElem *start, KElem *end, std::vector<uint64_t> &edges) {
+    for (auto it = start; it != end; ++it) {
+      walker->element(it->elem, edges);
+    }
+  }
+
+  void element(block *elem, std::vector<uint64_t> &edges) {
+    if (!is_leaf_block(elem)) {
+      edges.push_back(found(elem, HEAP_TERM));
+    }
+  }
+
+  // writes the nodes of a map or set in the same order as
+  // migrate_champ_traversal, and returns the id of the given node.
+  template <typename NodeT, typename T>
+  uint64_t champNodes(NodeT *node, immer::detail::hamts::count_t depth, void (*elements)(heap_walker *, T *, T *, std::vector<uint64_t> &)) {
+    uint64_t nodeId = id(collectionNode(node)).first;
+    if (written[nodeId]) {
+      return nodeId;
+    }
+    std::vector<uint64_t> edges;
+    if (depth < immer::detail::hamts::max_depth<immer::default_bits>) {
+      auto datamap = node->datamap();
+      if (datamap) {
+        // the values of a node may be shared with other nodes.
+        void *values = node->impl.d.data.inner.values;
+        uint64_t valuesId = id(collectionNode(values)).first;
+        if (!written[valuesId]) {
+          std::vector<uint64_t> valueEdges;
+          elements(this, node->values(), node->values() + immer::detail::hamts::popcount(datamap), valueEdges);
+          writeNode(valuesId, values, valueEdges);
+        }
+        edges.push_back(valuesId);
+      }
+      auto nodemap = node->nodemap();
+      if (nodemap) {
+        auto fst = node->children();
+        auto lst = fst + immer::detail::hamts::popcount(nodemap);
+        for (; fst != lst; ++fst) {
+          edges.push_back(champNodes(*fst, depth + 1, elements));
+        }
+      }
+    } else {
+      elements(this, node->collisions(), node->collisions() + node->collision_count(), edges);
+    }
+    writeNode(nodeId, node, edges);
+    return nodeId;
+  }
+};
+
+thread_local heap_walker *heap_walker::walker = nullptr;
+
+static void writeHeapSnapshot(void **roots, uint8_t nroots, layoutitem *typeInfo) {
+  std::string filename = std::string(snapshotPrefix) + "." + std::to_string(getpid()) + "." + std::to_string(snapshotCount++) + ".heap";
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (!file) {
+    perror(filename.c_str());
+    return;
+  }
+  fwrite(HEAP_SNAPSHOT_MAGIC, 1, strlen(HEAP_SNAPSHOT_MAGIC), file);
+  heap_walker walker(file);
+  walker.roots(roots, nroots, typeInfo);
+  walker.objects();
+  if (fclose(file)) {
+    perror(filename.c_str());
+  }
+}
+
+extern "C" {
+
+void initHeapSnapshots(void) {
+  snapshotPrefix = getenv("KLLVM_HEAP_SNAPSHOT");
+  if (!snapshotPrefix) {
+    return;
+  }
+  if (const char *threshold = getenv("KLLVM_HEAP_SNAPSHOT_THRESHOLD")) {
+    uint64_t size;
+    if (!parseSize(threshold, size)) {
+      fprintf(stderr, "Invalid KLLVM_HEAP_SNAPSHOT_THRESHOLD: %s\n", threshold);
+      abort();
+    }
+    snapshotThreshold = size;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = requestSnapshot;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGUSR2, &action, nullptr) < 0) {
+    perror("KLLVM_HEAP_SNAPSHOT");
+    abort();
+  }
+}
+
+void heapSnapshotAfterCollection(void **roots, uint8_t nroots, layoutitem *typeInfo) {
+  if (!snapshotPrefix) {
+    return;
+  }
+  bool requested = snapshotRequested.exchange(false);
+  unsigned long long used = youngspace_used() + oldspace_used();
+  unsigned long long threshold = snapshotThreshold;
+  if (threshold && used >= threshold) {
+    unsigned long long next = threshold;
+    while (next <= used) {
+      next *= 2;
+    }
+    // only one of the threads whose heap crosses the threshold takes a
+    // snapshot.
+    requested |= snapshotThreshold.compare_exchange_strong(threshold, next);
+  }
+  if (requested) {
+    writeHeapSnapshot(roots, nroots, typeInfo);
+  }
+}
+
+}
@@ -6,27 +6,35 @@
 
 void migrate_collection_node(void **nodePtr) {
   string *currBlock = struct_base(string, data, *nodePtr);
-  if (youngspace_collection_id() != getArenaSemispaceIDOfObject((void *)currBlock) &&
-      oldspace_collection_id() != getArenaSemispaceIDOfObject((void *)currBlock)) {
+  if (!is_collected_object(currBlock)) {
     return;
   }
-  const uint64_t hdr = currBlock->h.hdr;
+  if (is_large_object(currBlock)) {
+    largeObjectMark(currBlock);
+    return;
+  }
+  const uint64_t hdr = gc_load_header(&currBlock->h);
   initialize_migrate();
   size_t lenInBytes = get_size(hdr, 0);
-  if (!hasForwardingAddress) {
-    string *newBlock;
-    if (shouldPromote || (isInOldGen && collect_old)) {
-      newBlock = (string *)koreAllocOld(lenInBytes);
-    } else {
-      newBlock = (string *)koreAlloc(lenInBytes);
+  if (isInOldGen && is_marked_in_place(currBlock)) {
+    if (!hasForwardingAddress) {
+#ifdef GC_DBG
+      numBytesLiveAtCollection[oldAge] += lenInBytes;
+#endif
+      currBlock->h.hdr = hdr | FWD_PTR_BIT;
     }
+    return;
+  }
+  if (!hasForwardingAddress && gc_claim(&currBlock->h, hdr)) {
+    string *newBlock = (string *)gcAlloc(lenInBytes, shouldPromote || (isInOldGen && collect_old));
 #ifdef GC_DBG
     numBytesLiveAtCollection[oldAge] += lenInBytes;
 #endif
     memcpy(newBlock, currBlock, lenInBytes);
+    newBlock->h.hdr = hdr;
     migrate_header(newBlock);
     *(void **)(currBlock+1) = newBlock + 1;
-    currBlock->h.hdr |= FWD_PTR_BIT;
+    gc_publish(&currBlock->h, hdr);
   }
   *nodePtr = *(void **)(currBlock+1);
 }
@@ -4,8 +4,8 @@
 
 extern std::vector<BlockEnumerator> blockEnumerators;
 
-extern gmp_randstate_t kllvm_randState;
-extern bool kllvm_randStateInitialized;
+extern thread_local gmp_randstate_t kllvm_randState;
+extern thread_local bool kllvm_randStateInitialized;
 
 extern "C" {
 
@@ -24,6 +24,16 @@ extern "C" {
       migrate((block **)&limbs);
       rand = (mp_limb_t *)limbs->data;
     }
+    if (status_enabled && current_configuration) {
+      migrate(&current_configuration);
+    }
+    for (gc_frame *frame = gc_frames; frame; frame = frame->prev) {
+      for (uint64_t i = 0; i < frame->nroots; i++) {
+        if (frame->roots[i]) {
+          migrate_child(frame->roots, frame->layout, i, true);
+        }
+      }
+    }
     if (blockEnumerators.empty()) {
       return;
     }
@@ -0,0 +1,349 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "runtime/alloc.h"
+#include "runtime/arena.h"
+#include "runtime/header.h"
+#include "runtime/collect.h"
+
+// Parallel evacuation for the copying collector.
+//
+// Each GC thread copies objects into its own local allocation blocks (LABs)
+// carved out of the young and old generation arenas, so the bump pointer path
+// does not need any synchronization. Objects are claimed for copying by
+// atomically replacing their header with FWD_PTR_BUSY (see gc_claim), which
+// guarantees that each object is copied exactly once.
+//
+// The objects a thread has copied but not yet scanned form its work. A thread
+// scans its current LABs itself; full LABs and objects too large for a LAB are
+// published as ranges onto a per-thread deque, from which idle threads steal.
+// The deques are guarded by a lock each rather than being lock-free: a range
+// covers a whole LAB, so they are pushed and stolen rarely compared to the
+// objects copied. The collection is over once every thread is idle and every
+// deque is empty.
+//
+// The pool of GC threads is shared by the heaps of all threads, so only one
+// of them is collected in parallel at a time. The helper threads copy the
+// state of the collection from the thread being collected, and allocate into
+// its arenas and from its block source.
+
+extern "C" {
+
+thread_local bool gc_parallel = false;
+
+// The size of a local allocation block. Objects larger than a quarter of this
+// are allocated directly from the shared arena.
+static const size_t LAB_SIZE = 32 * 1024;
+static const unsigned MAX_GC_THREADS = 64;
+
+struct gc_range {
+  char *start;
+  char *end;
+};
+
+struct gc_lab {
+  char *scan;
+  char *ptr;
+  char *end;
+};
+
+struct alignas(64) gc_worker {
+  std::mutex lock;
+  std::deque<gc_range> ranges;
+};
+
+static unsigned numThreads = 0;
+static gc_worker *workers;
+static std::mutex arenaLock;
+static std::atomic<unsigned> numIdle;
+
+static std::mutex poolLock;
+static std::condition_variable poolStart, poolDone;
+static uint64_t poolEpoch = 0;
+static unsigned poolRunning = 0;
+
+// held by the thread whose heap is being collected in parallel.
+static std::mutex poolOwner;
+static struct arena *poolYoung, *poolOld;
+static struct block_source *poolSource;
+static bool poolCollectOld;
+static char poolYoungId, poolOldId;
+
+static thread_local unsigned workerId;
+static thread_local gc_lab youngLab, oldLab;
+// ranges whose objects may not have been copied in full yet. They are
+// published once the object currently being migrated has been copied.
+static thread_local std::vector<gc_range> pending;
+
+unsigned gcThreads(void) {
+  if (!numThreads) {
+#ifdef GC_DBG
+    // the statistics collected by GcStats builds are not thread-safe.
+    numThreads = 1;
+#else
+    const char *env = getenv("KLLVM_GC_THREADS");
+    long n = env ? atol(env) : 1;
+    numThreads = n < 1 ? 1 : n > MAX_GC_THREADS ? MAX_GC_THREADS : n;
+    if (mark_region && numThreads > 1) {
+      // marking in place is only implemented by the sequential collector.
+      fprintf(stderr, "Warning: KLLVM_GC_THREADS=%s is ignored with KLLVM_OLD_GEN=mark-region; collecting with one thread.\n", env);
+      numThreads = 1;
+    }
+#endif
+  }
+  return numThreads;
+}
+
+// Fills the unused tail of a LAB with a sentinel in the same way freshBlock
+// does for the end of a block, so that the arena can still be traversed
+// linearly.
+static void fillLab(gc_lab *lab) {
+  size_t remaining = lab->end - lab->ptr;
+  if (remaining == 8) {
+    *(uint64_t *)lab->ptr = NOT_YOUNG_OBJECT_BIT;
+  } else if (remaining) {
+    *(uint64_t *)lab->ptr = remaining - 8;
+  }
+  lab->end = lab->ptr;
+}
+
+static void retireLab(gc_lab *lab) {
+  if (lab->scan != lab->ptr) {
+    pending.push_back({lab->scan, lab->ptr});
+  }
+  fillLab(lab);
+  lab->scan = lab->ptr;
+}
+
+static void *arenaLockedAlloc(size_t requested, bool old) {
+  std::lock_guard<std::mutex> guard(arenaLock);
+  return arenaAlloc(old ? poolOld : poolYoung, requested);
+}
+
+void* gcAlloc(size_t requested, bool old) {
+  if (!gc_parallel) {
+    void *result = old ? koreAllocOld(requested) : koreAlloc(requested);
+    if (old && mark_region) {
+      // every object promoted into the region space is scanned, even one
+      // without children, so that it is marked. In depth-first order, other
+      // copies are pushed by migrate once their layout is known.
+      pushGrayObject(result);
+    }
+    return result;
+  }
+  gc_lab *lab = old ? &oldLab : &youngLab;
+  if (lab->ptr + requested > lab->end) {
+    if (requested > LAB_SIZE / 4) {
+      char *result = (char *)arenaLockedAlloc(requested, old);
+      pending.push_back({result, result + requested});
+      return result;
+    }
+    retireLab(lab);
+    char *chunk = (char *)arenaLockedAlloc(LAB_SIZE, old);
+    lab->scan = lab->ptr = chunk;
+    lab->end = chunk + LAB_SIZE;
+  }
+  void *result = lab->ptr;
+  lab->ptr += requested;
+  return result;
+}
+
+void* gcAllocToken(size_t requested, bool old) {
+  size_t size = (requested + 7) & ~7;
+  return gcAlloc(size < 16 ? 16 : size, old);
+}
+
+static void publishPending(void) {
+  if (pending.empty()) {
+    return;
+  }
+  gc_worker &self = workers[workerId];
+  std::lock_guard<std::mutex> guard(self.lock);
+  self.ranges.insert(self.ranges.end(), pending.begin(), pending.end());
+  pending.clear();
+}
+
+// Migrates the children of a copied object and returns its size.
+static size_t scanObject(char *ptr) {
+  block *currBlock = (block *)ptr;
+  const uint64_t hdr = currBlock->h.hdr;
+  uint16_t layoutInt = layout_hdr(hdr);
+  if (layoutInt) {
+    layout *layoutData = getLayoutData(layoutInt);
+    for (unsigned i = 0; i < layoutData->nargs; i++) {
+      migrate_child(currBlock, layoutData->args, i, false);
+    }
+  }
+  return get_size(hdr, layoutInt);
+}
+
+// Scans the not yet scanned part of a LAB owned by this thread. The scan
+// pointer is advanced before the children of an object are migrated, because
+// migrating them may retire the LAB and publish its unscanned part.
+static bool scanLab(gc_lab *lab) {
+  bool progress = false;
+  while (lab->scan != lab->ptr) {
+    char *ptr = lab->scan;
+    const uint64_t hdr = ((block *)ptr)->h.hdr;
+    lab->scan += get_size(hdr, layout_hdr(hdr));
+    scanObject(ptr);
+    publishPending();
+    progress = true;
+  }
+  return progress;
+}
+
+static void scanRange(gc_range range) {
+  char *ptr = range.start;
+  while (ptr < range.end) {
+    ptr += scanObject(ptr);
+    publishPending();
+  }
+}
+
+static bool popRange(gc_range *range) {
+  gc_worker &self = workers[workerId];
+  std::lock_guard<std::mutex> guard(self.lock);
+  if (self.ranges.empty()) {
+    return false;
+  }
+  *range = self.ranges.back();
+  self.ranges.pop_back();
+  return true;
+}
+
+static bool stealRange(gc_range *range) {
+  for (unsigned i = 1; i < numThreads; i++) {
+    gc_worker &victim = workers[(workerId + i) % numThreads];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.ranges.empty()) {
+      *range = victim.ranges.front();
+      victim.ranges.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool hasWork(void) {
+  for (unsigned i = 0; i < numThreads; i++) {
+    gc_worker &worker = workers[i];
+    std::lock_guard<std::mutex> guard(worker.lock);
+    if (!worker.ranges.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void runWorker(void) {
+  gc_range range;
+  while (true) {
+    if (scanLab(&youngLab) | scanLab(&oldLab)) {
+      continue;
+    }
+    if (popRange(&range) || stealRange(&range)) {
+      scanRange(range);
+      continue;
+    }
+    // no local work left: become idle until either some work shows up or
+    // every thread is idle. Only threads that are not idle publish work, so
+    // once every thread is idle no more work can appear.
+    numIdle.fetch_add(1);
+    bool stolen = false;
+    while (numIdle.load() != numThreads) {
+      if (hasWork()) {
+        numIdle.fetch_sub(1);
+        if (stealRange(&range)) {
+          stolen = true;
+          break;
+        }
+        numIdle.fetch_add(1);
+      }
+      __builtin_ia32_pause();
+    }
+    if (!stolen) {
+      break;
+    }
+    scanRange(range);
+  }
+  fillLab(&youngLab);
+  fillLab(&oldLab);
+}
+
+static void workerThread(unsigned id) {
+  workerId = id;
+  // the helper threads only run while they evacuate.
+  gc_phase = GC_EVACUATE;
+  initSamplerThread();
+  uint64_t epoch = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(poolLock);
+      poolStart.wait(guard, [&]{ return poolEpoch != epoch; });
+      epoch = poolEpoch;
+    }
+    youngLab = oldLab = gc_lab{};
+    collect_old = poolCollectOld;
+    gc_young_collection_id = poolYoungId;
+    gc_old_collection_id = poolOldId;
+    gc_parallel = true;
+    arenaUseBlockSource(poolSource);
+    runWorker();
+    arenaUseBlockSource(nullptr);
+    gc_parallel = false;
+    std::lock_guard<std::mutex> guard(poolLock);
+    if (--poolRunning == 0) {
+      poolDone.notify_one();
+    }
+  }
+}
+
+void parallelEvacuate(void** roots, uint8_t nroots, layoutitem *typeInfo) {
+  std::lock_guard<std::mutex> owner(poolOwner);
+  if (!workers) {
+    workers = new gc_worker[numThreads];
+    for (unsigned i = 1; i < numThreads; i++) {
+      std::thread(workerThread, i).detach();
+    }
+  }
+  workerId = 0;
+  youngLab = oldLab = gc_lab{};
+  numIdle.store(0);
+  poolYoung = youngspace_arena();
+  poolOld = oldspace_arena();
+  poolSource = arenaBlockSource();
+  poolCollectOld = collect_old;
+  poolYoungId = gc_young_collection_id;
+  poolOldId = gc_old_collection_id;
+  gc_parallel = true;
+  {
+    std::lock_guard<std::mutex> guard(poolLock);
+    poolRunning = numThreads - 1;
+    poolEpoch++;
+  }
+  poolStart.notify_all();
+  for (int i = 0; i < nroots; i++) {
+    migrate_child(roots, typeInfo, i, true);
+    publishPending();
+  }
+  migrateRoots();
+  publishPending();
+  gc_phase = GC_EVACUATE;
+  runWorker();
+  {
+    std::unique_lock<std::mutex> guard(poolLock);
+    poolDone.wait(guard, []{ return poolRunning == 0; });
+  }
+  gc_parallel = false;
+}
+
+}
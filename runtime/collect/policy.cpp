@@ -0,0 +1,318 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#include "runtime/alloc.h"
+#include "runtime/collect.h"
+#include "runtime/dedup.h"
+#include "runtime/size.h"
+
+// Policies deciding when the old generation is collected.
+//
+// The policy is selected with the KLLVM_GC_POLICY environment variable:
+//
+// * "adaptive" (the default) estimates the amount of garbage in the old
+//   generation from the fraction of the objects promoted to it that survived
+//   past collections of the old generation, and collects it once that
+//   estimate exceeds KLLVM_GC_GARBAGE_RATIO (default 1.0) times the size of
+//   the old generation after the last such collection. It also collects it
+//   once it has grown to OLD_GROWTH_LIMIT times that size, whatever the
+//   estimate. The old generation is never collected while it is smaller than
+//   KLLVM_GC_OLD_MIN_SIZE bytes (default 16MB).
+// * "fixed" collects the old generation once every KLLVM_GC_OLD_INTERVAL
+//   (default 50) collections of the young generation.
+//
+// The size of the young generation (the nursery) starts at the size of the
+// last level cache and is adjusted every NURSERY_WINDOW collections of the
+// young generation only. It grows while a large fraction of the objects
+// allocated in it survive, since a larger nursery gives them more time to die.
+// Otherwise, it moves in whichever direction last reduced the time spent
+// collecting per byte allocated. KLLVM_NURSERY_MAX (default 1GB) caps it.
+//
+// Each thread has its own heap, so the policies keep their state per thread.
+//
+// If the KLLVM_GC_PAUSE_LOG environment variable is set, one line is appended
+// to the file it names for each collection, in the form
+// "<0 for young, 1 for full> <nanoseconds> <nursery size> <bytes allocated>
+// <bytes surviving> <timestamp in nanoseconds> <bytes saved by deduplication>".
+
+extern "C" {
+
+size_t get_gc_threshold(void);
+
+struct gc_policy {
+  const char *name;
+  void (*init)(void);
+  // called at the start of a collection with the number of bytes currently
+  // used by the old generation.
+  bool (*shouldCollectOld)(size_t oldUsed);
+  // called at the end of a collection with the number of bytes used by the old
+  // generation before and after it.
+  void (*collectionDone)(bool collectedOld, size_t oldUsedBefore, size_t oldUsedAfter);
+};
+
+static double envDouble(const char *name, double dflt) {
+  const char *env = getenv(name);
+  if (!env) {
+    return dflt;
+  }
+  char *end;
+  double result = strtod(env, &end);
+  return end != env && result > 0 ? result : dflt;
+}
+
+static unsigned long long envSize(const char *name, unsigned long long dflt) {
+  const char *env = getenv(name);
+  if (!env) {
+    return dflt;
+  }
+  uint64_t result;
+  if (!parseSize(env, result)) {
+    fprintf(stderr, "Invalid %s: %s\n", name, env);
+    abort();
+  }
+  return result;
+}
+
+static thread_local unsigned long long oldInterval;
+static thread_local unsigned long long numCollectionsOnlyYoung = 0;
+
+static void fixedInit(void) {
+  oldInterval = envSize("KLLVM_GC_OLD_INTERVAL", 50);
+  if (!oldInterval) {
+    oldInterval = 1;
+  }
+}
+
+static bool fixedShouldCollectOld(size_t oldUsed) {
+  if (++numCollectionsOnlyYoung >= oldInterval) {
+    numCollectionsOnlyYoung = 0;
+    return true;
+  }
+  return false;
+}
+
+static void fixedCollectionDone(bool collectedOld, size_t oldUsedBefore, size_t oldUsedAfter) {}
+
+// weight of the most recent collection of the old generation in the estimated
+// survival rate.
+static const double SURVIVAL_WEIGHT = 0.5;
+// factor by which the old generation may grow past its size after the last
+// collection of it before it is collected regardless of the estimated garbage.
+static const double OLD_GROWTH_LIMIT = 4.0;
+
+static thread_local double garbageRatio;
+static thread_local size_t oldMinSize;
+// estimated fraction of the objects promoted since the last collection of the
+// old generation that survive the next one.
+static thread_local double survivalRate = 0.5;
+// size of the old generation after the last collection of it.
+static thread_local size_t oldLive = 0;
+
+static void adaptiveInit(void) {
+  garbageRatio = envDouble("KLLVM_GC_GARBAGE_RATIO", 1.0);
+  oldMinSize = envSize("KLLVM_GC_OLD_MIN_SIZE", 16 * 1024 * 1024);
+}
+
+static bool adaptiveShouldCollectOld(size_t oldUsed) {
+  if (oldUsed < oldMinSize) {
+    return false;
+  }
+  // objects promoted since the last collection of the old generation survive
+  // at the estimated rate. The objects that were live at that point are
+  // counted as live, since a survival rate close to one would otherwise keep
+  // the estimate below the threshold however much was promoted.
+  size_t promoted = oldUsed > oldLive ? oldUsed - oldLive : 0;
+  double projectedGarbage = promoted * (1.0 - survivalRate);
+  size_t base = oldLive > oldMinSize ? oldLive : oldMinSize;
+  return projectedGarbage >= garbageRatio * base || oldUsed >= OLD_GROWTH_LIMIT * base;
+}
+
+static void adaptiveCollectionDone(bool collectedOld, size_t oldUsedBefore, size_t oldUsedAfter) {
+  if (!collectedOld) {
+    return;
+  }
+  // the garbage found is ascribed to the objects promoted since the last
+  // collection of the old generation. The old generation after the collection
+  // also contains the objects promoted by it, so this slightly overestimates
+  // the survival rate.
+  size_t promoted = oldUsedBefore > oldLive ? oldUsedBefore - oldLive : 0;
+  size_t garbage = oldUsedBefore > oldUsedAfter ? oldUsedBefore - oldUsedAfter : 0;
+  double survived = promoted ? 1.0 - (double)garbage / promoted : 1.0;
+  if (survived < 0.0) {
+    survived = 0.0;
+  }
+  survivalRate = SURVIVAL_WEIGHT * survived + (1.0 - SURVIVAL_WEIGHT) * survivalRate;
+  oldLive = oldUsedAfter;
+}
+
+static const gc_policy policies[] = {
+  {"adaptive", adaptiveInit, adaptiveShouldCollectOld, adaptiveCollectionDone},
+  {"fixed", fixedInit, fixedShouldCollectOld, fixedCollectionDone},
+};
+
+// number of collections of the young generation between two resizes of the
+// nursery.
+static const unsigned NURSERY_WINDOW = 8;
+// survival rate above which the nursery always grows.
+static const double NURSERY_GROW_SURVIVAL = 0.25;
+
+static thread_local size_t nurseryMin;
+static thread_local size_t nurseryMax;
+static thread_local size_t nurserySize = 0;
+static thread_local int nurseryDirection = 1;
+static thread_local double lastCostPerByte = -1.0;
+static thread_local unsigned windowCollections = 0;
+static thread_local double windowPause = 0, windowAllocated = 0, windowSurvived = 0;
+
+static size_t lastLevelCacheSize(void) {
+#if defined(__APPLE__)
+  uint64_t size = 0;
+  size_t len = sizeof(size);
+  if (sysctlbyname("hw.l3cachesize", &size, &len, NULL, 0) == 0 && size) {
+    return size;
+  }
+  if (sysctlbyname("hw.l2cachesize", &size, &len, NULL, 0) == 0 && size) {
+    return size;
+  }
+#elif defined(_SC_LEVEL3_CACHE_SIZE)
+  long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (size > 0) {
+    return size;
+  }
+  size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (size > 0) {
+    return size;
+  }
+#endif
+  return 0;
+}
+
+size_t initialNurserySize(void) {
+  if (!nurserySize) {
+    nurseryMin = BLOCK_SIZE - sizeof(memory_block_header);
+    nurseryMax = envSize("KLLVM_NURSERY_MAX", 1024 * 1024 * 1024);
+    if (nurseryMax < nurseryMin) {
+      nurseryMax = nurseryMin;
+    }
+    size_t cache = lastLevelCacheSize();
+    nurserySize = cache ? cache : get_gc_threshold();
+    nurserySize = nurserySize < nurseryMin ? nurseryMin : nurserySize > nurseryMax ? nurseryMax : nurserySize;
+  }
+  return nurserySize;
+}
+
+static void resizeNursery(bool collectedOld, size_t allocated, size_t survived, uint64_t pause) {
+  // the duration of collections of the old generation says little about the
+  // size of the nursery.
+  if (collectedOld || !allocated) {
+    return;
+  }
+  windowPause += pause;
+  windowAllocated += allocated;
+  windowSurvived += survived;
+  if (++windowCollections < NURSERY_WINDOW) {
+    return;
+  }
+  double costPerByte = windowPause / windowAllocated;
+  if (windowSurvived / windowAllocated > NURSERY_GROW_SURVIVAL) {
+    nurseryDirection = 1;
+  } else if (lastCostPerByte >= 0 && costPerByte > lastCostPerByte) {
+    nurseryDirection = -nurseryDirection;
+  }
+  lastCostPerByte = costPerByte;
+  size_t size = nurseryDirection > 0 ? nurserySize + nurserySize / 2 : nurserySize - nurserySize / 3;
+  nurserySize = size < nurseryMin ? nurseryMin : size > nurseryMax ? nurseryMax : size;
+  windowCollections = 0;
+  windowPause = windowAllocated = windowSurvived = 0;
+}
+
+static FILE *openPauseLog(void) {
+  const char *filename = getenv("KLLVM_GC_PAUSE_LOG");
+  return filename ? fopen(filename, "a") : nullptr;
+}
+
+// shared by the heaps of all threads.
+static FILE *pauseLog(void) {
+  static FILE *log = openPauseLog();
+  return log;
+}
+
+uint64_t gcNanoseconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static thread_local const gc_policy *policy = nullptr;
+static thread_local size_t oldUsedAtStart;
+static thread_local size_t youngUsedAtStart;
+// bytes of the young generation occupied by the objects that survived the
+// last collection.
+static thread_local size_t youngSurvivors = 0;
+
+static const gc_policy *selectPolicy(void) {
+  const char *env = getenv("KLLVM_GC_POLICY");
+  const gc_policy *result = &policies[0];
+  if (env) {
+    for (auto &p : policies) {
+      if (strcmp(env, p.name) == 0) {
+        result = &p;
+      }
+    }
+  }
+  result->init();
+  return result;
+}
+
+bool shouldCollectOldGen(void) {
+  if (!policy) {
+    policy = selectPolicy();
+  }
+  oldUsedAtStart = oldspace_used();
+  youngUsedAtStart = youngspace_used();
+#ifdef GC_DBG
+  return true;
+#else
+  return policy->shouldCollectOld(oldUsedAtStart);
+#endif
+}
+
+size_t collectionDone(bool collectedOld, uint64_t pause) {
+  size_t oldUsed = oldspace_used();
+  policy->collectionDone(collectedOld, oldUsedAtStart, oldUsed);
+
+  size_t nursery = initialNurserySize();
+  size_t allocated = youngUsedAtStart > youngSurvivors ? youngUsedAtStart - youngSurvivors : 0;
+  youngSurvivors = youngspace_used();
+  size_t promoted = !collectedOld && oldUsed > oldUsedAtStart ? oldUsed - oldUsedAtStart : 0;
+  resizeNursery(collectedOld, allocated, youngSurvivors + promoted, pause);
+  statsCollection(collectedOld, pause, allocated, promoted);
+
+  if (FILE *log = pauseLog()) {
+    fprintf(log, "%d %llu %zu %zu %zu %llu %zu\n", collectedOld, (unsigned long long)pause,
+        nursery, allocated, youngSurvivors + promoted, (unsigned long long)gcNanoseconds(),
+        dedupBytesSaved());
+  }
+  // the threshold is compared with all the bytes used by the young generation,
+  // so it must leave room for the survivors, or a high survival rate would
+  // trigger collections back to back.
+  return youngSurvivors + nurserySize;
+}
+
+size_t youngAllocatedSinceCollection(void) {
+  size_t used = youngspace_used();
+  return used > youngSurvivors ? used - youngSurvivors : 0;
+}
+
+size_t nurseryBytes(void) {
+  return initialNurserySize();
+}
+
+}
@@ -0,0 +1,196 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <link.h>
+#include <ucontext.h>
+#endif
+
+#include "runtime/collect.h"
+
+// A sampling profiler, started by initStaticObjects when KLLVM_PROFILE_SAMPLES
+// is set. Every KLLVM_PROFILE_INTERVAL microseconds of CPU time (1000 by
+// default), SIGPROF interrupts the thread that is running, which appends a
+// line to the file of samples:
+//
+//   s <gc phase> <pc> <return address>...
+//
+// with the addresses in hexadecimal, found by following the frame pointers of
+// the stack. The lines
+//
+//   m <load bias> <start> <end> <path>
+//
+// give the executable segments of the program and the libraries it loaded,
+// and llvm-kompile-profile uses them to symbolize the samples. Stacks are
+// only complete if the interpreter and the runtime keep their frame pointers,
+// as with llvm-kompile -fno-omit-frame-pointer and a RelWithDebInfo build.
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+
+// the number of frames recorded per sample.
+static const unsigned SAMPLE_DEPTH = 32;
+// the largest frame followed when walking the stack.
+static const uintptr_t MAX_FRAME = 1 << 20;
+
+static int samplesFd = -1;
+static pid_t samplerPid;
+// the end of the stack of the calling thread, or 0 if it was not recorded by
+// initSamplerThread, in which case samples of the thread hold no frames.
+static thread_local uintptr_t stackEnd = 0;
+
+static char *appendHex(char *out, uintptr_t value) {
+  char digits[2 * sizeof(value)];
+  int n = 0;
+  do {
+    digits[n++] = "0123456789abcdef"[value & 15];
+    value >>= 4;
+  } while (value);
+  *out++ = ' ';
+  while (n) {
+    *out++ = digits[--n];
+  }
+  return out;
+}
+
+// only async-signal-safe functions can be called here.
+static void takeSample(int, siginfo_t *, void *context) {
+  int savedErrno = errno;
+  mcontext_t &mc = ((ucontext_t *)context)->uc_mcontext;
+#ifdef __x86_64__
+  uintptr_t pc = mc.gregs[REG_RIP], fp = mc.gregs[REG_RBP], sp = mc.gregs[REG_RSP];
+#else
+  uintptr_t pc = mc.pc, fp = mc.regs[29], sp = mc.sp;
+#endif
+  char line[4 + 4 * sizeof(uintptr_t) * (SAMPLE_DEPTH + 1)];
+  char *out = line;
+  *out++ = 's';
+  out = appendHex(out, gc_phase);
+  out = appendHex(out, pc);
+  // a frame holds the frame pointer of its caller followed by the address it
+  // returns to. Frames are only followed up the stack, and never past its
+  // end, so that a register that does not hold a frame pointer ends the walk.
+  uintptr_t low = sp;
+  for (unsigned depth = 1; depth < SAMPLE_DEPTH; depth++) {
+    if (fp < low || fp - low > MAX_FRAME || fp % sizeof(uintptr_t) || fp + 2 * sizeof(uintptr_t) > stackEnd) {
+      break;
+    }
+    uintptr_t *frame = (uintptr_t *)fp;
+    uintptr_t ret = frame[1];
+    if (!ret) {
+      break;
+    }
+    out = appendHex(out, ret);
+    low = fp + 2 * sizeof(uintptr_t);
+    fp = frame[0];
+  }
+  *out++ = '\n';
+  // the file is opened with O_APPEND, so that the lines written by different
+  // threads are not interleaved.
+  ssize_t ignored = write(samplesFd, line, out - line);
+  (void)ignored;
+  errno = savedErrno;
+}
+
+static int writeMapping(struct dl_phdr_info *info, size_t, void *) {
+  std::string path = info->dlpi_name;
+  if (path.empty()) {
+    char exe[4096];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len < 0) {
+      return 0;
+    }
+    path.assign(exe, len);
+  }
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+    if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X)) {
+      uintptr_t start = info->dlpi_addr + phdr.p_vaddr;
+      dprintf(samplesFd, "m %lx %lx %lx %s\n", (unsigned long)info->dlpi_addr, (unsigned long)start,
+          (unsigned long)(start + phdr.p_memsz), path.c_str());
+    }
+  }
+  return 0;
+}
+
+// the mappings are written when the profiler starts and again at exit, to
+// include the libraries loaded in between.
+static void writeMappings(void) {
+  if (getpid() == samplerPid) {
+    dl_iterate_phdr(writeMapping, nullptr);
+  }
+}
+
+void initSamplerThread(void) {
+  if (samplesFd < 0 || stackEnd) {
+    return;
+  }
+  pthread_attr_t attr;
+  void *addr;
+  size_t size;
+  if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+    return;
+  }
+  if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+    stackEnd = (uintptr_t)addr + size;
+  }
+  pthread_attr_destroy(&attr);
+}
+
+void initSampler(void) {
+  const char *filename = getenv("KLLVM_PROFILE_SAMPLES");
+  if (!filename) {
+    return;
+  }
+  const char *env = getenv("KLLVM_PROFILE_INTERVAL");
+  long interval = env ? atol(env) : 1000;
+  if (interval <= 0) {
+    fprintf(stderr, "Invalid KLLVM_PROFILE_INTERVAL: %s\n", env);
+    abort();
+  }
+  samplesFd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (samplesFd < 0) {
+    perror(filename);
+    abort();
+  }
+  samplerPid = getpid();
+  dprintf(samplesFd, "# kllvm samples every %ld us\n", interval);
+  writeMappings();
+  atexit(writeMappings);
+  initSamplerThread();
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = takeSample;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  struct itimerval timer;
+  timer.it_interval.tv_sec = interval / 1000000;
+  timer.it_interval.tv_usec = interval % 1000000;
+  timer.it_value = timer.it_interval;
+  if (sigaction(SIGPROF, &action, nullptr) < 0 || setitimer(ITIMER_PROF, &timer, nullptr) < 0) {
+    perror("KLLVM_PROFILE_SAMPLES");
+    abort();
+  }
+}
+
+#else
+
+void initSamplerThread(void) {}
+
+void initSampler(void) {
+  if (getenv("KLLVM_PROFILE_SAMPLES")) {
+    fprintf(stderr, "KLLVM_PROFILE_SAMPLES is only supported on x86-64 and AArch64 Linux\n");
+  }
+}
+
+#endif
@@ -0,0 +1,311 @@
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "runtime/alloc.h"
+#include "runtime/collect.h"
+#include "runtime/header.h"
+
+// Statistics about the run of an interpreter. They are always kept, since
+// they are only updated once per collection and once per phase of the run, and
+// they are written at exit as a JSON object to the file named by KLLVM_STATS
+// if it is set:
+//
+//   {
+//     "steps": <rewrite steps taken by the thread that exits>,
+//     "time_ns": {"total": ..., "init": ..., "parse": ..., "rewrite": ..., "print": ...},
+//     "gc": {"minor_collections": ..., "major_collections": ...,
+//            "total_pause_ns": ..., "max_pause_ns": ...},
+//     "memory": {"allocated_bytes": ..., "promoted_bytes": ..., "peak_rss_bytes": ...,
+//                "young_generation_bytes": ..., "nursery_bytes": ...,
+//                "old_generation_bytes": ...}
+//   }
+//
+// The collections of the heaps of all threads are counted. Bytes allocated
+// are those allocated in the young generation, and bytes promoted those moved
+// to the old generation by collections of the young generation only. The
+// sizes of the generations are those of the thread that exits: the bytes
+// that can be allocated in the active semispace of the young generation, the
+// bytes that can be allocated in it between two collections, and the bytes
+// occupied by the old generation, including large objects.
+//
+// A running interpreter also reports its status on request: when
+// KLLVM_STATUS_FILE is set, it replaces the file with its current status after
+// receiving SIGUSR1, and when KLLVM_HEARTBEAT_FD is set, it writes its status
+// to that file descriptor every KLLVM_HEARTBEAT_INTERVAL seconds (10 by
+// default). A status is a JSON object on a single line:
+//
+//   {"time_ns": ..., "steps": ..., "steps_per_second": ...,
+//    "young_generation_bytes": ..., "old_generation_bytes": ...,
+//    "minor_collections": ..., "major_collections": ..., "total_pause_ns": ...,
+//    "k": <symbol at the top of the <k> cell, or null>}
+//
+// where steps per second are counted since the previous status written to the
+// same file. Requests are only flagged by the signal handler and the heartbeat
+// thread. The status is written by the thread that next finishes a rewrite step
+// or a collection, which is the only one that can safely look at its
+// configuration.
+
+extern "C" {
+
+uint64_t get_steps(void);
+
+static const char *PHASE_NAMES[STATS_PHASES] = {"init", "parse", "rewrite", "print"};
+
+static std::atomic<uint64_t> minorCollections(0), majorCollections(0);
+static std::atomic<uint64_t> totalPause(0), maxPause(0);
+static std::atomic<uint64_t> allocatedBytes(0), promotedBytes(0);
+
+// the phases are those of the main thread.
+static uint64_t startTime;
+static uint64_t phaseStart;
+static enum stats_phase currentPhase = STATS_INIT;
+static uint64_t phaseTime[STATS_PHASES];
+
+enum status_request { STATUS_FILE = 1, STATUS_HEARTBEAT = 2 };
+
+std::atomic<int> status_requested(0);
+bool status_enabled = false;
+thread_local block *current_configuration = nullptr;
+
+static const char *statusFile;
+static int heartbeatFd = -1;
+
+// the time and steps of the last status written to each file, by whichever
+// thread wrote it.
+struct status_point {
+  uint64_t time, steps;
+};
+static status_point lastStatus, lastHeartbeat;
+static std::mutex statusLock;
+
+static void writeStats(void);
+
+static void requestStatus(int) {
+  status_requested.fetch_or(STATUS_FILE, std::memory_order_relaxed);
+}
+
+static void heartbeat(unsigned interval) {
+  while (true) {
+    sleep(interval);
+    status_requested.fetch_or(STATUS_HEARTBEAT, std::memory_order_relaxed);
+  }
+}
+
+static void initStatus(void) {
+  statusFile = getenv("KLLVM_STATUS_FILE");
+  if (statusFile) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStatus;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGUSR1, &action, nullptr) < 0) {
+      perror("KLLVM_STATUS_FILE");
+      abort();
+    }
+  }
+  if (const char *fd = getenv("KLLVM_HEARTBEAT_FD")) {
+    heartbeatFd = atoi(fd);
+    const char *env = getenv("KLLVM_HEARTBEAT_INTERVAL");
+    long interval = env ? atol(env) : 10;
+    if (interval <= 0) {
+      fprintf(stderr, "Invalid KLLVM_HEARTBEAT_INTERVAL: %s\n", env);
+      abort();
+    }
+    std::thread(heartbeat, interval).detach();
+  }
+  status_enabled = statusFile || heartbeatFd >= 0;
+}
+
+void initStats(void) {
+  startTime = phaseStart = gcNanoseconds();
+  if (getenv("KLLVM_STATS")) {
+    atexit(writeStats);
+  }
+  initStatus();
+}
+
+void statsPhase(enum stats_phase phase) {
+  uint64_t now = gcNanoseconds();
+  phaseTime[currentPhase] += now - phaseStart;
+  phaseStart = now;
+  currentPhase = phase;
+}
+
+void statsCollection(bool collectedOld, uint64_t pause, size_t allocated, size_t promoted) {
+  (collectedOld ? majorCollections : minorCollections).fetch_add(1, std::memory_order_relaxed);
+  totalPause.fetch_add(pause, std::memory_order_relaxed);
+  uint64_t max = maxPause.load(std::memory_order_relaxed);
+  while (pause > max && !maxPause.compare_exchange_weak(max, pause, std::memory_order_relaxed)) {
+  }
+  allocatedBytes.fetch_add(allocated, std::memory_order_relaxed);
+  promotedBytes.fetch_add(promoted, std::memory_order_relaxed);
+}
+
+static uint64_t peakRSS(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+static uint32_t tagOf(block *term) {
+  return is_leaf_block(term) ? (uintptr_t)term >> 32 : tag_hdr(term->h.hdr);
+}
+
+// returns the child of a term at the given index if it is a term, or null.
+static block *symbolChild(block *term, unsigned i) {
+  if (is_leaf_block(term) || !layout(term)) {
+    return nullptr;
+  }
+  layout *layoutData = getLayoutData(layout(term));
+  if (i >= layoutData->nargs || layoutData->args[i].cat != SYMBOL_LAYOUT) {
+    return nullptr;
+  }
+  return *(block **)((char *)term + layoutData->args[i].offset);
+}
+
+static bool isCell(block *term) {
+  return !is_leaf_block(term) && layout(term) && !strncmp(getSymbolNameForTag(tagOf(term)), "Lbl'-LT-'", 9);
+}
+
+// finds the <k> cell by descending into the cells of the configuration only.
+// Cells held by collections, such as those of multiplicity *, are not found.
+static block *findKCell(block *cell) {
+  if (!strcmp(getSymbolNameForTag(tagOf(cell)), "Lbl'-LT-'k'-GT-'{}")) {
+    return cell;
+  }
+  layout *layoutData = getLayoutData(layout(cell));
+  for (unsigned i = 0; i < layoutData->nargs; i++) {
+    block *child = symbolChild(cell, i);
+    if (child && isCell(child)) {
+      if (block *k = findKCell(child)) {
+        return k;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// returns the symbol at the top of the <k> cell of the configuration, without
+// its injection into KItem, or null if the cell was not found.
+static const char *kCellTop(void) {
+  if (!current_configuration || !isCell(current_configuration)) {
+    return nullptr;
+  }
+  block *k = findKCell(current_configuration);
+  block *seq = k ? symbolChild(k, 0) : nullptr;
+  if (!seq) {
+    return nullptr;
+  }
+  block *top = seq;
+  if (!strcmp(getSymbolNameForTag(tagOf(seq)), "kseq{}") && symbolChild(seq, 0)) {
+    top = symbolChild(seq, 0);
+  }
+  if (!strncmp(getSymbolNameForTag(tagOf(top)), "inj{", 4) && symbolChild(top, 0)) {
+    top = symbolChild(top, 0);
+  }
+  return getSymbolNameForTag(tagOf(top));
+}
+
+static std::string jsonString(const char *str) {
+  if (!str) {
+    return "null";
+  }
+  std::string result = "\"";
+  for (const char *c = str; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      result += '\\';
+      result += *c;
+    } else if ((unsigned char)*c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      result += escaped;
+    } else {
+      result += *c;
+    }
+  }
+  return result + "\"";
+}
+
+static std::string status(status_point &last) {
+  uint64_t now = gcNanoseconds(), steps = get_steps();
+  double elapsed = (now - (last.time ? last.time : startTime)) / 1e9;
+  // the steps are reset between the requests of a server.
+  uint64_t taken = steps >= last.steps ? steps - last.steps : steps;
+  double rate = elapsed > 0 ? taken / elapsed : 0;
+  last.time = now;
+  last.steps = steps;
+  char buf[512];
+  snprintf(buf, sizeof(buf), "{\"time_ns\": %" PRIu64 ", \"steps\": %" PRIu64 ", \"steps_per_second\": %.1f"
+      ", \"young_generation_bytes\": %zu, \"old_generation_bytes\": %zu, \"minor_collections\": %" PRIu64
+      ", \"major_collections\": %" PRIu64 ", \"total_pause_ns\": %" PRIu64 ", \"k\": ",
+      now - startTime, steps, rate, youngspace_used(), oldspace_used(), minorCollections.load(),
+      majorCollections.load(), totalPause.load());
+  return buf + jsonString(kCellTop()) + "}\n";
+}
+
+void statusReport(void) {
+  int requested = status_requested.exchange(0);
+  std::lock_guard<std::mutex> guard(statusLock);
+  if (requested & STATUS_FILE) {
+    // the file is replaced at once, so that it can be read at any time.
+    std::string tmp = std::string(statusFile) + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "w");
+    if (file) {
+      fputs(status(lastStatus).c_str(), file);
+      fclose(file);
+      rename(tmp.c_str(), statusFile);
+    } else {
+      perror(tmp.c_str());
+    }
+  }
+  if (requested & STATUS_HEARTBEAT) {
+    std::string line = status(lastHeartbeat);
+    ssize_t ignored = write(heartbeatFd, line.data(), line.size());
+    (void)ignored;
+  }
+}
+
+static void writeStats(void) {
+  const char *filename = getenv("KLLVM_STATS");
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    perror(filename);
+    return;
+  }
+  statsPhase(currentPhase);
+  fprintf(file, "{\n  \"steps\": %" PRIu64 ",\n", get_steps());
+  fprintf(file, "  \"time_ns\": {\"total\": %" PRIu64, phaseStart - startTime);
+  for (int phase = 0; phase < STATS_PHASES; phase++) {
+    fprintf(file, ", \"%s\": %" PRIu64, PHASE_NAMES[phase], phaseTime[phase]);
+  }
+  fprintf(file, "},\n");
+  fprintf(file, "  \"gc\": {\"minor_collections\": %" PRIu64 ", \"major_collections\": %" PRIu64
+      ", \"total_pause_ns\": %" PRIu64 ", \"max_pause_ns\": %" PRIu64 "},\n",
+      minorCollections.load(), majorCollections.load(), totalPause.load(), maxPause.load());
+  fprintf(file, "  \"memory\": {\"allocated_bytes\": %" PRIu64 ", \"promoted_bytes\": %" PRIu64
+      ", \"peak_rss_bytes\": %" PRIu64 ", \"young_generation_bytes\": %zu, \"nursery_bytes\": %zu"
+      ", \"old_generation_bytes\": %zu}\n}\n",
+      allocatedBytes.load() + youngAllocatedSinceCollection(), promotedBytes.load(), peakRSS(),
+      youngspace_size(), nurseryBytes(), oldspace_used());
+  fclose(file);
+}
+
+}
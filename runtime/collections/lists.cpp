@@ -35,10 +35,10 @@ extern "C" {
   }
 
   bool hook_LIST_in_keys(SortInt index, SortList list) {
-    if (!mpz_fits_ulong_p(index)) {
+    if (!mpz_fits_ulong_p(int_view(index))) {
       throw std::invalid_argument("Index is too large for in_keys");
     }
-    size_t idx = mpz_get_ui(index);
+    size_t idx = mpz_get_ui(int_view(index));
     return idx < list->size();
   }
 
@@ -49,10 +49,10 @@ extern "C" {
   }
 
   SortKItem hook_LIST_get(SortList list, SortInt index) {
-    if (!mpz_fits_slong_p(index)) {
+    if (!mpz_fits_slong_p(int_view(index))) {
       throw std::invalid_argument("Index is too large for get");
     }
-    ssize_t idx = mpz_get_si(index);
+    ssize_t idx = mpz_get_si(int_view(index));
     return hook_LIST_get_long(list, idx);
   }
 
@@ -74,12 +74,12 @@ extern "C" {
   }
 
   list hook_LIST_range(SortList list, SortInt from_front, SortInt from_back) {
-    if (!mpz_fits_ulong_p(from_front) || !mpz_fits_ulong_p(from_back)) {
+    if (!mpz_fits_ulong_p(int_view(from_front)) || !mpz_fits_ulong_p(int_view(from_back))) {
       throw std::invalid_argument("Range index too large for range");
     }
 
-    size_t front = mpz_get_ui(from_front);
-    size_t back = mpz_get_ui(from_back);
+    size_t front = mpz_get_ui(int_view(from_front));
+    size_t back = mpz_get_ui(int_view(from_back));
 
     return hook_LIST_range_long(list, front, back);
   }
@@ -95,20 +95,20 @@ extern "C" {
   }
 
   list hook_LIST_make(SortInt len, SortKItem value) {
-    if (!mpz_fits_ulong_p(len)) {
+    if (!mpz_fits_ulong_p(int_view(len))) {
       throw std::invalid_argument("Length is too large for make");
     }
 
-    size_t length = mpz_get_ui(len);
+    size_t length = mpz_get_ui(int_view(len));
     return list(length, value);
   }
 
   list hook_LIST_update(SortList list, SortInt index, SortKItem value) {
-    if (!mpz_fits_ulong_p(index)) {
+    if (!mpz_fits_ulong_p(int_view(index))) {
       throw std::invalid_argument("Length is too large for update");
     }
     
-    size_t idx = mpz_get_ui(index);
+    size_t idx = mpz_get_ui(int_view(index));
     if (idx >= list->size()) {
       throw std::invalid_argument("Index out of range for update");
     }
@@ -117,11 +117,11 @@ extern "C" {
   }
 
   list hook_LIST_updateAll(SortList l1, SortInt index, SortList l2) {
-    if (!mpz_fits_ulong_p(index)) {
+    if (!mpz_fits_ulong_p(int_view(index))) {
       throw std::invalid_argument("Length is too large for updateAll");
     }
 
-    size_t idx = mpz_get_ui(index);
+    size_t idx = mpz_get_ui(int_view(index));
     size_t size = l1->size();
     size_t size2 = l2->size();
     if (idx != 0 && size2 != 0) {
@@ -150,16 +150,16 @@ extern "C" {
   }
 
   list hook_LIST_fill(SortList l, SortInt index, SortInt len, SortKItem val) {
-    if (!mpz_fits_ulong_p(index)) {
+    if (!mpz_fits_ulong_p(int_view(index))) {
       throw std::invalid_argument("Index is too large for fill");
     }
 
-    if (!mpz_fits_ulong_p(len)) {
+    if (!mpz_fits_ulong_p(int_view(len))) {
       throw std::invalid_argument("Length is too large for fill");
     }
 
-    size_t idx = mpz_get_ui(index);
-    size_t length = mpz_get_ui(len);
+    size_t idx = mpz_get_ui(int_view(index));
+    size_t length = mpz_get_ui(int_view(len));
 
     if (idx != 0 && length != 0) {
       if (idx + length - 1 >= l->size()) {
@@ -59,7 +59,7 @@ compareChildren:
   %children = extractvalue %layout %layoutData, 1
   br label %loop
 loop:
-  %counter = phi i8 [ %length, %compareChildren ], [ %sub1, %compareMap ], [ %sub1, %compareList ], [ %sub1, %compareSet ], [ %sub1, %compareInt ], [ %sub1, %compareFloat ], [ %sub1, %compareBool ], [ %sub1, %compareSymbol ], [ %sub1, %compareVariable ]
+  %counter = phi i8 [ %length, %compareChildren ], [ %sub1, %compareMap ], [ %sub1, %compareList ], [ %sub1, %compareSet ], [ %sub1, %compareInt ], [ %sub1, %compareIntValue ], [ %sub1, %compareFloat ], [ %sub1, %compareBool ], [ %sub1, %compareSymbol ], [ %sub1, %compareVariable ]
   %index = sub i8 %length, %counter
   %indexlong = zext i8 %index to i64
   %sub1 = sub i8 %counter, 1
@@ -101,6 +101,9 @@ compareInt:
   %int2ptrptr = inttoptr i64 %child2intptr to %mpz**
   %int1ptr = load %mpz*, %mpz** %int1ptrptr
   %int2ptr = load %mpz*, %mpz** %int2ptrptr
+  %sameInt = icmp eq %mpz* %int1ptr, %int2ptr
+  br i1 %sameInt, label %loop, label %compareIntValue
+compareIntValue:
   %comparedInt = call i1 @hook_INT_eq(%mpz* %int1ptr, %mpz* %int2ptr)
   br i1 %comparedInt, label %loop, label %exit
 compareFloat:
@@ -132,7 +135,7 @@ compareVariable:
   %comparedVar = call i1 @hook_STRING_eq(%block* %var1ptr, %block* %var2ptr)
   br i1 %comparedVar, label %loop, label %exit
 exit:
-  %phi = phi i1 [ 0, %entry ], [ %eqconstant, %constant ], [ 0, %block ], [ %eqcontents, %eqString ], [ 1, %loop ], [ 0, %compareMap ], [ 0, %compareList ], [ 0, %compareSet ], [ 0, %compareInt ], [ 0, %compareFloat ], [ 0, %compareBool ], [ 0, %compareSymbol ], [ 0, %compareVariable ]
+  %phi = phi i1 [ 0, %entry ], [ %eqconstant, %constant ], [ 0, %block ], [ %eqcontents, %eqString ], [ 1, %loop ], [ 0, %compareMap ], [ 0, %compareList ], [ 0, %compareSet ], [ 0, %compareIntValue ], [ 0, %compareFloat ], [ 0, %compareBool ], [ 0, %compareSymbol ], [ 0, %compareVariable ]
   ret i1 %phi
 stuck:
   call void @abort()
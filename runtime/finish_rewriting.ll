@@ -6,6 +6,7 @@ target triple = "x86_64-unknown-linux-gnu"
 %mpz = type { i32, i32, i64* }
 
 declare void @printStatistics(i8*, i64)
+declare void @statsPhase(i32)
 declare void @printConfiguration(i8*, %block*)
 declare void @printConfigurationToFile(i8*, %block*)
 declare void @exit(i32) #0
@@ -27,7 +28,27 @@ define weak fastcc %mpz* @"eval_LblgetExitCode{SortGeneratedTopCell{}}"(%block*)
 @statistics = global i1 zeroinitializer
 @steps = external thread_local global i64
 
+; if set, called instead of terminating the process when a function is stuck.
+; It must not return.
+@stuck_in_function_handler = thread_local global void (%block*)* null
+
+define void @set_stuck_in_function_handler(void (%block*)* %handler) {
+  store void (%block*)* %handler, void (%block*)** @stuck_in_function_handler
+  ret void
+}
+
 define void @finish_rewriting(%block* %subject, i1 %error) #0 {
+entry:
+  br i1 %error, label %checkHandler, label %start
+checkHandler:
+  %handler = load void (%block*)*, void (%block*)** @stuck_in_function_handler
+  %hasHandler = icmp ne void (%block*)* %handler, null
+  br i1 %hasHandler, label %handle, label %start
+handle:
+  call void %handler(%block* %subject)
+  unreachable
+start:
+  call void @statsPhase(i32 3) ; print
   %output = load i8*, i8** @output_file
   %outputintptr = ptrtoint i8* %output to i64
   %isnull = icmp eq i64 %outputintptr, 0
@@ -48,9 +69,7 @@ printConfig:
   call void @printConfiguration(i8* %output, %block* %subject)
   br i1 %error, label %exit, label %exitCode
 exitCode:
-  %exit_z = call fastcc %mpz* @"eval_LblgetExitCode{SortGeneratedTopCell{}}"(%block* %subject)
-  %exit_ul = call i64 @__gmpz_get_ui(%mpz* %exit_z)
-  %exit_trunc = trunc i64 %exit_ul to i32
+  %exit_trunc = call i32 @get_exit_code(%block* %subject)
   br label %exit
 exit:
   %exit_ui = phi i32 [ %exit_trunc, %exitCode ], [ 113, %printConfig ]
@@ -58,4 +77,21 @@ exit:
   unreachable
 }
 
+define i32 @get_exit_code(%block* %subject) {
+entry:
+  %exit_z = call fastcc %mpz* @"eval_LblgetExitCode{SortGeneratedTopCell{}}"(%block* %subject)
+  %exit_intptr = ptrtoint %mpz* %exit_z to i64
+  %exit_tag = and i64 %exit_intptr, 1
+  %exit_small = icmp ne i64 %exit_tag, 0
+  br i1 %exit_small, label %small, label %heap
+small:
+  %exit_value = ashr i64 %exit_intptr, 1
+  %exit_small_trunc = trunc i64 %exit_value to i32
+  ret i32 %exit_small_trunc
+heap:
+  %exit_ul = call i64 @__gmpz_get_ui(%mpz* %exit_z)
+  %exit_trunc = trunc i64 %exit_ul to i32
+  ret i32 %exit_trunc
+}
+
 attributes #0 = { noreturn }
@@ -18,11 +18,18 @@ declare %mpz* @hook_INT_add(%mpz*, %mpz*)
 declare i8* @evaluateFunctionSymbol(i32, i8**)
 declare i8* @getTerminatedString(%string*)
 
+@gc_safepoint_inhibit = external thread_local global i64
+
 @fresh_int_1 = global %mpz { i32 1, i32 1, i64* getelementptr inbounds ([1 x i64], [1 x i64]* @fresh_int_1_limbs, i32 0, i32 0) }
 @fresh_int_1_limbs = global [1 x i64] [i64 1]
 
+; called by K functions while they hold pointers into the heap, so the
+; functions it evaluates must not collect.
 define i8* @get_fresh_constant(%string* %sort, %block* %top) {
 entry:
+  %inhibit = load i64, i64* @gc_safepoint_inhibit
+  %inhibited = add i64 %inhibit, 1
+  store i64 %inhibited, i64* @gc_safepoint_inhibit
   %counterCell = call fastcc %block* @"eval_LblgetGeneratedCounterCell{SortGeneratedTopCell{}}"(%block* %top)
   %counterCellPointer = getelementptr %block, %block* %counterCell, i64 0, i32 1, i64 0
   %mpzPtrPtr = bitcast i64** %counterCellPointer to %mpz**
@@ -35,6 +42,7 @@ entry:
   %voidPtr = bitcast %mpz* %currCounter to i8*
   store i8* %voidPtr, i8** %args
   %retval = call i8* @evaluateFunctionSymbol(i32 %tag, i8** %args)
+  store i64 %inhibit, i64* @gc_safepoint_inhibit
   ret i8* %retval
 }
 
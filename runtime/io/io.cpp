@@ -263,11 +263,11 @@ extern "C" {
   }
 
   SortIOInt hook_IO_tell(SortInt i) {
-    if (!mpz_fits_sint_p(i)) {
+    if (!mpz_fits_sint_p(int_view(i))) {
       throw std::invalid_argument("Arg too large for int");
     }
 
-    int fd = mpz_get_si(i);
+    int fd = mpz_get_si(int_view(i));
     off_t loc = lseek(fd, 0, SEEK_CUR);
 
     if (-1 == loc) {
@@ -284,11 +284,11 @@ extern "C" {
   }
 
   SortIOInt hook_IO_getc(SortInt i) {
-    if (!mpz_fits_sint_p(i)) {
+    if (!mpz_fits_sint_p(int_view(i))) {
       throw std::invalid_argument("Arg too large for int");
     }
 
-    int fd = mpz_get_si(i);
+    int fd = mpz_get_si(int_view(i));
     char c;
     ssize_t ret = read(fd, &c, sizeof(char));
 
@@ -313,12 +313,12 @@ extern "C" {
   }
 
   SortIOString hook_IO_read(SortInt i, SortInt len) {
-    if (!mpz_fits_sint_p(i) || !mpz_fits_ulong_p(len)) {
+    if (!mpz_fits_sint_p(int_view(i)) || !mpz_fits_ulong_p(int_view(len))) {
       throw std::invalid_argument("Arg too large");
     }
 
-    int fd = mpz_get_si(i);
-    size_t length = mpz_get_ui(len);
+    int fd = mpz_get_si(int_view(i));
+    size_t length = mpz_get_ui(int_view(len));
 
     auto result = static_cast<string *>(koreAllocToken(sizeof(string) + length));
     int bytes = read(fd, &(result->data), length);
@@ -336,11 +336,11 @@ extern "C" {
   }
 
   SortK hook_IO_close(SortInt i) {
-    if (!mpz_fits_sint_p(i)) {
+    if (!mpz_fits_sint_p(int_view(i))) {
       throw std::invalid_argument("Arg too large for int");
     }
 
-    int fd = mpz_get_si(i);
+    int fd = mpz_get_si(int_view(i));
     int ret = close(fd);
 
     if (ret == -1) {
@@ -351,12 +351,12 @@ extern "C" {
   }
 
   SortK hook_IO_seek(SortInt i, SortInt loc) {
-    if (!mpz_fits_sint_p(i) || !mpz_fits_slong_p(loc)) {
+    if (!mpz_fits_sint_p(int_view(i)) || !mpz_fits_slong_p(int_view(loc))) {
       throw std::invalid_argument("Arg too large");
     }
 
-    int fd = mpz_get_si(i);
-    off_t l = mpz_get_si(loc);
+    int fd = mpz_get_si(int_view(i));
+    off_t l = mpz_get_si(int_view(loc));
     int ret = lseek(fd, l, SEEK_SET);
 
     if (ret == -1) {
@@ -367,12 +367,12 @@ extern "C" {
   }
 
   SortK hook_IO_seekEnd(SortInt i, SortInt loc) {
-    if (!mpz_fits_sint_p(i) || !mpz_fits_slong_p(loc)) {
+    if (!mpz_fits_sint_p(int_view(i)) || !mpz_fits_slong_p(int_view(loc))) {
       throw std::invalid_argument("Arg too large");
     }
 
-    int fd = mpz_get_si(i);
-    off_t l = mpz_get_si(loc);
+    int fd = mpz_get_si(int_view(i));
+    off_t l = mpz_get_si(int_view(loc));
     int ret = lseek(fd, l, SEEK_END);
 
     if (ret == -1) {
@@ -383,12 +383,12 @@ extern "C" {
   }
 
   SortK hook_IO_putc(SortInt i, SortInt c) {
-    if (!mpz_fits_sint_p(i) || !mpz_fits_sint_p(c)) {
+    if (!mpz_fits_sint_p(int_view(i)) || !mpz_fits_sint_p(int_view(c))) {
       throw std::invalid_argument("Arg too large");
     }
 
-    int fd = mpz_get_si(i);
-    int ch = mpz_get_si(c);
+    int fd = mpz_get_si(int_view(i));
+    int ch = mpz_get_si(int_view(c));
     int ret = write(fd, &ch, 1);
 
     if (ret == -1) {
@@ -399,11 +399,11 @@ extern "C" {
   }
 
   SortK hook_IO_write(SortInt i, SortString str) {
-    if (!mpz_fits_sint_p(i)) {
+    if (!mpz_fits_sint_p(int_view(i))) {
       throw std::invalid_argument("Arg too large for int");
     }
 
-    int fd = mpz_get_si(i);
+    int fd = mpz_get_si(int_view(i));
     int ret = write(fd, str->data, len(str));
 
     if (ret == -1) {
@@ -414,12 +414,12 @@ extern "C" {
   }
 
   SortK hook_IO_lock(SortInt i, SortInt len) {
-    if (!mpz_fits_sint_p(i) || !mpz_fits_slong_p(len)) {
+    if (!mpz_fits_sint_p(int_view(i)) || !mpz_fits_slong_p(int_view(len))) {
       throw std::invalid_argument("Arg too large");
     }
 
-    int fd = mpz_get_si(i);
-    off_t l = mpz_get_si(len);
+    int fd = mpz_get_si(int_view(i));
+    off_t l = mpz_get_si(int_view(len));
 
     struct flock lockp = {0};
     lockp.l_type = F_WRLCK; lockp.l_whence = SEEK_CUR; lockp.l_start = 0; lockp.l_len = l;
@@ -433,12 +433,12 @@ extern "C" {
   }
 
   SortK hook_IO_unlock(SortInt i, SortInt len) {
-    if (!mpz_fits_sint_p(i) || !mpz_fits_slong_p(len)) {
+    if (!mpz_fits_sint_p(int_view(i)) || !mpz_fits_slong_p(int_view(len))) {
       throw std::invalid_argument("Arg too large");
     }
 
-    int fd = mpz_get_si(i);
-    off_t l = mpz_get_si(len);
+    int fd = mpz_get_si(int_view(i));
+    off_t l = mpz_get_si(int_view(len));
 
     struct flock lockp = {0};
     lockp.l_type = F_UNLCK; lockp.l_whence = SEEK_CUR; lockp.l_start = 0; lockp.l_len = l;
@@ -463,11 +463,11 @@ extern "C" {
   }
 
   SortIOInt hook_IO_accept(SortInt sock) {
-    if (!mpz_fits_sint_p(sock)) {
+    if (!mpz_fits_sint_p(int_view(sock))) {
       throw std::invalid_argument("Arg too large");
     }
 
-    int fd = mpz_get_si(sock);
+    int fd = mpz_get_si(int_view(sock));
     int clientsock = accept(fd, NULL, NULL);
 
     if (clientsock == -1) {
@@ -485,11 +485,11 @@ extern "C" {
   }
 
   SortK hook_IO_shutdownWrite(SortInt sock) {
-    if (!mpz_fits_sint_p(sock)) {
+    if (!mpz_fits_sint_p(int_view(sock))) {
       throw std::invalid_argument("Arg too large");
     }
 
-    int fd = mpz_get_si(sock);
+    int fd = mpz_get_si(int_view(sock));
     int ret = shutdown(fd, SHUT_WR);
 
     if (ret == -1) {
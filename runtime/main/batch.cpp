@@ -0,0 +1,70 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "runtime/arena.h"
+#include "runtime/header.h"
+
+// Rewrites several input files concurrently. Every thread of the pool has its
+// own heap and collects it independently, so the threads do not synchronize
+// while rewriting.
+//
+// Usage: interpreter <depth> <threads> <input.kore>...
+//
+// The final configuration of each input is written to <input.kore>.out. A
+// thread count of 0 uses one thread per core. As with the plain interpreter,
+// an input that gets stuck in a function prints its configuration to stderr
+// and aborts the whole process.
+
+extern "C" {
+  void initStaticObjects(void);
+  block *take_steps(int64_t, block *);
+}
+
+static void rewriteFiles(int64_t depth, std::vector<char *> const &inputs, std::atomic<size_t> &next) {
+  initStaticObjects();
+  size_t i;
+  while ((i = next.fetch_add(1)) < inputs.size()) {
+    block *input = parseConfiguration(inputs[i]);
+    block *result = take_steps(depth, input);
+    std::string output = std::string(inputs[i]) + ".out";
+    printConfiguration(output.c_str(), result);
+  }
+  freeAllMemory();
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr, "Usage: %s <depth> <threads> <input.kore>...\n", argv[0]);
+    return 1;
+  }
+  int64_t depth = atol(argv[1]);
+  size_t numThreads = atol(argv[2]);
+  if (!numThreads) {
+    numThreads = std::thread::hardware_concurrency();
+  }
+  if (!numThreads) {
+    numThreads = 1;
+  }
+  std::vector<char *> inputs(argv + 3, argv + argc);
+  if (numThreads > inputs.size()) {
+    numThreads = inputs.size();
+  }
+
+  // allocates the objects shared by every thread before any of them starts.
+  initStaticObjects();
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < numThreads; i++) {
+    threads.emplace_back(rewriteFiles, depth, std::cref(inputs), std::ref(next));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return 0;
+}
@@ -0,0 +1,150 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "runtime/header.h"
+#include "runtime/serve.h"
+
+// Rewrites a stream of configurations, each in a child process forked from an
+// interpreter that has already initialized its heap. The child inherits that
+// heap copy-on-write, so a request pays neither for starting the interpreter
+// nor for constructing the parts of its configuration that every request
+// shares.
+//
+// Usage: interpreter <depth> <base.kore>|- [<socket>]
+//
+// If a base configuration is given, it is parsed once, and its subterms that
+// contain no KORE variables are constructed before the first request. Each
+// request then binds the variables of the base: it is the number of bindings
+// as a 64-bit integer, followed by each binding as the length of the variable
+// name as a 64-bit integer, the name, the length of a KORE pattern as a 64-bit
+// integer and the pattern. If the base is -, each request is the length of a
+// whole KORE pattern as a 64-bit integer, followed by the pattern.
+//
+// The response is the exit code of the final configuration as a 32-bit
+// integer, followed by the length in bytes of the final configuration as a
+// 64-bit integer and the configuration itself. The child sends its response
+// to the server through a pipe, and only the server writes to the client. If
+// the child fails before its whole response is sent, for instance because its
+// input cannot be parsed or it gets stuck in a function, the response is an
+// exit code of -1 and an empty configuration, and the server carries on.
+// Integers are in native byte order.
+//
+// Requests are read from stdin or a Unix domain socket as in the "server"
+// main, and served one at a time.
+
+extern "C" {
+  void initStaticObjects(void);
+  block *take_steps(int64_t, block *);
+  int32_t get_exit_code(block *);
+}
+
+// reads the next request, returning false at the end of the input.
+static bool readRequest(int in, configuration_template *base, std::string &pattern, std::unordered_map<std::string, std::string> &bindings) {
+  if (!base) {
+    return readString(in, pattern);
+  }
+  uint64_t count;
+  if (!readAll(in, &count, sizeof(count))) {
+    return false;
+  }
+  bindings.clear();
+  for (uint64_t i = 0; i < count; i++) {
+    std::string name, value;
+    if (!readString(in, name) || !readString(in, value)) {
+      fprintf(stderr, "Truncated request\n");
+      return false;
+    }
+    bindings[name] = value;
+  }
+  return true;
+}
+
+// serves requests until the end of the input or until the client goes away.
+static void serve(int64_t depth, configuration_template *base, int in, int out) {
+  std::string pattern;
+  std::unordered_map<std::string, std::string> bindings;
+  while (readRequest(in, base, pattern, bindings)) {
+    // buffered output of the server must not be written again by the child.
+    fflush(nullptr);
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+      perror("pipe");
+      exit(1);
+    }
+    pid_t child = fork();
+    if (child < 0) {
+      perror("fork");
+      exit(1);
+    }
+    if (child == 0) {
+      close(pipefd[0]);
+      block *input = base
+        ? instantiateConfigurationTemplate(base, bindings)
+        : parseConfigurationFromString(pattern.data(), pattern.size());
+      block *result = take_steps(depth, input);
+      int32_t exitCode = get_exit_code(result);
+      string *output = printConfigurationToString(result);
+      bool written = writeResponse(pipefd[1], exitCode, output->data, len(output));
+      fflush(stdout);
+      _exit(written ? 0 : 1);
+    }
+    close(pipefd[1]);
+    // the child's response is relayed only once it has exited cleanly, so a
+    // child that dies part way through cannot leave a partial frame behind.
+    std::string response;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(pipefd[0], buf, sizeof(buf))) != 0) {
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      response.append(buf, n);
+    }
+    close(pipefd[0]);
+    int status;
+    pid_t waited;
+    while ((waited = waitpid(child, &status, 0)) < 0 && errno == EINTR) {}
+    bool ok = waited == child && WIFEXITED(status) && WEXITSTATUS(status) == 0
+      && responseSize(response) == response.size();
+    bool written = ok
+      ? writeAll(out, response.data(), response.size())
+      : writeResponse(out, -1, "", 0);
+    if (!written) {
+      return;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 4) {
+    fprintf(stderr, "Usage: %s <depth> <base.kore>|- [<socket>]\n", argv[0]);
+    return 1;
+  }
+  int64_t depth = atol(argv[1]);
+
+  initStaticObjects();
+  configuration_template *base = nullptr;
+  if (strcmp(argv[2], "-") != 0) {
+    base = parseConfigurationTemplate(argv[2]);
+  }
+
+  if (argc == 3) {
+    int out = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    serve(depth, base, STDIN_FILENO, out);
+    return 0;
+  }
+
+  return serveSocket(argv[3], [depth, base](int conn) { serve(depth, base, conn, conn); });
+}
@@ -11,6 +11,7 @@ declare %block* @take_steps(i64, %block*)
 declare void @finish_rewriting(%block*, i1) #0
 
 declare void @initStaticObjects()
+declare void @statsPhase(i32)
 
 @output_file = external global i8*
 @statistics = external global i1
@@ -30,7 +31,9 @@ entry:
 
   call void @initStaticObjects()
 
+  call void @statsPhase(i32 1) ; parse
   %ret = call %block* @parseConfiguration(i8* %filename)
+  call void @statsPhase(i32 2) ; rewrite
   %result = call %block* @take_steps(i64 %depth, %block* %ret)
   call void @finish_rewriting(%block* %result, i1 0)
   unreachable
@@ -1,28 +1,122 @@
-#include <unordered_set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 
+#include "runtime/collect.h"
 #include "runtime/header.h"
 
+// Usage: interpreter <input.kore> <depth> <output> [<option>...] [stats]
+//
+// With the bfs strategy, depth bounds the number of states expanded, as it
+// always has. With the others, it bounds the length of the paths followed.
+//
+// Options:
+//   --visited <mode>       how the states already visited are remembered (see
+//                          setSearchVisitedSet). Also prints the size of the
+//                          state space found and the estimated probability
+//                          that part of it was omitted to stderr.
+//   --strategy <strategy>  bfs (the default), dfs or iddfs.
+//   --bound <n>            stop once n results have been found.
+//   --reachable            every state reached that matches the search
+//                          pattern is a result, not only the stuck ones.
+//   --processes <addresses> --process <i>
+//                          split the search between the processes listening
+//                          at the comma-separated addresses (unix:<path> or
+//                          <host>:<port>), this one being the i-th from 0.
+//                          Only process 0 writes the results.
+
 extern "C" {
   void initStaticObjects(void);
   uint64_t get_steps(void);
 }
 
-std::unordered_set<block *, HashBlock, KEq> take_search_steps(int64_t depth, block *subject);
-void printConfigurations(const char *filename, std::unordered_set<block *, HashBlock, KEq> results);
+uint64_t take_search_steps(int64_t depth, block *subject, FILE *output);
+bool setSearchVisitedSet(const char *mode);
+bool setSearchStrategy(const char *strategy);
+void setSearchBound(uint64_t bound);
+void setSearchReachable(bool reachable);
+bool setSearchProcesses(const char *addresses, unsigned self);
+void printSearchSummary(FILE *file);
+
+// runs the search and writes its results to output, preceded by the
+// statistics if they were requested.
+static void search(int64_t depth, block *input, const char *output, bool hasStatistics) {
+  if (!hasStatistics) {
+    FILE *file = fopen(output, "a");
+    take_search_steps(depth, input, file);
+    fclose(file);
+  } else {
+    // the statistics precede the results in the output, but are only known
+    // once the search is over.
+    FILE *results = tmpfile();
+    take_search_steps(depth, input, results);
+    statsPhase(STATS_PRINT);
+    printStatistics(output, get_steps());
+    FILE *file = fopen(output, "a");
+    rewind(results);
+    char buf[8192];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), results))) {
+      fwrite(buf, 1, n, file);
+    }
+    fclose(results);
+    fclose(file);
+  }
+}
 
 int main(int argc, char **argv) {
   char *filename = argv[1];
   int64_t depth = atol(argv[2]);
   char *output = argv[3];
-  bool hasStatistics = argc != 4;
+  bool hasStatistics = false;
+  bool hasSummary = false;
+  const char *processes = nullptr;
+  unsigned process = 0;
+  for (int i = 4; i < argc; i++) {
+    if (!strcmp(argv[i], "--visited") && i + 1 < argc) {
+      if (!setSearchVisitedSet(argv[++i])) {
+        fprintf(stderr, "Invalid visited set: %s\n", argv[i]);
+        return 1;
+      }
+      hasSummary = true;
+    } else if (!strcmp(argv[i], "--strategy") && i + 1 < argc) {
+      if (!setSearchStrategy(argv[++i])) {
+        fprintf(stderr, "Invalid search strategy: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (!strcmp(argv[i], "--bound") && i + 1 < argc) {
+      setSearchBound(strtoull(argv[++i], nullptr, 10));
+    } else if (!strcmp(argv[i], "--reachable")) {
+      setSearchReachable(true);
+    } else if (!strcmp(argv[i], "--processes") && i + 1 < argc) {
+      processes = argv[++i];
+    } else if (!strcmp(argv[i], "--process") && i + 1 < argc) {
+      process = atoi(argv[++i]);
+    } else {
+      hasStatistics = true;
+    }
+  }
+
+  if (processes && !setSearchProcesses(processes, process)) {
+    fprintf(stderr, "Invalid search process: %u\n", process);
+    return 1;
+  }
 
   initStaticObjects();
 
+  statsPhase(STATS_PARSE);
   block *input = parseConfiguration(filename);
-  std::unordered_set<block *, HashBlock, KEq> results = take_search_steps(depth, input);
-  if (hasStatistics) {
-    printStatistics(output, get_steps());
+  statsPhase(STATS_REWRITE);
+  try {
+    search(depth, input, output, hasStatistics);
+  } catch (std::exception &e) {
+    // a hook failed while a state was being stepped.
+    fprintf(stderr, "%s\n", e.what());
+    return 113;
+  }
+  if (hasSummary) {
+    printSearchSummary(stderr);
   }
-  printConfigurations(output, results);
   return 0;
 }
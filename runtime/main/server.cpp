@@ -0,0 +1,101 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "runtime/collect.h"
+#include "runtime/header.h"
+#include "runtime/serve.h"
+
+// Rewrites a stream of configurations in a single process, so that starting
+// the interpreter and initializing its heap is paid for once rather than once
+// per input.
+//
+// Usage: interpreter <depth> [<socket>]
+//
+// Without a socket, requests are read from stdin and responses written to
+// stdout until the end of stdin. Anything the definition itself writes to
+// stdout goes to stderr instead. With a socket, the server listens on a Unix
+// domain socket at that path and serves one connection at a time, each until
+// the client closes it.
+//
+// A request is the length in bytes of a KORE pattern as a 64-bit integer,
+// followed by the pattern. The response is the exit code of the final
+// configuration as a 32-bit integer, followed by the length in bytes of the
+// final configuration as a 64-bit integer and the configuration itself.
+// Integers are in native byte order.
+//
+// If a request cannot be parsed, gets stuck in a function or fails in a hook,
+// the error is printed to stderr, the response is an exit code of -1 and an
+// empty configuration, as with the "fork-server" main, and the server carries
+// on. The heap is emptied by a full collection after each request.
+
+extern "C" {
+  void initStaticObjects(void);
+  block *take_steps(int64_t, block *);
+  void reset_steps(void);
+  int32_t get_exit_code(block *);
+  void koreCollectAll(void);
+  void set_stuck_in_function_handler(void (*)(block *));
+}
+
+static void stuckInFunction(block *subject) {
+  string *term = printConfigurationToString(subject);
+  throw std::runtime_error("Stuck in function: " + std::string(term->data, len(term)));
+}
+
+// serves requests until the end of the input or until the client goes away.
+static void serve(int64_t depth, int in, int out) {
+  std::vector<char> request;
+  uint64_t requestSize;
+  while (readAll(in, &requestSize, sizeof(requestSize))) {
+    request.resize(requestSize);
+    if (!readAll(in, request.data(), requestSize)) {
+      fprintf(stderr, "Truncated request\n");
+      return;
+    }
+    bool written;
+    try {
+      gc_state_guard saved;
+      block *input = tryParseConfigurationFromString(request.data(), requestSize);
+      reset_steps();
+      block *result = take_steps(depth, input);
+      int32_t exitCode = get_exit_code(result);
+      string *output = printConfigurationToString(result);
+      uint64_t outputSize = len(output);
+      written = writeResponse(out, exitCode, output->data, outputSize);
+    } catch (std::exception &e) {
+      fprintf(stderr, "%s\n", e.what());
+      written = writeResponse(out, -1, "", 0);
+    }
+    koreCollectAll();
+    if (!written) {
+      return;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <depth> [<socket>]\n", argv[0]);
+    return 1;
+  }
+  int64_t depth = atol(argv[1]);
+
+  initStaticObjects();
+  set_stuck_in_function_handler(stuckInFunction);
+
+  if (argc == 2) {
+    int out = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    serve(depth, STDIN_FILENO, out);
+    return 0;
+  }
+
+  return serveSocket(argv[2], [depth](int conn) { serve(depth, conn, conn); });
+}
@@ -8,6 +8,7 @@
 #include <stdexcept>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <unordered_map>
 
 #include "runtime/alloc.h"
@@ -33,8 +34,8 @@ extern "C" {
 
   thread_local static std::vector<ffi_type *> structTypes;
 
-  static std::unordered_map<block *, string *, HashBlock, KEq> allocatedKItemPtrs;
-  static std::map<string *, block *> allocatedBytesRefs;
+  thread_local static std::unordered_map<block *, string *, HashBlock, KEq> allocatedKItemPtrs;
+  thread_local static std::map<string *, block *> allocatedBytesRefs;
 
   TAG_TYPE(void)
   TAG_TYPE(uint8)
@@ -170,11 +171,11 @@ extern "C" {
     ffi_type ** argtypes, * rtype;
     void (* address)(void);
 
-    if (!mpz_fits_ulong_p(addr)) {
+    if (!mpz_fits_ulong_p(int_view(addr))) {
       throw std::invalid_argument("Addr is too large");
     }
 
-    address = (void (*) (void))  mpz_get_ui(addr);
+    address = (void (*) (void))  mpz_get_ui(int_view(addr));
 
     size_t nargs = hook_LIST_size_long(args);
     size_t nfixtypes = hook_LIST_size_long(fixtypes);
@@ -305,7 +306,7 @@ extern "C" {
   }
 
   static std::pair<std::vector<block **>::iterator, std::vector<block **>::iterator> firstBlockEnumerator() {
-    static std::vector<block **> blocks;
+    thread_local static std::vector<block **> blocks;
 
     blocks.clear();
 
@@ -317,7 +318,7 @@ extern "C" {
   }
 
   static std::pair<std::vector<block **>::iterator, std::vector<block **>::iterator> secondBlockEnumerator() {
-    static std::vector<block **> blocks;
+    thread_local static std::vector<block **> blocks;
 
     blocks.clear();
 
@@ -329,22 +330,20 @@ extern "C" {
   }
 
   string * hook_FFI_alloc(block * kitem, mpz_t size, mpz_t align) {
-    static int registered = -1;
-
-    if (registered == -1) {
+    static std::once_flag registered;
+    std::call_once(registered, []{
       registerGCRootsEnumerator(firstBlockEnumerator);
       registerGCRootsEnumerator(secondBlockEnumerator);
-      registered = 0;
-    }
+    });
 
-    if (!mpz_fits_ulong_p(size)) {
+    if (!mpz_fits_ulong_p(int_view(size))) {
       throw std::invalid_argument("Size is too large");
     }
-    if (!mpz_fits_ulong_p(align)) {
+    if (!mpz_fits_ulong_p(int_view(align))) {
       throw std::invalid_argument("Alignment is too large");
     }
 
-    size_t a = mpz_get_ui(align);
+    size_t a = mpz_get_ui(int_view(align));
 
     if (allocatedKItemPtrs.find(kitem) != allocatedKItemPtrs.end()) {
       string *result = allocatedKItemPtrs[kitem];
@@ -354,7 +353,7 @@ extern "C" {
       return allocatedKItemPtrs[kitem];
     }
 
-    size_t s = mpz_get_ui(size);
+    size_t s = mpz_get_ui(int_view(size));
 
     string * ret;
     int result = posix_memalign((void **)&ret, a < sizeof(void *) ? sizeof(void *) : a, sizeof(string *) + s);
@@ -418,7 +417,7 @@ extern "C" {
   }
 
   SortK hook_FFI_read(SortInt addr, SortBytes mem) {
-    unsigned long l = mpz_get_ui(addr);
+    unsigned long l = mpz_get_ui(int_view(addr));
     uintptr_t intptr = (uintptr_t)l;
     char *ptr = (char *)intptr;
     memcpy(mem->data, ptr, len(mem));
@@ -426,7 +425,7 @@ extern "C" {
   }
 
   SortK hook_FFI_write(SortInt addr, SortBytes mem) {
-    unsigned long l = mpz_get_ui(addr);
+    unsigned long l = mpz_get_ui(int_view(addr));
     uintptr_t intptr = (uintptr_t)l;
     char *ptr = (char *)intptr;
     for (size_t i = 0; i < len(mem); ++i) {
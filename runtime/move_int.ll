@@ -4,7 +4,36 @@ target triple = "x86_64-unknown-linux-gnu"
 %mpz = type { i32, i32, i64 * } ; mpz_t
 
 ; helper function for int hooks
+; integers between SMALL_INT_MIN and SMALL_INT_MAX are returned as small
+; integers; their limbs are left to the garbage collector.
 define %mpz* @move_int(%mpz* %val) {
+entry:
+  %sizeptr = getelementptr inbounds %mpz, %mpz* %val, i64 0, i32 1
+  %size = load i32, i32* %sizeptr
+  switch i32 %size, label %heap [ i32 0, label %small
+                                  i32 1, label %positive
+                                  i32 -1, label %negative ]
+positive:
+  %poslimbsptr = getelementptr inbounds %mpz, %mpz* %val, i64 0, i32 2
+  %poslimbs = load i64*, i64** %poslimbsptr
+  %poslimb = load i64, i64* %poslimbs
+  %posfits = icmp ule i64 %poslimb, @SMALL_INT_MAX@
+  br i1 %posfits, label %small, label %heap
+negative:
+  %neglimbsptr = getelementptr inbounds %mpz, %mpz* %val, i64 0, i32 2
+  %neglimbs = load i64*, i64** %neglimbsptr
+  %neglimb = load i64, i64* %neglimbs
+  %negmagnitude = sub i64 %neglimb, 1
+  %negfits = icmp ule i64 %negmagnitude, @SMALL_INT_MAX@
+  %negvalue = sub i64 0, %neglimb
+  br i1 %negfits, label %small, label %heap
+small:
+  %value = phi i64 [ 0, %entry ], [ %poslimb, %positive ], [ %negvalue, %negative ]
+  %shifted = shl i64 %value, 1
+  %tagged = or i64 %shifted, 1
+  %smallptr = inttoptr i64 %tagged to %mpz*
+  ret %mpz* %smallptr
+heap:
   %loaded = load %mpz, %mpz* %val
   %malloccall = tail call i8* @koreAllocInteger(i64 0)
   %ptr = bitcast i8* %malloccall to %mpz*
@@ -13,4 +42,3 @@ define %mpz* @move_int(%mpz* %val) {
 }
 
 declare noalias i8* @koreAllocInteger(i64)
-
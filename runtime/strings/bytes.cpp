@@ -68,8 +68,11 @@ extern "C" {
     return move_int(result);
   }
 
-  unsigned long get_ui(mpz_t i) {
-    if (!mpz_fits_ulong_p(i)) {
+  unsigned long get_ui(SortInt i) {
+    if (is_small_int(i) && small_int_value(i) >= 0) {
+      return small_int_value(i);
+    }
+    if (is_small_int(i) || !mpz_fits_ulong_p(i)) {
       throw std::invalid_argument("Integer overflow");
     }
     return mpz_get_ui(i);
@@ -80,18 +83,19 @@ extern "C" {
   // syntax Bytes ::= Int2Bytes(Int, Int, Endianness)
   SortBytes hook_BYTES_int2bytes(SortInt len, SortInt i, SortEndianness endianness_ptr) {
     uint64_t endianness = (uint64_t)endianness_ptr;
-    unsigned long len_long = mpz_get_ui(len);
+    unsigned long len_long = mpz_get_ui(int_view(len));
     if (len_long == 0) {
       return hook_BYTES_empty();
     }
-    bool neg = mpz_sgn(i) < 0;
+    int_view vi(i);
+    bool neg = mpz_sgn(vi) < 0;
     string *result = static_cast<string *>(koreAllocToken(sizeof(string) + len_long));
     set_len(result, len_long);
     memset(result->data, neg ? 0xff : 0x00, len_long);
     int order = endianness == tag_big_endian() ? 1 : -1;
     mpz_t twos;
     mpz_init(twos);
-    extract(twos, i, 0, len_long*8);
+    extract(twos, vi, 0, len_long*8);
     size_t sizeInBytes = (mpz_sizeinbase(twos, 2) + 7) / 8;
     void *start = result->data + (endianness == tag_big_endian() ? len_long - sizeInBytes : 0);
     mpz_export(start, nullptr, order, 1, 0, 0, twos);
@@ -72,8 +72,11 @@ extern "C" {
     return hook_BYTES_length(a);
   }
 
-  static inline uint64_t gs(mpz_t i) {
-    if (!mpz_fits_ulong_p(i)) {
+  static inline uint64_t gs(SortInt i) {
+    if (is_small_int(i) && small_int_value(i) >= 0) {
+      return small_int_value(i);
+    }
+    if (is_small_int(i) || !mpz_fits_ulong_p(i)) {
       throw std::invalid_argument("Arg too large for int64_t");
     }
     return mpz_get_ui(i);
@@ -186,7 +189,8 @@ extern "C" {
     return buf->data;
   }
 
-  SortString hook_STRING_base2string_long(SortInt input, uint64_t base) {
+  SortString hook_STRING_base2string_long(SortInt i, uint64_t base) {
+    int_view input(i);
     size_t len = mpz_sizeinbase(input, base) + 2;
     // +1 for null terminator needed by mpz_get_str, +1 for minus sign
     auto result = static_cast<string *>(koreAllocToken(sizeof(string) + len));
@@ -302,15 +306,11 @@ extern "C" {
   SortString hook_STRING_replaceAll(SortString haystack, SortString needle, SortString replacer) {
     // It's guaranteed that there can be no more replacements than the length of the haystack, so this
     // gives us the functionality of replaceAll.
-    mpz_t arg;
-    mpz_init_set_si(arg, len(haystack));
-    return hook_STRING_replace(haystack, needle, replacer, arg);
+    return hook_STRING_replace(haystack, needle, replacer, make_small_int(len(haystack)));
   }
 
   SortString hook_STRING_replaceFirst(SortString haystack, SortString needle, SortString replacer) {
-    mpz_t arg;
-    mpz_init_set_si(arg, 1);
-    return hook_STRING_replace(haystack, needle, replacer, arg);
+    return hook_STRING_replace(haystack, needle, replacer, make_small_int(1));
   }
 
   SortInt hook_STRING_countAllOccurrences(SortString haystack, SortString needle) {
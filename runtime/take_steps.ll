@@ -9,10 +9,17 @@ declare fastcc %block** @stepAll(%block*, i64*)
 
 @depth = thread_local global i64 zeroinitializer
 @steps = thread_local global i64 zeroinitializer
+; the number of rewrite steps taken by the last call to take_steps
+@steps_taken = thread_local global i64 zeroinitializer
 @current_interval = thread_local global i64 0
 @GC_THRESHOLD = thread_local global i64 @GC_THRESHOLD@
 
-@gc_roots = global [256 x i8 *] zeroinitializer
+@gc_roots = thread_local global [256 x i8 *] zeroinitializer
+@gc_safepoint_inhibit = external thread_local global i64
+@current_configuration = external thread_local global %block*
+@status_requested = external global i32
+
+declare void @statusReport()
 
 define void @set_gc_threshold(i64 %threshold) {
   store i64 %threshold, i64* @GC_THRESHOLD
@@ -26,6 +33,13 @@ define i64 @get_gc_threshold() {
 
 define i1 @finished_rewriting() {
 entry:
+  %requested = load atomic i32, i32* @status_requested monotonic, align 4
+  %isRequested = icmp ne i32 %requested, 0
+  br i1 %isRequested, label %report, label %count
+report:
+  call void @statusReport()
+  br label %count
+count:
   %depth = load i64, i64* @depth
   %hasDepth = icmp sge i64 %depth, 0
   %steps = load i64, i64* @steps
@@ -43,13 +57,29 @@ else:
 
 define %block* @take_steps(i64 %depth, %block* %subject) {
   store i64 %depth, i64* @depth
+  ; enables the safepoints in K functions while rewriting
+  %inhibit = load i64, i64* @gc_safepoint_inhibit
+  %enabled = sub i64 %inhibit, 1
+  store i64 %enabled, i64* @gc_safepoint_inhibit
+  %before = load i64, i64* @steps
   %result = call fastcc %block* @step(%block* %subject)
+  store i64 %inhibit, i64* @gc_safepoint_inhibit
+  ; finished_rewriting increments @steps once per check, and the last check,
+  ; which stops rewriting, does not take a step.
+  %after = load i64, i64* @steps
+  %checks = sub i64 %after, %before
+  %taken = sub i64 %checks, 1
+  store i64 %taken, i64* @steps_taken
+  ; the configuration stored by the step function must not be kept alive by
+  ; the collector, or reported, once rewriting has stopped.
+  store %block* null, %block** @current_configuration
   ret %block* %result
 }
 
 define %block** @take_search_step(%block* %subject, i64* %count) {
   store i64 -1, i64* @depth
   %result = call fastcc %block** @stepAll(%block* %subject, i64* %count)
+  store %block* null, %block** @current_configuration
   ret %block** %result
 }
 
@@ -58,3 +88,23 @@ entry:
   %steps = load i64, i64* @steps
   ret i64 %steps
 }
+
+define i64 @get_steps_taken() {
+entry:
+  %taken = load i64, i64* @steps_taken
+  ret i64 %taken
+}
+
+define void @reset_steps() {
+entry:
+  store i64 0, i64* @steps
+  ret void
+}
+
+define void @add_steps(i64 %count) {
+entry:
+  %steps = load i64, i64* @steps
+  %newSteps = add i64 %steps, %count
+  store i64 %newSteps, i64* @steps
+  ret void
+}
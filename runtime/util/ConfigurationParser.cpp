@@ -3,8 +3,12 @@
 #include "runtime/alloc.h"
 
 #include <gmp.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
 #include <variant>
 #include <map>
+#include <unordered_map>
 
 #include "runtime/header.h"
 
@@ -41,14 +45,37 @@ struct construction {
   size_t nchildren;
 };
 
-static void *constructInitialConfiguration(const KOREPattern *initial) {
+// terms already on the heap that stand for parts of a pattern: subterms of
+// the pattern itself, and the values of its variables.
+struct prebuilt_terms {
+  std::unordered_map<const KOREPattern *, void *> subterms;
+  std::unordered_map<std::string, void *> variables;
+};
+
+static void *constructInitialConfiguration(const KOREPattern *initial, const prebuilt_terms *prebuilt = nullptr) {
   std::vector<std::variant<const KOREPattern *, construction>> workList{initial};
   std::vector<void *> output;
   while (!workList.empty()) {
     std::variant<const KOREPattern *, construction> current = workList.back();
     workList.pop_back();
     if (current.index() == 0) {
-      const auto constructor = dynamic_cast<const KORECompositePattern *>(*std::get_if<const KOREPattern *>(&current));
+      const KOREPattern *pattern = *std::get_if<const KOREPattern *>(&current);
+      if (prebuilt) {
+        auto subterm = prebuilt->subterms.find(pattern);
+        if (subterm != prebuilt->subterms.end()) {
+          output.push_back(subterm->second);
+          continue;
+        }
+        if (const auto var = dynamic_cast<const KOREVariablePattern *>(pattern)) {
+          auto value = prebuilt->variables.find(var->getName());
+          if (value == prebuilt->variables.end()) {
+            throw ParseError("Unbound variable in configuration: " + var->getName());
+          }
+          output.push_back(value->second);
+          continue;
+        }
+      }
+      const auto constructor = dynamic_cast<const KORECompositePattern *>(pattern);
       assert(constructor);
 
       const KORESymbol *symbol = constructor->getConstructor();
@@ -121,9 +148,17 @@ static void *constructInitialConfiguration(const KOREPattern *initial) {
   return output[0];
 }
 
-block *parseConfiguration(const char *filename) {
+// terminates the process after a parse error, as the interpreter has no
+// input to rewrite. Only the entry points used by the main functions do this;
+// code that can run inside the C API, such as hooks, must let the ParseError
+// propagate to it instead.
+[[ noreturn ]] static void parseFailed(const ParseError &e) {
+  std::cerr << e.what() << "\n";
+  exit(-1);
+}
+
+static block *parseConfigurationInternal(KOREParser &parser) {
   // Parse initial configuration as a KOREPattern
-  KOREParser parser(filename);
   ptr<KOREPattern> InitialConfiguration = parser.pattern();
 
   //InitialConfiguration->print(std::cout);
@@ -133,3 +168,110 @@ block *parseConfiguration(const char *filename) {
   deallocateSPtrKorePattern(std::move(InitialConfiguration));
   return b;
 }
+
+block *parseConfiguration(const char *filename) {
+  try {
+    KOREParser parser(filename);
+    return parseConfigurationInternal(parser);
+  } catch (ParseError &e) {
+    parseFailed(e);
+  }
+}
+
+static ptr<KOREPattern> parsePatternFromString(const char *data, size_t size) {
+  FILE *in = fmemopen((void *)data, size, "r");
+  if (!in) {
+    throw ParseError(std::string("Cannot read input: ") + strerror(errno));
+  }
+  KOREParser parser(in, "<input>");
+  return parser.pattern();
+}
+
+block *tryParseConfigurationFromString(const char *data, size_t size) {
+  ptr<KOREPattern> InitialConfiguration = parsePatternFromString(data, size);
+  auto b = (block *) constructInitialConfiguration(InitialConfiguration.get());
+  deallocateSPtrKorePattern(std::move(InitialConfiguration));
+  return b;
+}
+
+block *parseConfigurationFromString(const char *data, size_t size) {
+  try {
+    return tryParseConfigurationFromString(data, size);
+  } catch (ParseError &e) {
+    parseFailed(e);
+  }
+}
+
+struct configuration_template {
+  sptr<KOREPattern> pattern;
+  prebuilt_terms prebuilt;
+};
+
+// constructs the largest subterms of pattern that contain no variables.
+static void constructGroundSubterms(const KOREPattern *pattern, prebuilt_terms &prebuilt) {
+  std::vector<std::pair<const KOREPattern *, bool>> workList{{pattern, false}};
+  // whether each pattern visited so far contains no variables, with the
+  // first child of a pattern on top of its other children.
+  std::vector<bool> ground;
+  while (!workList.empty()) {
+    auto [current, visited] = workList.back();
+    workList.pop_back();
+    const auto constructor = dynamic_cast<const KORECompositePattern *>(current);
+    if (!visited) {
+      if (!constructor) {
+        ground.push_back(false);
+      } else if (constructor->getConstructor()->getName() == "\\dv") {
+        ground.push_back(true);
+      } else {
+        workList.push_back({current, true});
+        for (const auto &child : constructor->getArguments()) {
+          workList.push_back({child.get(), false});
+        }
+      }
+      continue;
+    }
+    const auto &children = constructor->getArguments();
+    size_t first = ground.size() - 1;
+    bool isGround = true;
+    for (size_t i = 0; i < children.size(); i++) {
+      isGround = isGround && ground[first - i];
+    }
+    if (!isGround) {
+      for (size_t i = 0; i < children.size(); i++) {
+        if (ground[first - i]) {
+          prebuilt.subterms[children[i].get()] = constructInitialConfiguration(children[i].get());
+        }
+      }
+    }
+    ground.resize(ground.size() - children.size());
+    ground.push_back(isGround);
+  }
+  if (ground.back()) {
+    prebuilt.subterms[pattern] = constructInitialConfiguration(pattern);
+  }
+}
+
+configuration_template *parseConfigurationTemplate(const char *filename) {
+  auto result = new configuration_template;
+  try {
+    KOREParser parser(filename);
+    result->pattern = parser.pattern();
+  } catch (ParseError &e) {
+    parseFailed(e);
+  }
+  constructGroundSubterms(result->pattern.get(), result->prebuilt);
+  return result;
+}
+
+block *instantiateConfigurationTemplate(configuration_template *base, std::unordered_map<std::string, std::string> const &bindings) {
+  prebuilt_terms &prebuilt = base->prebuilt;
+  prebuilt.variables.clear();
+  try {
+    for (const auto &binding : bindings) {
+      prebuilt.variables[binding.first] = tryParseConfigurationFromString(binding.second.data(), binding.second.size());
+    }
+    return (block *) constructInitialConfiguration(base->pattern.get(), &prebuilt);
+  } catch (ParseError &e) {
+    parseFailed(e);
+  }
+}
@@ -5,15 +5,14 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
 #include <set>
 #include <functional>
 
 #include "runtime/header.h"
 #include "runtime/alloc.h"
 
-void printInt(writer *file, mpz_t i, const char *sort) {
-  char *str = mpz_get_str(NULL, 10, i);
+void printInt(writer *file, SortInt i, const char *sort) {
+  char *str = mpz_get_str(NULL, 10, int_view(i));
   sfprintf(file, "\\dv{%s}(\"%s\")", sort, str);
 }
 
@@ -37,7 +36,7 @@ void printMInt(writer *file, size_t *i, size_t bits, const char *sort) {
     sfprintf(file, "\\dv{%s}(\"0p%zd\")", sort, bits);
   } else {
     mpz_ptr z = hook_MINT_import(i, bits, false);
-    char *str = mpz_get_str(NULL, 10, z);
+    char *str = mpz_get_str(NULL, 10, int_view(z));
     sfprintf(file, "\\dv{%s}(\"%sp%zd\")", sort, str, bits);
   }
 }
@@ -193,34 +192,6 @@ void printConfiguration(const char *filename, block *subject) {
   fclose(file);
 }
 
-void printConfigurations(const char *filename, std::unordered_set<block *, HashBlock, KEq> results) {
-  FILE *file = fopen(filename, "a");
-  boundVariables.clear();
-  varCounter = 0;
-  writer w = {file,nullptr};
-  ssize_t size = results.size();
-  if (size == 0) {
-    sfprintf(&w, "\\bottom{SortGeneratedTopCell{}}()");
-  } else {
-    for (size_t i = 0; i < size - 1; i++) {
-      sfprintf(&w, "\\or{SortGeneratedTopCell{}}(");
-    }
-    size_t j = 0;
-    for (const auto& subject : results) {
-      printConfigurationInternal(&w, subject, nullptr, false);
-      if (++j != results.size()) {
-        sfprintf(&w, ",");
-      }
-    }
-    for (size_t i = 0; i < size - 1; i++) {
-      sfprintf(&w, ")");
-    }
-  }
-  varNames.clear();
-  usedVarNames.clear();
-  fclose(file);
-}
-
 string *printConfigurationToString(block *subject) {
   boundVariables.clear();
   varCounter = 0;
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "runtime/header.h"
+
+extern "C" {
+  floating *move_float(floating *);
+}
+
+// The binary encoding of a term written by serializeConfiguration. Each value
+// starts with its kind, except where the layout of the enclosing block already
+// determines it:
+//
+// * a term is IMMEDIATE followed by the 64-bit value of a constant or bound
+//   variable, TOKEN followed by the 64-bit length of a string token with its
+//   VARIABLE_BIT and its bytes, or BLOCK followed by the 64-bit header of a
+//   block without its garbage collection bits and each of its children;
+// * an integer is its 32-bit signed number of limbs followed by its limbs;
+// * a float is the 64-bit length of its string representation followed by it;
+// * a string buffer is the 64-bit length of its contents followed by them;
+// * a bool is a byte and a machine integer is its bytes, least significant
+//   first, with the bits above its width cleared;
+// * a list is its 64-bit size followed by its elements, and a map or set is
+//   its 64-bit size followed by its elements (with their values), sorted by
+//   their encoding.
+//
+// Integers are encoded by value and collections in sorted order, so equal
+// terms have equal encodings. Variables are encoded by name, so distinct
+// variables of the same name within a term become the same variable.
+
+enum : char { IMMEDIATE, TOKEN, BLOCK };
+
+static const uint16_t MINT_LAYOUT = 10;
+
+template <typename T>
+static void write(std::string &out, T value) {
+  out.append((const char *)&value, sizeof(T));
+}
+
+static void serializeTerm(block *subject, std::string &out);
+
+static void serializeInt(mpz_ptr i, std::string &out) {
+  int_view value(i);
+  int32_t size = value->_mp_size;
+  write(out, size);
+  out.append((const char *)value->_mp_d, std::abs(size) * sizeof(mp_limb_t));
+}
+
+// writes the elements of a map or set sorted by their encoding.
+template <typename Collection, typename F>
+static void serializeUnordered(Collection *collection, std::string &out, F serializeElement) {
+  std::vector<std::string> elements;
+  elements.reserve(collection->size());
+  for (const auto &element : *collection) {
+    elements.emplace_back();
+    serializeElement(element, elements.back());
+  }
+  std::sort(elements.begin(), elements.end());
+  write<uint64_t>(out, elements.size());
+  for (const auto &element : elements) {
+    out += element;
+  }
+}
+
+static void serializeChild(block *subject, layoutitem *item, std::string &out) {
+  void *arg = ((char *)subject) + item->offset;
+  switch (item->cat) {
+  case MAP_LAYOUT:
+    serializeUnordered((map *)arg, out, [](const std::pair<KElem, KElem> &element, std::string &out) {
+      serializeTerm(element.first, out);
+      serializeTerm(element.second, out);
+    });
+    break;
+  case SET_LAYOUT:
+    serializeUnordered((set *)arg, out, [](const KElem &element, std::string &out) {
+      serializeTerm(element, out);
+    });
+    break;
+  case LIST_LAYOUT: {
+    list *l = (list *)arg;
+    write<uint64_t>(out, l->size());
+    for (const auto &element : *l) {
+      serializeTerm(element, out);
+    }
+    break;
+  }
+  case INT_LAYOUT:
+    serializeInt(*(mpz_ptr *)arg, out);
+    break;
+  case FLOAT_LAYOUT: {
+    std::string str = floatToString(*(floating **)arg);
+    write<uint64_t>(out, str.size());
+    out += str;
+    break;
+  }
+  case STRINGBUFFER_LAYOUT: {
+    stringbuffer *buffer = *(stringbuffer **)arg;
+    write<uint64_t>(out, buffer->strlen);
+    out.append(buffer->contents->data, buffer->strlen);
+    break;
+  }
+  case BOOL_LAYOUT:
+    write(out, *(bool *)arg);
+    break;
+  case SYMBOL_LAYOUT:
+  case VARIABLE_LAYOUT:
+    serializeTerm(*(block **)arg, out);
+    break;
+  default: {
+    size_t bits = item->cat - MINT_LAYOUT;
+    out.append((const char *)arg, (bits + 7) / 8);
+    if (bits % 8) {
+      out[out.size() - 1] &= (1 << (bits % 8)) - 1;
+    }
+    break;
+  }
+  }
+}
+
+static void serializeTerm(block *subject, std::string &out) {
+  if (is_leaf_block(subject)) {
+    out += IMMEDIATE;
+    write(out, (uint64_t)subject);
+    return;
+  }
+  uint16_t layoutInt = layout(subject);
+  if (!layoutInt) {
+    out += TOKEN;
+    write<uint64_t>(out, subject->h.hdr & (LENGTH_MASK | VARIABLE_BIT));
+    out.append(((string *)subject)->data, len(subject));
+    return;
+  }
+  out += BLOCK;
+  write<uint64_t>(out, subject->h.hdr & HDR_MASK);
+  layout *data = getLayoutData(layoutInt);
+  for (unsigned i = 0; i < data->nargs; i++) {
+    serializeChild(subject, data->args + i, out);
+  }
+}
+
+void serializeConfiguration(block *subject, std::string &out) {
+  serializeTerm(subject, out);
+}
+
+namespace {
+
+class deserializer {
+public:
+  deserializer(const char *data) : ptr(data) {}
+
+  block *term();
+
+private:
+  const char *ptr;
+  // the variables decoded so far, by name.
+  std::unordered_map<std::string, string *> variables;
+
+  template <typename T>
+  T read() {
+    T value;
+    memcpy(&value, ptr, sizeof(T));
+    ptr += sizeof(T);
+    return value;
+  }
+
+  const char *bytes(size_t size) {
+    const char *result = ptr;
+    ptr += size;
+    return result;
+  }
+
+  void child(block *subject, layoutitem *item);
+};
+
+}
+
+block *deserializer::term() {
+  char kind = read<char>();
+  switch (kind) {
+  case IMMEDIATE:
+    return (block *)read<uint64_t>();
+  case TOKEN: {
+    uint64_t hdr = read<uint64_t>();
+    size_t size = len_hdr(hdr);
+    const char *contents = bytes(size);
+    bool isVar = hdr & VARIABLE_BIT;
+    if (isVar) {
+      auto existing = variables.find(std::string(contents, size));
+      if (existing != variables.end()) {
+        return (block *)existing->second;
+      }
+    }
+    string *token = (string *)koreAllocToken(sizeof(string) + size);
+    memcpy(token->data, contents, size);
+    set_len(token, size);
+    if (isVar) {
+      token->h.hdr |= VARIABLE_BIT;
+      variables[std::string(contents, size)] = token;
+    }
+    return (block *)token;
+  }
+  default: {
+    uint64_t hdr = read<uint64_t>();
+    block *result = (block *)koreAlloc(size_hdr(hdr));
+    result->h.hdr = hdr;
+    layout *data = getLayoutData(layout_hdr(hdr));
+    for (unsigned i = 0; i < data->nargs; i++) {
+      child(result, data->args + i);
+    }
+    return result;
+  }
+  }
+}
+
+void deserializer::child(block *subject, layoutitem *item) {
+  void *arg = ((char *)subject) + item->offset;
+  switch (item->cat) {
+  case MAP_LAYOUT: {
+    map result;
+    uint64_t size = read<uint64_t>();
+    for (uint64_t i = 0; i < size; i++) {
+      block *key = term();
+      block *value = term();
+      result = result.insert({key, value});
+    }
+    new (arg) map(std::move(result));
+    break;
+  }
+  case SET_LAYOUT: {
+    set result;
+    uint64_t size = read<uint64_t>();
+    for (uint64_t i = 0; i < size; i++) {
+      result = result.insert(term());
+    }
+    new (arg) set(std::move(result));
+    break;
+  }
+  case LIST_LAYOUT: {
+    list result;
+    uint64_t size = read<uint64_t>();
+    for (uint64_t i = 0; i < size; i++) {
+      result = result.push_back(term());
+    }
+    new (arg) list(std::move(result));
+    break;
+  }
+  case INT_LAYOUT: {
+    int32_t size = read<int32_t>();
+    size_t limbs = std::abs(size);
+    mpz_t value;
+    mpz_init(value);
+    mpz_import(value, limbs, -1, sizeof(mp_limb_t), 0, 0, bytes(limbs * sizeof(mp_limb_t)));
+    if (size < 0) {
+      mpz_neg(value, value);
+    }
+    *(mpz_ptr *)arg = move_int(value);
+    break;
+  }
+  case FLOAT_LAYOUT: {
+    uint64_t size = read<uint64_t>();
+    floating result[1];
+    init_float2(result, std::string(bytes(size), size));
+    *(floating **)arg = move_float(result);
+    break;
+  }
+  case STRINGBUFFER_LAYOUT: {
+    uint64_t size = read<uint64_t>();
+    stringbuffer *buffer = hook_BUFFER_empty();
+    *(stringbuffer **)arg = hook_BUFFER_concat_raw(buffer, bytes(size), size);
+    break;
+  }
+  case BOOL_LAYOUT:
+    *(bool *)arg = read<bool>();
+    break;
+  case SYMBOL_LAYOUT:
+  case VARIABLE_LAYOUT:
+    *(block **)arg = term();
+    break;
+  default: {
+    size_t bits = item->cat - MINT_LAYOUT;
+    memcpy(arg, bytes((bits + 7) / 8), (bits + 7) / 8);
+    break;
+  }
+  }
+}
+
+block *deserializeConfiguration(const char *data, size_t size) {
+  return deserializer(data).term();
+}
@@ -0,0 +1,146 @@
+#include "kllvm/parser/KOREScanner.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <string>
+
+#include "runtime/collect.h"
+#include "runtime/header.h"
+#include "runtime/kllvm-c.h"
+
+using namespace kllvm::parser;
+
+extern "C" {
+  void initStaticObjects(void);
+  block *take_steps(int64_t, block *);
+  int32_t get_exit_code(block *);
+  uint64_t get_steps_taken(void);
+  void set_stuck_in_function_handler(void (*)(block *));
+}
+
+static thread_local block *current;
+static thread_local bool stuck;
+static thread_local std::string lastError;
+
+namespace {
+
+// thrown through the generated code when a function is stuck.
+struct stuck_in_function {
+  std::string term;
+};
+
+}
+
+static void stuckInFunction(block *subject) {
+  string *term = printConfigurationToString(subject);
+  throw stuck_in_function{std::string(term->data, len(term))};
+}
+
+// runs body, turning each way in which the interpreter can fail into a
+// status. The state of the collector that unwinding out of the generated code
+// leaves behind is restored by a gc_state_guard.
+template <typename F>
+static kllvm_status guard(F body) {
+  kllvm_status status;
+  {
+    gc_state_guard saved;
+    try {
+      body();
+      return KLLVM_OK;
+    } catch (ParseError &e) {
+      status = KLLVM_ERROR_PARSE;
+      lastError = e.what();
+    } catch (stuck_in_function &e) {
+      status = KLLVM_ERROR_STUCK_FUNCTION;
+      lastError = "Stuck in function: " + e.term;
+    } catch (std::exception &e) {
+      status = KLLVM_ERROR_HOOK;
+      lastError = e.what();
+    } catch (...) {
+      status = KLLVM_ERROR_HOOK;
+      lastError = "Unknown error";
+    }
+  }
+  current = nullptr;
+  stuck = false;
+  return status;
+}
+
+static kllvm_status noConfiguration(void) {
+  lastError = "No configuration loaded";
+  return KLLVM_ERROR_NO_CONFIGURATION;
+}
+
+int kllvm_version(void) {
+  return KLLVM_C_API_VERSION;
+}
+
+kllvm_status kllvm_init(void) {
+  initStaticObjects();
+  set_stuck_in_function_handler(stuckInFunction);
+  return KLLVM_OK;
+}
+
+kllvm_status kllvm_load(const char *data, size_t size) {
+  current = nullptr;
+  stuck = false;
+  return guard([&] {
+    current = tryParseConfigurationFromString(data, size);
+  });
+}
+
+kllvm_status kllvm_step(int64_t depth, int64_t *steps) {
+  if (!current) {
+    return noConfiguration();
+  }
+  return guard([&] {
+    current = take_steps(depth, current);
+    int64_t taken = get_steps_taken();
+    stuck = depth < 0 || taken < depth;
+    if (steps) {
+      *steps = taken;
+    }
+  });
+}
+
+bool kllvm_is_stuck(void) {
+  return stuck;
+}
+
+kllvm_status kllvm_get_kore(char **data, size_t *size) {
+  if (!current) {
+    return noConfiguration();
+  }
+  return guard([&] {
+    string *output = printConfigurationToString(current);
+    size_t outputSize = len(output);
+    char *buf = (char *)malloc(outputSize ? outputSize : 1);
+    if (!buf) {
+      throw std::bad_alloc();
+    }
+    memcpy(buf, output->data, outputSize);
+    *data = buf;
+    *size = outputSize;
+  });
+}
+
+kllvm_status kllvm_get_exit_code(int32_t *exitCode) {
+  if (!current) {
+    return noConfiguration();
+  }
+  return guard([&] {
+    *exitCode = get_exit_code(current);
+  });
+}
+
+void kllvm_reset(void) {
+  current = nullptr;
+  stuck = false;
+  koreCollectAll();
+}
+
+const char *kllvm_last_error(void) {
+  return lastError.c_str();
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// The profile of the rules applied, kept by interpreters compiled with
+// llvm-kompile --profile-rules (see kllvm/codegen/RuleProfile.h). The
+// counters are updated without synchronization, so they are approximate if
+// several threads rewrite at once.
+
+struct rule_profile_entry {
+  uint64_t count;
+  uint64_t cycles;
+  uint64_t conditionCycles;
+};
+
+static rule_profile_entry *profile;
+static const char **profileLabels, **profileLocations;
+static uint64_t profileRules;
+
+// Writes the profile to the file named by KLLVM_RULE_PROFILE, or to
+// rule-profile.<pid>.txt, as a line per rule applied, sorted by cycles and
+// then by number of applications:
+//
+//   <ordinal> <count> <cycles> <side condition cycles> <location> <label>
+//
+// separated by tabs, with - for an unknown location or label. The cycles of a
+// rule include those of the functions it evaluates, but not those of the
+// steps after it. The ordinal can be passed to llvm-kompile-compute-loc.
+static void writeRuleProfile(void) {
+  const char *env = getenv("KLLVM_RULE_PROFILE");
+  std::string filename = env ? env : "rule-profile." + std::to_string(getpid()) + ".txt";
+  FILE *file = fopen(filename.c_str(), "w");
+  if (!file) {
+    perror(filename.c_str());
+    return;
+  }
+  std::vector<uint64_t> rules;
+  for (uint64_t i = 0; i < profileRules; i++) {
+    if (profile[i].count) {
+      rules.push_back(i);
+    }
+  }
+  std::sort(rules.begin(), rules.end(), [](uint64_t a, uint64_t b) {
+    uint64_t ca = profile[a].cycles + profile[a].conditionCycles;
+    uint64_t cb = profile[b].cycles + profile[b].conditionCycles;
+    if (ca != cb) {
+      return ca > cb;
+    }
+    return profile[a].count > profile[b].count;
+  });
+  fprintf(file, "# ordinal\tcount\tcycles\tside condition cycles\tlocation\tlabel\n");
+  for (uint64_t i : rules) {
+    fprintf(file, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\t%s\n", i, profile[i].count,
+        profile[i].cycles, profile[i].conditionCycles, *profileLocations[i] ? profileLocations[i] : "-",
+        *profileLabels[i] ? profileLabels[i] : "-");
+  }
+  fclose(file);
+}
+
+extern "C" {
+
+// called by a constructor of the definition with its table of counters,
+// indexed by axiom ordinal, and the label and source location of each axiom.
+void registerRuleProfile(rule_profile_entry *entries, const char **labels, const char **locations, uint64_t rules) {
+  profile = entries;
+  profileLabels = labels;
+  profileLocations = locations;
+  profileRules = rules;
+  atexit(writeRuleProfile);
+}
+
+}
@@ -1,10 +1,30 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cinttypes>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <list>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
+#include <sys/resource.h>
+
+#include "runtime/arena.h"
 #include "runtime/header.h"
 #include "runtime/collect.h"
+#include "runtime/search_network.h"
+#include "runtime/size.h"
+#include "runtime/spill_queue.h"
 
 extern "C" {
 
@@ -21,58 +41,993 @@ void addSearchResult(block *result, block ***bufPtr, uint64_t *count, uint64_t *
 }
 
 block** take_search_step(block *, uint64_t *);
+bool search_pattern(block *);
+void initStaticObjects(void);
+uint64_t get_steps(void);
+void add_steps(uint64_t);
+
+}
+
+// The states of the search are kept outside of the heap, encoded by
+// serializeConfiguration. This lets threads with separate heaps exchange
+// them, keeps the cost of a collection independent of the number of states
+// seen, and lets states be compared by their encoding.
+
+namespace {
+
+struct fingerprint {
+  uint64_t lo, hi;
+
+  bool operator==(const fingerprint &other) const {
+    return lo == other.lo && hi == other.hi;
+  }
+};
+
+}
+
+static inline uint64_t rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix64(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
 
+// a 64-bit hash of data, independent for different seeds.
+static uint64_t hashBytes(const std::string &data, uint64_t seed) {
+  const uint64_t k1 = 0x87c37b91114253d5ULL, k2 = 0x4cf5ad432745937fULL;
+  uint64_t h = seed ^ (data.size() * k1);
+  size_t i = 0;
+  for (; i + 8 <= data.size(); i += 8) {
+    uint64_t w;
+    memcpy(&w, data.data() + i, 8);
+    h ^= rotl(w * k1, 31) * k2;
+    h = rotl(h, 27) * 5 + 0x52dce729;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data.data() + i, data.size() - i);
+  h ^= rotl(tail * k1, 31) * k2;
+  return mix64(h);
 }
 
-static std::list<block *> states;
-static block *state;
+namespace {
 
-static std::pair<std::vector<block **>::iterator, std::vector<block **>::iterator> blockEnumerator() {
-  static std::vector<block **> blocks;
+struct encoded_state {
+  std::string state;
+  // lo selects the shard of the visited set; hi is independent of it.
+  fingerprint fp;
 
-  blocks.clear();
+  encoded_state(std::string state) : state(std::move(state)),
+    fp{hashBytes(this->state, 0x9e3779b97f4a7c15ULL), hashBytes(this->state, 0xc2b2ae3d27d4eb4fULL)} {}
 
-  for (auto &keyVal : states) {
-    blocks.push_back(const_cast<block**>(&(keyVal)));
+  bool operator==(const encoded_state &other) const {
+    return fp == other.fp && state == other.state;
   }
-  blocks.push_back(&state);
+};
+
+struct HashEncodedState {
+  size_t operator()(const encoded_state &s) const { return s.fp.lo; }
+};
+
+// How the visited set remembers states:
+//
+// * exact stores their encodings;
+// * fingerprint64 and fingerprint128 store only a 64 or 128-bit hash of their
+//   encodings, so a state whose hash collides with that of a state already
+//   seen is wrongly taken to have been visited;
+// * bitstate sets BITSTATE_HASHES bits per state in a bit array of a fixed
+//   size (Holzmann's supertrace), so a state is wrongly taken to have been
+//   visited when all of its bits were already set by other states.
+//
+// The last three bound the memory used per state, or in total, at the cost
+// of possibly omitting part of the state space. The probability of this
+// happening is estimated as the search proceeds.
+enum class visited_mode { Exact, Fingerprint64, Fingerprint128, Bitstate };
 
-  return std::make_pair(blocks.begin(), blocks.end());
 }
 
-std::unordered_set<block *, HashBlock, KEq> take_search_steps(int64_t depth, block *subject) {
-  static int registered = -1;
-  if (registered == -1) {
-    registerGCRootsEnumerator(blockEnumerator);
+static visited_mode visitedMode = visited_mode::Exact;
+static uint64_t bitstateBytes;
+static const unsigned BITSTATE_HASHES = 3;
+
+namespace {
+
+// an open addressing hash table of fingerprints, in which zero marks an empty
+// slot.
+template <typename T>
+class fingerprint_table {
+public:
+  fingerprint_table() : slots(1024) {}
+
+  bool insert(T key) {
+    if (key == T{}) {
+      key = one();
+    }
+    if ((used + 1) * 4 > slots.size() * 3) {
+      grow();
+    }
+    size_t i = index(key);
+    while (!(slots[i] == T{})) {
+      if (slots[i] == key) {
+        return false;
+      }
+      i = (i + 1) & (slots.size() - 1);
+    }
+    slots[i] = key;
+    used++;
+    return true;
   }
 
-  std::unordered_set<block *, HashBlock, KEq> results;
-  std::unordered_set<block *, HashBlock, KEq> states_set;
-  states.clear();
-  states_set.insert(subject);
-  states.push_back(subject);
-  while(!states.empty() && depth != 0) {
-    state = states.front();
-    states.pop_front();
-    states_set.erase(state);
-    if (depth > 0) depth--;
-    uint64_t count;
-    block **stepResults = take_search_step(state, &count);
-    if (count == 0) {
-      results.insert(state);
+  size_t bytes() const { return slots.size() * sizeof(T); }
+
+private:
+  std::vector<T> slots;
+  size_t used = 0;
+
+  static T one();
+  size_t index(T key) const;
+
+  void grow() {
+    std::vector<T> old(slots.size() * 2);
+    old.swap(slots);
+    for (T key : old) {
+      if (!(key == T{})) {
+        size_t i = index(key);
+        while (!(slots[i] == T{})) {
+          i = (i + 1) & (slots.size() - 1);
+        }
+        slots[i] = key;
+      }
+    }
+  }
+};
+
+template <> uint64_t fingerprint_table<uint64_t>::one() { return 1; }
+template <> fingerprint fingerprint_table<fingerprint>::one() { return {0, 1}; }
+template <> size_t fingerprint_table<uint64_t>::index(uint64_t key) const { return key & (slots.size() - 1); }
+template <> size_t fingerprint_table<fingerprint>::index(fingerprint key) const { return key.hi & (slots.size() - 1); }
+
+// One shard of the visited set, in the representation given by visitedMode.
+class visited_shard {
+public:
+  visited_shard(size_t bitstateWords) : bits(visitedMode == visited_mode::Bitstate ? bitstateWords : 0) {}
+
+  // returns whether the state was taken to be new, and adds it to the shard.
+  bool insert(const encoded_state &s) {
+    bool fresh;
+    // the chance that the state would have been taken to have been visited
+    // already if it were new. It is counted for the states that are stored,
+    // since the others cannot be told apart from states seen before.
+    double risk = 0;
+    switch (visitedMode) {
+    case visited_mode::Exact:
+      fresh = exact.insert(s).second;
+      if (fresh) {
+        exactBytes += s.state.size();
+      }
+      break;
+    case visited_mode::Fingerprint64:
+      fresh = fingerprints64.insert(s.fp.hi);
+      risk = std::ldexp((double)stored, -64);
+      break;
+    case visited_mode::Fingerprint128:
+      fresh = fingerprints128.insert(s.fp);
+      risk = std::ldexp((double)stored, -128);
+      break;
+    case visited_mode::Bitstate: {
+      uint64_t size = bits.size() * 64;
+      risk = std::pow((double)setBits / size, BITSTATE_HASHES);
+      uint64_t step = rotl(s.fp.lo, 32) | 1;
+      fresh = false;
+      for (unsigned i = 0; i < BITSTATE_HASHES; i++) {
+        uint64_t bit = (s.fp.hi + i * step) % size;
+        uint64_t mask = (uint64_t)1 << (bit % 64);
+        if (!(bits[bit / 64] & mask)) {
+          bits[bit / 64] |= mask;
+          setBits++;
+          fresh = true;
+        }
+      }
+      break;
+    }
+    }
+    if (fresh) {
+      stored++;
+      omissions += risk;
+    }
+    return fresh;
+  }
+
+  uint64_t states() const { return stored; }
+  double expectedOmissions() const { return omissions; }
+
+  size_t bytes() const {
+    switch (visitedMode) {
+    case visited_mode::Exact:
+      // the encodings, and roughly a node and a bucket of the table for each.
+      return exactBytes + exact.size() * (sizeof(encoded_state) + 3 * sizeof(void *));
+    case visited_mode::Fingerprint64:
+      return fingerprints64.bytes();
+    case visited_mode::Fingerprint128:
+      return fingerprints128.bytes();
+    case visited_mode::Bitstate:
+      return bits.size() * sizeof(uint64_t);
+    }
+    return 0;
+  }
+
+private:
+  std::unordered_set<encoded_state, HashEncodedState> exact;
+  size_t exactBytes = 0;
+  fingerprint_table<uint64_t> fingerprints64;
+  fingerprint_table<fingerprint> fingerprints128;
+  std::vector<uint64_t> bits;
+  uint64_t setBits = 0;
+  uint64_t stored = 0;
+  double omissions = 0;
+};
+
+// The states found so far, split into shards by hash so that several threads
+// can insert into it at once, each into its own shards.
+class visited_set {
+public:
+  visited_set(size_t numShards) {
+    size_t words = std::max<uint64_t>(bitstateBytes / numShards / sizeof(uint64_t), 1);
+    shards.reserve(numShards);
+    for (size_t i = 0; i < numShards; i++) {
+      shards.emplace_back(words);
+    }
+  }
+
+  size_t numShards() const { return shards.size(); }
+  size_t shardOf(const encoded_state &s) const { return s.fp.lo % shards.size(); }
+  bool insert(const encoded_state &s) { return shards[shardOf(s)].insert(s); }
+
+  template <typename F>
+  double sum(F f) const {
+    double total = 0;
+    for (const auto &shard : shards) {
+      total += (shard.*f)();
+    }
+    return total;
+  }
+
+private:
+  std::vector<visited_shard> shards;
+};
+
+struct expansion {
+  std::vector<encoded_state> successors;
+  // whether each successor was seen for the first time.
+  std::vector<bool> fresh;
+  // whether the state expanded is a result of the search, and if so, the
+  // state printed as a KORE pattern.
+  bool isResult = false;
+  std::string printed;
+};
+
+// A fixed set of threads, each with its own heap, to which the search hands
+// out the states of a level.
+class worker_pool {
+public:
+  worker_pool(size_t numThreads) : workerSteps(numThreads) {
+    for (size_t i = 0; i < numThreads; i++) {
+      threads.emplace_back(&worker_pool::work, this, i);
+    }
+  }
+
+  ~worker_pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+      generation++;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  // calls task(i) for every i < count on the threads of the pool, and returns
+  // once every call has returned. If a call throws, the calls not yet started
+  // are skipped and the first exception is rethrown.
+  void run(size_t count, std::function<void(size_t)> task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    currentTask = std::move(task);
+    taskCount = count;
+    next = 0;
+    error = nullptr;
+    running = threads.size();
+    generation++;
+    wake.notify_all();
+    done.wait(lock, [&] { return running == 0; });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // returns the number of steps taken by the threads of the pool.
+  uint64_t steps() {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t total = 0;
+    for (uint64_t s : workerSteps) {
+      total += s;
+    }
+    return total;
+  }
+
+private:
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  std::function<void(size_t)> currentTask;
+  size_t taskCount = 0;
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  size_t running = 0;
+  uint64_t generation = 0;
+  bool stopping = false;
+  std::vector<uint64_t> workerSteps;
+
+  void work(size_t id) {
+    initStaticObjects();
+    uint64_t initialSteps = get_steps();
+    uint64_t seen = 0;
+    while (true) {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return generation != seen; });
+      seen = generation;
+      if (stopping) {
+        break;
+      }
+      lock.unlock();
+      size_t i;
+      while ((i = next.fetch_add(1)) < taskCount) {
+        try {
+          currentTask(i);
+        } catch (...) {
+          std::lock_guard<std::mutex> errorLock(mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+          next = taskCount;
+        }
+      }
+      lock.lock();
+      workerSteps[id] = get_steps() - initialSteps;
+      if (--running == 0) {
+        done.notify_one();
+      }
+    }
+    freeAllMemory();
+  }
+};
+
+}
+
+static size_t searchThreads(void) {
+  const char *env = getenv("KLLVM_SEARCH_THREADS");
+  size_t threads = env ? atol(env) : 1;
+  if (!threads) {
+    threads = std::thread::hardware_concurrency();
+  }
+  return threads ? threads : 1;
+}
+
+// the number of bytes of pending states kept in memory before the frontier
+// spills to segment files, from KLLVM_SEARCH_MEMORY (default 1G).
+static size_t searchMemory(void) {
+  const char *env = getenv("KLLVM_SEARCH_MEMORY");
+  if (!env) {
+    return 1024 * 1024 * 1024;
+  }
+  uint64_t size;
+  if (!parseSize(env, size)) {
+    fprintf(stderr, "Invalid KLLVM_SEARCH_MEMORY: %s\n", env);
+    abort();
+  }
+  return size;
+}
+
+static std::string spillDirectory(void) {
+  const char *env = getenv("KLLVM_SEARCH_SPILL_DIR");
+  if (!env) {
+    env = getenv("TMPDIR");
+  }
+  return env ? env : "/tmp";
+}
+
+// the number of states of a level taken from the frontier and expanded at
+// once.
+static const size_t SEARCH_CHUNK = 4096;
+
+// the size of the visited set and the estimated number of states it wrongly
+// took to have been visited, at the end of the last search.
+static uint64_t lastStates, lastBytes;
+static double lastOmissions;
+
+// sets the visited set used by take_search_steps to one of exact (the
+// default), fingerprint64, fingerprint128 (or fingerprint) or bitstate:<size>,
+// where size is a number of bytes with an optional K, M or G suffix. Returns
+// false if the mode is not valid.
+bool setSearchVisitedSet(const char *mode) {
+  if (!strcmp(mode, "exact")) {
+    visitedMode = visited_mode::Exact;
+  } else if (!strcmp(mode, "fingerprint64")) {
+    visitedMode = visited_mode::Fingerprint64;
+  } else if (!strcmp(mode, "fingerprint128") || !strcmp(mode, "fingerprint")) {
+    visitedMode = visited_mode::Fingerprint128;
+  } else if (!strncmp(mode, "bitstate:", 9)) {
+    uint64_t size;
+    if (!parseSize(mode + 9, size) || !size) {
+      return false;
+    }
+    visitedMode = visited_mode::Bitstate;
+    bitstateBytes = size;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void printSearchSummary(FILE *file) {
+  fprintf(file, "states: %" PRIu64 "\n", lastStates);
+  fprintf(file, "visited set bytes: %" PRIu64 "\n", lastBytes);
+  // each omission is taken to be independent of the others.
+  fprintf(file, "estimated omission probability: %.3g\n", -std::expm1(-lastOmissions));
+  fprintf(file, "expected omitted states: %.3g\n", lastOmissions);
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  fprintf(file, "peak resident set size: %ld KB\n", usage.ru_maxrss);
+}
+
+namespace {
+
+// Writes the results of a search to a file as they are found, as a
+// right-nested disjunction \or(r1,\or(r2,r3)) of binary \or patterns, or
+// \bottom if there are none. The last result is held back until the next one
+// is found or the search ends, since only then is it known whether it is the
+// last operand of a disjunction.
+class result_writer {
+public:
+  result_writer(FILE *file, uint64_t bound) : file(file), bound(bound) {}
+
+  void add(const std::string &result) {
+    if (count) {
+      fputs("\\or{SortGeneratedTopCell{}}(", file);
+      fwrite(pending.data(), 1, pending.size(), file);
+      fputc(',', file);
+    }
+    pending = result;
+    count++;
+  }
+
+  // returns whether the search has found as many results as it was asked for.
+  bool full() const { return bound && count >= bound; }
+
+  uint64_t finish() {
+    if (!count) {
+      fputs("\\bottom{SortGeneratedTopCell{}}()", file);
     } else {
-      for (uint64_t i = 0; i < count; i++) {
-        auto dirty = states_set.insert(stepResults[i]);
-        if (dirty.second) {
-          states.push_back(stepResults[i]);
+      fwrite(pending.data(), 1, pending.size(), file);
+      for (uint64_t i = 1; i < count; i++) {
+        fputc(')', file);
+      }
+    }
+    fflush(file);
+    return count;
+  }
+
+private:
+  FILE *file;
+  uint64_t bound;
+  uint64_t count = 0;
+  std::string pending;
+};
+
+enum class search_strategy { BFS, DFS, IDDFS };
+
+}
+
+static search_strategy searchStrategy = search_strategy::BFS;
+static uint64_t searchBound = 0;
+static bool searchReachable = false;
+
+// sets the order in which take_search_steps explores states to one of bfs
+// (the default), dfs or iddfs. Returns false if the strategy is not valid.
+bool setSearchStrategy(const char *strategy) {
+  if (!strcmp(strategy, "bfs")) {
+    searchStrategy = search_strategy::BFS;
+  } else if (!strcmp(strategy, "dfs")) {
+    searchStrategy = search_strategy::DFS;
+  } else if (!strcmp(strategy, "iddfs")) {
+    searchStrategy = search_strategy::IDDFS;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// makes take_search_steps stop once it has found bound results, or never if
+// bound is 0.
+void setSearchBound(uint64_t bound) {
+  searchBound = bound;
+}
+
+// makes every state reached by take_search_steps a candidate result, rather
+// than only the states in which no rule applies.
+void setSearchReachable(bool reachable) {
+  searchReachable = reachable;
+}
+
+static std::vector<std::string> searchProcesses;
+static unsigned searchProcess;
+
+// makes take_search_steps split the search between the processes listening
+// at addresses, a comma-separated list of addresses as taken by
+// search_network, this process being the one at index self. Returns false if
+// there is no such index.
+bool setSearchProcesses(const char *addresses, unsigned self) {
+  searchProcesses.clear();
+  const char *start = addresses;
+  while (true) {
+    const char *end = strchr(start, ',');
+    searchProcesses.emplace_back(start, end ? end - start : strlen(start));
+    if (!end) {
+      break;
+    }
+    start = end + 1;
+  }
+  searchProcess = self;
+  return self < searchProcesses.size();
+}
+
+static std::string printState(block *subject) {
+  string *printed = printConfigurationToString(subject);
+  return std::string(printed->data, len(printed));
+}
+
+// expands a state, and decides whether it is a result of the search: a state
+// matching the search pattern that is either stuck or, if searchReachable is
+// set, any state at all.
+// An exception thrown while the state is being stepped propagates to the
+// caller, with the state of the collector restored.
+static void expand(const encoded_state &state, expansion &result) {
+  gc_state_guard saved;
+  block *subject = deserializeConfiguration(state.state.data(), state.state.size());
+  if (searchReachable && search_pattern(subject)) {
+    result.isResult = true;
+    result.printed = printState(subject);
+  }
+  uint64_t count;
+  block **stepResults = take_search_step(subject, &count);
+  for (uint64_t i = 0; i < count; i++) {
+    std::string successor;
+    serializeConfiguration(stepResults[i], successor);
+    result.successors.emplace_back(std::move(successor));
+  }
+  result.fresh.assign(count, false);
+  if (!searchReachable && !count) {
+    // the step may have moved the state if it collected garbage.
+    subject = deserializeConfiguration(state.state.data(), state.state.size());
+    if (search_pattern(subject)) {
+      result.isResult = true;
+      result.printed = printState(subject);
+    }
+  }
+}
+
+// decides whether a state left unexpanded because the search reached its depth
+// is a result of the search: it is if it matches the search pattern.
+static void leftover(const encoded_state &state, expansion &result) {
+  block *subject = deserializeConfiguration(state.state.data(), state.state.size());
+  if (search_pattern(subject)) {
+    result.isResult = true;
+    result.printed = printState(subject);
+  }
+}
+
+// Explores the states breadth-first, one level at a time. The states of a
+// level are expanded concurrently, and their successors are then added to the
+// visited set concurrently, each shard of the set taking the successors in the
+// order of the level. The next level therefore contains the same states in the
+// same order as if the level had been expanded by a single thread, and the
+// search finds the same results in the same order.
+//
+// The frontier is kept in spill queues, so that only a bounded number of
+// bytes of pending states is held in memory and the rest is read back from
+// disk in order. A level is expanded SEARCH_CHUNK states at a time, or one
+// state per thread if the number of results is bounded, so that the search
+// stops soon after finding enough of them.
+//
+// depth bounds the number of states expanded.
+static void searchBreadthFirst(int64_t depth, const std::string &initial, result_writer &results) {
+  size_t numThreads = searchThreads();
+  std::unique_ptr<worker_pool> pool;
+  if (numThreads > 1) {
+    pool.reset(new worker_pool(numThreads));
+  }
+  // runs task(i) for every i < count, on the pool if there is one.
+  auto forEach = [&](size_t count, std::function<void(size_t)> task) {
+    if (pool) {
+      pool->run(count, task);
+    } else {
+      for (size_t i = 0; i < count; i++) {
+        task(i);
+      }
+    }
+  };
+  size_t chunkSize = searchBound ? numThreads : SEARCH_CHUNK;
+
+  visited_set visited(pool ? numThreads * 4 : 1);
+  spill_budget budget{searchMemory(), 0};
+  std::string directory = spillDirectory();
+  spill_queue level(&budget, directory), nextLevel(&budget, directory);
+  visited.insert(encoded_state(initial));
+  level.push(initial);
+
+  // takes up to count states from queue.
+  auto takeChunk = [&](spill_queue &queue, size_t count) {
+    std::vector<encoded_state> chunk;
+    chunk.reserve(count);
+    std::string state;
+    for (size_t i = 0; i < count && queue.pop(state); i++) {
+      chunk.emplace_back(std::move(state));
+    }
+    return chunk;
+  };
+
+  while (!level.empty() && depth != 0 && !results.full()) {
+    while (!level.empty() && depth != 0 && !results.full()) {
+      size_t count = std::min(level.size(), chunkSize);
+      if (depth > 0 && (uint64_t)depth < count) {
+        count = depth;
+      }
+      std::vector<encoded_state> chunk = takeChunk(level, count);
+      std::vector<expansion> expanded(count);
+      forEach(count, [&](size_t i) { expand(chunk[i], expanded[i]); });
+
+      std::vector<std::vector<std::pair<size_t, size_t>>> byShard(visited.numShards());
+      for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < expanded[i].successors.size(); j++) {
+          byShard[visited.shardOf(expanded[i].successors[j])].emplace_back(i, j);
         }
       }
+      forEach(byShard.size(), [&](size_t shard) {
+        for (auto [i, j] : byShard[shard]) {
+          expanded[i].fresh[j] = visited.insert(expanded[i].successors[j]);
+        }
+      });
+
+      if (depth > 0) {
+        depth -= count;
+      }
+      for (size_t i = 0; i < count && !results.full(); i++) {
+        if (expanded[i].isResult) {
+          results.add(expanded[i].printed);
+        }
+        for (size_t j = 0; j < expanded[i].successors.size(); j++) {
+          if (expanded[i].fresh[j]) {
+            nextLevel.push(expanded[i].successors[j].state);
+          }
+        }
+      }
+    }
+    if (depth == 0) {
+      break;
     }
+    level.swap(nextLevel);
   }
   if (depth == 0) {
-    for (auto state : states) {
-      results.insert(state);
+    // the rest of the last level and the next one are left unexpanded.
+    for (spill_queue *queue : {&level, &nextLevel}) {
+      while (!queue->empty() && !results.full()) {
+        std::vector<encoded_state> chunk = takeChunk(*queue, chunkSize);
+        std::vector<expansion> checked(chunk.size());
+        forEach(chunk.size(), [&](size_t i) { leftover(chunk[i], checked[i]); });
+        for (size_t i = 0; i < chunk.size() && !results.full(); i++) {
+          if (checked[i].isResult) {
+            results.add(checked[i].printed);
+          }
+        }
+      }
+    }
+  }
+
+  if (pool) {
+    add_steps(pool->steps());
+  }
+  lastStates = visited.sum(&visited_shard::states);
+  lastBytes = visited.sum(&visited_shard::bytes);
+  lastOmissions = visited.sum(&visited_shard::expectedOmissions);
+}
+
+// Explores the states depth-first, taking the successors of a state in the
+// order in which the step function returns them. Each state is expanded at
+// most once, so a state first reached by a long path is not explored again
+// when it is reached by a shorter one.
+//
+// depth bounds the length of the paths explored.
+static void searchDepthFirst(int64_t depth, const std::string &initial, result_writer &results) {
+  visited_set visited(1);
+  std::vector<std::pair<encoded_state, int64_t>> stack;
+  stack.emplace_back(encoded_state(initial), 0);
+  visited.insert(stack.back().first);
+  while (!stack.empty() && !results.full()) {
+    encoded_state state = std::move(stack.back().first);
+    int64_t length = stack.back().second;
+    stack.pop_back();
+    expansion expanded;
+    if (length == depth) {
+      leftover(state, expanded);
+    } else {
+      expand(state, expanded);
+    }
+    if (expanded.isResult) {
+      results.add(expanded.printed);
+    }
+    for (size_t j = expanded.successors.size(); j-- > 0;) {
+      if (visited.insert(expanded.successors[j])) {
+        stack.emplace_back(std::move(expanded.successors[j]), length + 1);
+      }
+    }
+  }
+  lastStates = visited.sum(&visited_shard::states);
+  lastBytes = visited.sum(&visited_shard::bytes);
+  lastOmissions = visited.sum(&visited_shard::expectedOmissions);
+}
+
+namespace {
+
+struct HashFingerprint {
+  size_t operator()(const fingerprint &fp) const { return fp.lo; }
+};
+
+}
+
+// Explores the states depth-first to increasing bounds on the length of the
+// paths explored, up to depth, until a bound is reached at which no path is
+// cut short. The length of the shortest path to each state found is kept
+// across iterations, and an iteration only follows the shortest paths, so
+// that it explores every state within its bound once. States are remembered by
+// their 128-bit fingerprints, whatever the visited set mode.
+static void searchIterativeDeepening(int64_t depth, const std::string &initial, result_writer &results) {
+  std::unordered_map<fingerprint, int64_t, HashFingerprint> shortest;
+  std::unordered_set<fingerprint, HashFingerprint> reported;
+  auto report = [&](const encoded_state &state, expansion &expanded) {
+    if (expanded.isResult && reported.insert(state.fp).second) {
+      results.add(expanded.printed);
+    }
+  };
+  encoded_state start(initial);
+  shortest[start.fp] = 0;
+  for (int64_t limit = 0; depth < 0 || limit <= depth; limit++) {
+    bool cutShort = false;
+    std::unordered_set<fingerprint, HashFingerprint> explored;
+    std::vector<std::pair<encoded_state, int64_t>> stack;
+    stack.emplace_back(start, 0);
+    while (!stack.empty() && !results.full()) {
+      encoded_state state = std::move(stack.back().first);
+      int64_t length = stack.back().second;
+      stack.pop_back();
+      if (!explored.insert(state.fp).second) {
+        continue;
+      }
+      expansion expanded;
+      if (length == depth) {
+        leftover(state, expanded);
+        report(state, expanded);
+        continue;
+      }
+      expand(state, expanded);
+      report(state, expanded);
+      for (size_t j = expanded.successors.size(); j-- > 0;) {
+        auto &successor = expanded.successors[j];
+        auto previous = shortest.find(successor.fp);
+        if (previous == shortest.end()) {
+          shortest[successor.fp] = length + 1;
+        } else if (previous->second != length + 1) {
+          continue;
+        }
+        if (length == limit) {
+          cutShort = true;
+        } else {
+          stack.emplace_back(std::move(successor), length + 1);
+        }
+      }
+    }
+    if (!cutShort || results.full()) {
+      break;
+    }
+  }
+  lastStates = shortest.size();
+  lastBytes = shortest.size() * (sizeof(fingerprint) + sizeof(int64_t) + 3 * sizeof(void *));
+  lastOmissions = std::ldexp((double)lastStates * lastStates / 2, -128);
+}
+
+namespace {
+
+// the tags of the messages exchanged by the processes of a distributed search.
+enum search_message : uint8_t { STATES, RESULT };
+
+}
+
+// the number of bytes of states queued for another process before they are
+// sent to it.
+static const size_t STATES_BATCH = 256 * 1024;
+// the number of states a process of a distributed search expands between
+// reading the messages sent to it.
+static const size_t STATES_BETWEEN_POLLS = 64;
+
+// the process of a distributed search that owns a state: the one that adds it
+// to its visited set and expands it. It depends on both halves of the
+// fingerprint, so that it is independent of the slot the state takes in a
+// visited set.
+static unsigned ownerOf(const encoded_state &state, unsigned processes) {
+  return mix64(state.fp.lo ^ state.fp.hi) % processes;
+}
+
+// appends a state reached by a path of the given length to a batch of states,
+// as the size of the state, the length and the state.
+static void appendState(std::string &batch, int64_t length, const std::string &state) {
+  uint64_t size = state.size();
+  batch.append((const char *)&size, sizeof(size));
+  batch.append((const char *)&length, sizeof(length));
+  batch += state;
+}
+
+// Explores the states with the processes set by setSearchProcesses, each of
+// which owns the states whose hash maps to it. A process expands the states it
+// owns in the order in which it first finds them, keeps their successors that
+// it owns, and sends the others to their owners in batches. The processes
+// send their results to process 0, which writes them, and stops the search
+// once it has enough. The search is over once every process is idle and no
+// states are in flight, and process 0 then collects the size of the state
+// space and the number of steps taken from the others.
+//
+// depth bounds the length of the path by which each state is first reached,
+// which may depend on the timing of the processes.
+static void searchDistributed(int64_t depth, const std::string &initial, result_writer &results) {
+  search_network network(searchProcesses, searchProcess);
+  unsigned self = network.self();
+  visited_set visited(1);
+  spill_budget budget{searchMemory(), 0};
+  spill_queue pending(&budget, spillDirectory());
+  std::vector<std::string> outgoing(network.size());
+
+  auto flush = [&](unsigned to) {
+    network.send(to, STATES, outgoing[to]);
+    outgoing[to].clear();
+  };
+  auto add = [&](int64_t length, encoded_state state) {
+    unsigned owner = ownerOf(state, network.size());
+    if (owner == self) {
+      if (visited.insert(state)) {
+        std::string record((const char *)&length, sizeof(length));
+        record += state.state;
+        pending.push(record);
+      }
+    } else {
+      appendState(outgoing[owner], length, state.state);
+      if (outgoing[owner].size() >= STATES_BATCH) {
+        flush(owner);
+      }
+    }
+  };
+  auto deliver = [&](unsigned, uint8_t tag, std::string &payload) {
+    if (tag == RESULT) {
+      if (!results.full()) {
+        results.add(payload);
+      }
+      return;
+    }
+    size_t pos = 0;
+    while (pos < payload.size()) {
+      uint64_t size;
+      int64_t length;
+      memcpy(&size, payload.data() + pos, sizeof(size));
+      memcpy(&length, payload.data() + pos + sizeof(size), sizeof(length));
+      pos += sizeof(size) + sizeof(length);
+      add(length, encoded_state(payload.substr(pos, size)));
+      pos += size;
     }
+  };
+
+  encoded_state start(initial);
+  if (ownerOf(start, network.size()) == self) {
+    add(0, std::move(start));
+  }
+  std::string record;
+  while (network.poll(pending.empty(), deliver)) {
+    for (size_t i = 0; i < STATES_BETWEEN_POLLS && pending.pop(record); i++) {
+      int64_t length;
+      memcpy(&length, record.data(), sizeof(length));
+      encoded_state state(record.substr(sizeof(length)));
+      expansion expanded;
+      if (length == depth) {
+        leftover(state, expanded);
+      } else {
+        expand(state, expanded);
+      }
+      if (expanded.isResult) {
+        if (self == 0) {
+          if (!results.full()) {
+            results.add(expanded.printed);
+          }
+        } else {
+          network.send(0, RESULT, expanded.printed);
+        }
+      }
+      for (auto &successor : expanded.successors) {
+        add(length + 1, std::move(successor));
+      }
+    }
+    if (pending.empty()) {
+      for (unsigned to = 0; to < network.size(); to++) {
+        if (!outgoing[to].empty()) {
+          flush(to);
+        }
+      }
+    }
+    if (self == 0 && results.full()) {
+      network.stop();
+    }
+  }
+
+  struct {
+    uint64_t states, bytes, steps;
+    double omissions;
+  } summary{(uint64_t)visited.sum(&visited_shard::states), (uint64_t)visited.sum(&visited_shard::bytes),
+            get_steps(), visited.sum(&visited_shard::expectedOmissions)};
+  std::vector<std::string> summaries = network.gather(std::string((const char *)&summary, sizeof(summary)));
+  lastStates = summary.states;
+  lastBytes = summary.bytes;
+  lastOmissions = summary.omissions;
+  for (size_t i = 1; i < summaries.size(); i++) {
+    decltype(summary) other;
+    memcpy(&other, summaries[i].data(), sizeof(other));
+    lastStates += other.states;
+    lastBytes += other.bytes;
+    lastOmissions += other.omissions;
+    add_steps(other.steps);
+  }
+}
+
+// Searches the states reachable from subject for results: by default, the
+// states in which no rule applies, or with setSearchReachable, every state
+// reached. Only the states matching the search pattern of the definition, if
+// it has one, are results. The states left unexplored because the search
+// reached its depth are also results if they match the search pattern. The
+// results are written to output as they are found, as a disjunction, and
+// their number is returned. The search stops early once it has found the
+// number of results set by setSearchBound. In a distributed search, only
+// process 0 writes the results, and the others return 0.
+uint64_t take_search_steps(int64_t depth, block *subject, FILE *output) {
+  result_writer results(output, searchBound);
+  std::string initial;
+  serializeConfiguration(subject, initial);
+  if (!searchProcesses.empty()) {
+    searchDistributed(depth, initial, results);
+    if (searchProcess != 0) {
+      return 0;
+    }
+    return results.finish();
+  }
+  switch (searchStrategy) {
+  case search_strategy::BFS:
+    searchBreadthFirst(depth, initial, results);
+    break;
+  case search_strategy::DFS:
+    searchDepthFirst(depth, initial, results);
+    break;
+  case search_strategy::IDDFS:
+    searchIterativeDeepening(depth, initial, results);
+    break;
   }
-  return results;
+  return results.finish();
 }
@@ -0,0 +1,372 @@
+#include "runtime/search_network.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Every message on a connection is a frame made of its kind, its tag, the
+// length of its payload as a 64-bit integer, and the payload.
+enum frame_kind : uint8_t { MESSAGE, TOKEN, DONE, GATHER };
+static const size_t FRAME_HEADER = 2 + sizeof(uint64_t);
+
+// how long an idle process waits for messages before checking for the token
+// again, in milliseconds.
+static const int IDLE_WAIT = 100;
+// how long a process keeps trying to connect to a process that is not
+// listening yet, in seconds.
+static const int CONNECT_TIMEOUT = 60;
+
+// returns a socket listening on address, or connected to it, or -1 if
+// connecting failed because nothing is listening there yet.
+static int openSocket(const std::string &address, bool listening) {
+  if (!address.compare(0, 5, "unix:")) {
+    std::string path = address.substr(5);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "Socket path too long: %s\n", path.c_str());
+      abort();
+    }
+    strcpy(addr.sun_path, path.c_str());
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+      perror("socket");
+      abort();
+    }
+    if (listening) {
+      unlink(path.c_str());
+      if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, SOMAXCONN) < 0) {
+        perror(path.c_str());
+        abort();
+      }
+    } else if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      if (errno != ENOENT && errno != ECONNREFUSED) {
+        perror(path.c_str());
+        abort();
+      }
+      close(sock);
+      return -1;
+    }
+    return sock;
+  }
+
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    fprintf(stderr, "Invalid address: %s\n", address.c_str());
+    abort();
+  }
+  std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+  struct addrinfo *info;
+  int err = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &info);
+  if (err) {
+    fprintf(stderr, "%s: %s\n", address.c_str(), gai_strerror(err));
+    abort();
+  }
+  int sock = -1;
+  for (struct addrinfo *ai = info; ai && sock < 0; ai = ai->ai_next) {
+    sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (sock < 0) {
+      continue;
+    }
+    int one = 1;
+    if (listening) {
+      setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (bind(sock, ai->ai_addr, ai->ai_addrlen) < 0 || listen(sock, SOMAXCONN) < 0) {
+        perror(address.c_str());
+        abort();
+      }
+    } else if (connect(sock, ai->ai_addr, ai->ai_addrlen) < 0) {
+      close(sock);
+      sock = -1;
+      continue;
+    }
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  freeaddrinfo(info);
+  return sock;
+}
+
+static void transfer(int fd, void *buf, size_t size, bool writing) {
+  char *p = (char *)buf;
+  while (size) {
+    ssize_t n = writing ? send(fd, p, size, MSG_NOSIGNAL) : read(fd, p, size);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      perror("search network");
+      abort();
+    }
+    p += n;
+    size -= n;
+  }
+}
+
+search_network::search_network(const std::vector<std::string> &addresses, unsigned self)
+  : peers(addresses.size(), peer{-1, std::string(), std::string()}), id(self), count(0), black(false),
+    hasToken(self == 0), tokenCount(0), tokenBlack(false), tokenSent(false), done(false),
+    gathered(addresses.size()), numGathered(0) {
+  // the processes after this one connect to it, so it listens before
+  // connecting to the processes before it, which may be waiting for it.
+  int listener = -1;
+  if (self + 1 < size()) {
+    listener = openSocket(addresses[self], true);
+    if (!addresses[self].compare(0, 5, "unix:")) {
+      unixPath = addresses[self].substr(5);
+    }
+  }
+  for (unsigned j = 0; j < self; j++) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(CONNECT_TIMEOUT);
+    while ((peers[j].fd = openSocket(addresses[j], false)) < 0) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        fprintf(stderr, "Could not connect to search process %u at %s\n", j, addresses[j].c_str());
+        abort();
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    uint32_t from = self;
+    transfer(peers[j].fd, &from, sizeof(from), true);
+  }
+  for (unsigned k = self + 1; k < size(); k++) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        k--;
+        continue;
+      }
+      perror("accept");
+      abort();
+    }
+    uint32_t from;
+    transfer(fd, &from, sizeof(from), false);
+    if (from <= self || from >= size() || peers[from].fd >= 0) {
+      fprintf(stderr, "Unexpected connection from search process %u\n", from);
+      abort();
+    }
+    peers[from].fd = fd;
+  }
+  if (listener >= 0) {
+    close(listener);
+  }
+  if (!unixPath.empty()) {
+    unlink(unixPath.c_str());
+  }
+  for (auto &p : peers) {
+    if (p.fd >= 0) {
+      fcntl(p.fd, F_SETFL, fcntl(p.fd, F_GETFL) | O_NONBLOCK);
+    }
+  }
+}
+
+search_network::~search_network() {
+  for (auto &p : peers) {
+    if (p.fd >= 0) {
+      close(p.fd);
+    }
+  }
+}
+
+void search_network::queue(unsigned to, uint8_t kind, uint8_t tag, const std::string &payload) {
+  std::string &out = peers[to].out;
+  uint64_t length = payload.size();
+  out += (char)kind;
+  out += (char)tag;
+  out.append((const char *)&length, sizeof(length));
+  out += payload;
+}
+
+void search_network::send(unsigned to, uint8_t tag, const std::string &payload) {
+  queue(to, MESSAGE, tag, payload);
+  count++;
+}
+
+void search_network::passToken() {
+  hasToken = false;
+  if (id == 0) {
+    if (size() == 1 || (tokenSent && !tokenBlack && !black && tokenCount + count == 0)) {
+      finish();
+      return;
+    }
+    tokenCount = 0;
+    tokenBlack = false;
+    tokenSent = true;
+  } else {
+    tokenCount += count;
+    tokenBlack = tokenBlack || black;
+  }
+  black = false;
+  std::string token((const char *)&tokenCount, sizeof(tokenCount));
+  token += (char)tokenBlack;
+  queue((id + 1) % size(), TOKEN, 0, token);
+}
+
+void search_network::finish() {
+  done = true;
+  for (unsigned j = 0; j < size(); j++) {
+    if (j != id) {
+      queue(j, DONE, 0, std::string());
+    }
+  }
+}
+
+void search_network::stop() {
+  if (!done) {
+    finish();
+  }
+}
+
+// handles the complete frames received from a process, and returns whether
+// any of them was a message delivered.
+bool search_network::receive(unsigned from, const std::function<void(unsigned, uint8_t, std::string &)> &deliver) {
+  std::string &in = peers[from].in;
+  bool delivered = false;
+  size_t pos = 0;
+  while (in.size() - pos >= FRAME_HEADER) {
+    uint64_t length;
+    memcpy(&length, in.data() + pos + 2, sizeof(length));
+    if (in.size() - pos - FRAME_HEADER < length) {
+      break;
+    }
+    uint8_t kind = in[pos], tag = in[pos + 1];
+    std::string payload = in.substr(pos + FRAME_HEADER, length);
+    pos += FRAME_HEADER + length;
+    switch (kind) {
+    case MESSAGE:
+      // messages still in flight when the search was stopped are dropped.
+      if (!done) {
+        count--;
+        black = true;
+        delivered = true;
+        deliver(from, tag, payload);
+      }
+      break;
+    case TOKEN:
+      memcpy(&tokenCount, payload.data(), sizeof(tokenCount));
+      tokenBlack = payload[sizeof(tokenCount)];
+      hasToken = true;
+      break;
+    case DONE:
+      done = true;
+      break;
+    case GATHER:
+      gathered[from] = std::move(payload);
+      numGathered++;
+      break;
+    }
+  }
+  in.erase(0, pos);
+  return delivered;
+}
+
+// writes and reads what the sockets allow, waiting up to timeout milliseconds
+// for one of them to be ready, and returns whether a message was delivered.
+bool search_network::exchange(int timeout, const std::function<void(unsigned, uint8_t, std::string &)> &deliver) {
+  std::vector<struct pollfd> fds;
+  std::vector<unsigned> from;
+  for (unsigned j = 0; j < size(); j++) {
+    if (peers[j].fd >= 0) {
+      short events = POLLIN;
+      if (!peers[j].out.empty()) {
+        events |= POLLOUT;
+      }
+      fds.push_back({peers[j].fd, events, 0});
+      from.push_back(j);
+    }
+  }
+  if (fds.empty()) {
+    return false;
+  }
+  if (::poll(fds.data(), fds.size(), timeout) < 0) {
+    if (errno == EINTR) {
+      return false;
+    }
+    perror("poll");
+    abort();
+  }
+  bool delivered = false;
+  for (size_t i = 0; i < fds.size(); i++) {
+    peer &p = peers[from[i]];
+    if (fds[i].revents & POLLOUT) {
+      ssize_t n = ::send(p.fd, p.out.data(), p.out.size(), MSG_NOSIGNAL);
+      if (n > 0) {
+        p.out.erase(0, n);
+      } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        if (!done) {
+          perror("search network");
+          abort();
+        }
+        p.out.clear();
+      }
+    }
+    if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+      char buf[65536];
+      ssize_t n;
+      while ((n = read(p.fd, buf, sizeof(buf))) > 0) {
+        p.in.append(buf, n);
+      }
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        // the other processes only disconnect once process 0 has closed its
+        // connections, at the end of the search.
+        if (!done || id == 0) {
+          fprintf(stderr, "Search process %u disconnected\n", from[i]);
+          abort();
+        }
+        close(p.fd);
+        p.fd = -1;
+      }
+      delivered = receive(from[i], deliver) || delivered;
+    }
+  }
+  return delivered;
+}
+
+bool search_network::poll(bool idle, const std::function<void(unsigned, uint8_t, std::string &)> &deliver) {
+  if (done) {
+    return false;
+  }
+  // an idle process holding the token passes it on without waiting.
+  bool delivered = exchange(idle && !hasToken ? IDLE_WAIT : 0, deliver);
+  if (!done && idle && !delivered && hasToken) {
+    passToken();
+  }
+  return !done;
+}
+
+std::vector<std::string> search_network::gather(const std::string &payload) {
+  auto ignore = [](unsigned, uint8_t, std::string &) {};
+  if (id != 0) {
+    queue(0, GATHER, 0, payload);
+    for (unsigned j = 1; j < size(); j++) {
+      peers[j].out.clear();
+    }
+    // process 0 closes its connections once it has every payload.
+    while (peers[0].fd >= 0) {
+      exchange(-1, ignore);
+    }
+    return std::vector<std::string>();
+  }
+  gathered[0] = payload;
+  numGathered++;
+  while (numGathered < size()) {
+    exchange(-1, ignore);
+  }
+  return gathered;
+}
@@ -0,0 +1,98 @@
+#include "runtime/serve.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+bool readAll(int fd, void *buf, size_t size) {
+  char *ptr = (char *)buf;
+  while (size) {
+    ssize_t n = read(fd, ptr, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void *buf, size_t size) {
+  const char *ptr = (const char *)buf;
+  while (size) {
+    ssize_t n = write(fd, ptr, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool readString(int fd, std::string &result) {
+  uint64_t size;
+  if (!readAll(fd, &size, sizeof(size))) {
+    return false;
+  }
+  result.resize(size);
+  return readAll(fd, &result[0], size);
+}
+
+bool writeResponse(int fd, int32_t exitCode, const char *data, uint64_t size) {
+  return writeAll(fd, &exitCode, sizeof(exitCode))
+    && writeAll(fd, &size, sizeof(size))
+    && writeAll(fd, data, size);
+}
+
+size_t responseSize(const std::string &data) {
+  const size_t header = sizeof(int32_t) + sizeof(uint64_t);
+  if (data.size() < header) {
+    return 0;
+  }
+  uint64_t size;
+  memcpy(&size, data.data() + sizeof(int32_t), sizeof(size));
+  return size <= data.size() - header ? header + size : 0;
+}
+
+int serveSocket(const char *path, const std::function<void(int)> &serve) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return 1;
+  }
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, SOMAXCONN) < 0) {
+    perror(path);
+    return 1;
+  }
+  // a client that disconnects early must not kill the server.
+  signal(SIGPIPE, SIG_IGN);
+  while (true) {
+    int conn = accept(sock, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("accept");
+      return 1;
+    }
+    serve(conn);
+    close(conn);
+  }
+}
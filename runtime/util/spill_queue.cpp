@@ -0,0 +1,148 @@
+#include "runtime/spill_queue.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// segments kept in memory are freed once consumed, so they are kept small to
+// return memory to the budget promptly.
+static const size_t MEMORY_SEGMENT_BYTES = 1024 * 1024;
+
+spill_queue::spill_queue(spill_budget *budget, std::string directory, size_t segmentSize)
+  : budget(budget), directory(std::move(directory)), segmentSize(segmentSize), count(0), files(0) {}
+
+spill_queue::~spill_queue() {
+  for (auto &s : segments) {
+    release(s);
+  }
+}
+
+void spill_queue::swap(spill_queue &other) {
+  std::swap(budget, other.budget);
+  std::swap(directory, other.directory);
+  std::swap(segmentSize, other.segmentSize);
+  std::swap(segments, other.segments);
+  std::swap(count, other.count);
+  std::swap(files, other.files);
+}
+
+bool spill_queue::fits(const segment &s, bool inMemory, size_t recordSize) const {
+  if (inMemory) {
+    return s.fd < 0 && s.memory.size() + recordSize <= MEMORY_SEGMENT_BYTES;
+  }
+  return s.fd >= 0 && s.writable && s.size + recordSize <= s.mapped;
+}
+
+void spill_queue::openFile(segment &s, size_t recordSize) {
+  std::string path = directory + "/kllvm-search.XXXXXX";
+  s.fd = mkstemp(&path[0]);
+  if (s.fd < 0) {
+    perror(path.c_str());
+    abort();
+  }
+  unlink(path.c_str());
+  s.mapped = recordSize > segmentSize ? recordSize : segmentSize;
+  if (ftruncate(s.fd, s.mapped) < 0) {
+    perror("ftruncate");
+    abort();
+  }
+  s.data = (char *)mmap(NULL, s.mapped, PROT_READ | PROT_WRITE, MAP_SHARED, s.fd, 0);
+  if (s.data == MAP_FAILED) {
+    perror("mmap");
+    abort();
+  }
+  s.writable = true;
+  files++;
+}
+
+// unmaps a segment file once no more records will be appended to it, so that
+// its pages can be written back and dropped until it is read.
+void spill_queue::finishWriting(segment &s) {
+  if (s.fd < 0 || !s.writable) {
+    return;
+  }
+  s.writable = false;
+  if (s.pos == 0) {
+    munmap(s.data, s.mapped);
+    s.data = nullptr;
+    s.mapped = 0;
+    // the rest of the file is never used.
+    if (ftruncate(s.fd, s.size) < 0) {
+      perror("ftruncate");
+      abort();
+    }
+  }
+}
+
+void spill_queue::release(segment &s) {
+  if (s.fd < 0) {
+    budget->used -= s.memory.size();
+    return;
+  }
+  if (s.data) {
+    munmap(s.data, s.mapped);
+  }
+  close(s.fd);
+}
+
+void spill_queue::push(const std::string &record) {
+  uint64_t length = record.size();
+  size_t recordSize = sizeof(length) + length;
+  bool inMemory = budget->used + recordSize <= budget->limit;
+  if (segments.empty() || !fits(segments.back(), inMemory, recordSize)) {
+    if (!segments.empty()) {
+      finishWriting(segments.back());
+    }
+    segments.push_back(segment{std::string(), -1, nullptr, 0, false, 0, 0});
+    if (!inMemory) {
+      openFile(segments.back(), recordSize);
+    }
+  }
+  segment &s = segments.back();
+  if (inMemory) {
+    s.memory.append((const char *)&length, sizeof(length));
+    s.memory += record;
+    budget->used += recordSize;
+  } else {
+    memcpy(s.data + s.size, &length, sizeof(length));
+    memcpy(s.data + s.size + sizeof(length), record.data(), length);
+  }
+  s.size += recordSize;
+  count++;
+}
+
+bool spill_queue::pop(std::string &record) {
+  if (!count) {
+    return false;
+  }
+  segment &s = segments.front();
+  const char *base;
+  if (s.fd < 0) {
+    base = s.memory.data();
+  } else {
+    if (!s.data) {
+      s.mapped = s.size;
+      s.data = (char *)mmap(NULL, s.mapped, PROT_READ, MAP_SHARED, s.fd, 0);
+      if (s.data == MAP_FAILED) {
+        perror("mmap");
+        abort();
+      }
+      madvise(s.data, s.mapped, MADV_SEQUENTIAL);
+    }
+    base = s.data;
+  }
+  uint64_t length;
+  memcpy(&length, base + s.pos, sizeof(length));
+  record.assign(base + s.pos + sizeof(length), length);
+  s.pos += sizeof(length) + length;
+  count--;
+  if (s.pos == s.size) {
+    release(s);
+    segments.pop_front();
+  }
+  return true;
+}
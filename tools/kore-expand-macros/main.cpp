@@ -6,7 +6,7 @@
 using namespace kllvm;
 using namespace kllvm::parser;
 
-int main (int argc, char **argv) {
+int main (int argc, char **argv) try {
   if (argc != 3) {
     std::cerr << "usage: " << argv[0] << " <kompiled-dir> <pattern.kore>" << std::endl;
     return 1;
@@ -69,4 +69,7 @@ int main (int argc, char **argv) {
   std::cout << std::endl;
 
   def.release(); // so we don't waste time calling delete a bunch of times
+} catch (ParseError &e) {
+  std::cerr << e.what() << "\n";
+  return -1;
 }
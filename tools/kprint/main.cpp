@@ -26,7 +26,7 @@ static std::string trim(const std::string &s) {
     return rtrim(ltrim(s));
 }
 
-int main (int argc, char **argv) {
+int main (int argc, char **argv) try {
   if (argc != 3 && argc != 4 && argc != 5) {
     std::cerr << "usage: " << argv[0] << " <definition.kore> <pattern.kore> [true|false|auto] [true|false]" << std::endl;
   }
@@ -260,4 +260,7 @@ int main (int argc, char **argv) {
   std::cout << std::endl;
 
   def.release(); // so we don't waste time calling delete a bunch of times
+} catch (ParseError &e) {
+  std::cerr << e.what() << "\n";
+  return -1;
 }
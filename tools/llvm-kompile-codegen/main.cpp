@@ -3,6 +3,8 @@
 #include "kllvm/codegen/Debug.h"
 #include "kllvm/codegen/DecisionParser.h"
 #include "kllvm/codegen/EmitConfigParser.h"
+#include "kllvm/codegen/RuleProfile.h"
+#include "kllvm/codegen/Safepoints.h"
 #include "kllvm/parser/KOREScanner.h"
 #include "kllvm/parser/KOREParser.h"
 
@@ -24,13 +26,14 @@ std::string getFilename(std::map<std::string, std::string> index, char **argv, K
   return argv[3] + std::string("/") + index.at(decl->getSymbol()->getName());
 }
 
-int main (int argc, char **argv) {
+int main (int argc, char **argv) try {
   if (argc < 5) {
-    std::cerr << "Usage: llvm-kompile-codegen <def.kore> <dt.yaml> <dir> [1|0]\n";
+    std::cerr << "Usage: llvm-kompile-codegen <def.kore> <dt.yaml> <dir> [1|0] [0|1|2]\n";
     exit(1);
   }
 
   CODEGEN_DEBUG = atoi(argv[4]);
+  CODEGEN_PROFILE = argc > 5 ? atoi(argv[5]) : 0;
 
   KOREParser parser(argv[1]);
   ptr<KOREDefinition> definition = parser.definition();
@@ -47,6 +50,8 @@ int main (int argc, char **argv) {
     addKompiledDirSymbol(Context, dirname(realPath), mod.get());
   }
 
+  initRuleProfile(definition.get(), mod.get());
+
   for (auto axiom : definition->getAxioms()) {
     makeSideConditionFunction(axiom, definition.get(), mod.get());
     if (!axiom->isTopAxiom()) {
@@ -76,6 +81,14 @@ int main (int argc, char **argv) {
   auto dtSearch = parseYamlDecisionTree(mod.get(), argv[3] + std::string("/") + "dt-search.yaml", definition->getAllSymbols(), definition->getHookedSorts());
   makeStepFunction(definition.get(), mod.get(), dtSearch, true);
 
+  std::string searchPatternFile = argv[3] + std::string("/") + "search-pattern.yaml";
+  struct stat searchPatternBuf;
+  DecisionNode *dtSearchPattern = nullptr;
+  if (stat(searchPatternFile.c_str(), &searchPatternBuf) == 0) {
+    dtSearchPattern = parseYamlDecisionTree(mod.get(), searchPatternFile, definition->getAllSymbols(), definition->getHookedSorts());
+  }
+  makeSearchPatternFunction(definition.get(), mod.get(), dtSearchPattern);
+
   std::map<std::string, std::string> index;
 
   std::ifstream in(argv[3] + std::string("/index.txt"));
@@ -104,10 +117,15 @@ int main (int argc, char **argv) {
     }
   }
 
+  addGCSafepoints(mod.get());
+
   if (CODEGEN_DEBUG) {
     finalizeDebugInfo();
   }
 
   mod->print(llvm::outs(), nullptr);
   return 0;
+} catch (ParseError &e) {
+  std::cerr << e.what() << "\n";
+  return -1;
 }
@@ -0,0 +1,381 @@
+#include "kllvm/ast/AST.h"
+#include "runtime/heap_snapshot.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace kllvm;
+
+// Reads a heap snapshot written by an interpreter run with KLLVM_HEAP_SNAPSHOT
+// (see runtime/collect/heap_snapshot.cpp) and reports what holds the memory of
+// the heap. It computes the dominator tree of the object graph, in which an
+// object dominates the objects that it alone keeps alive, and the retained size
+// of each object, which is the number of bytes of the objects it dominates,
+// including itself. It then prints two tab-separated tables, sorted by retained
+// size:
+//
+// * for each symbol and kind of token, the number of objects, the number of
+//   bytes they occupy, and the number of bytes they retain. The objects of a
+//   symbol that are dominated by another object of the same symbol, such as
+//   the tail of a cons list, are not counted twice.
+// * for each configuration cell, the number of its occurrences, the number of
+//   bytes of the objects whose closest dominating cell it is, and the number of
+//   bytes it retains, including those of the cells nested in it.
+
+static const uint32_t NONE = UINT32_MAX;
+
+static const char *KIND_NAMES[HEAP_OBJECT_KINDS] = {
+  "", "[string]", "[integer]", "[float]", "[string buffer]", "[limbs]", "[collection node]"
+};
+
+struct snapshot {
+  std::vector<uint8_t> kinds;
+  std::vector<uint32_t> tags;
+  std::vector<uint64_t> sizes;
+  // the edges of the graph, and the objects referenced by roots.
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  std::vector<uint32_t> roots;
+  std::unordered_map<uint32_t, std::string> symbols;
+};
+
+static FILE *in;
+static const char *filename;
+
+static void truncated(void) {
+  fprintf(stderr, "%s: truncated or invalid heap snapshot\n", filename);
+  exit(1);
+}
+
+static uint64_t get(void) {
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int c = getc_unlocked(in);
+    if (c == EOF) {
+      truncated();
+    }
+    value |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      return value;
+    }
+  }
+  truncated();
+  return 0;
+}
+
+static uint32_t getId(snapshot &s) {
+  uint64_t id = get();
+  if (id >= NONE) {
+    fprintf(stderr, "%s: too many objects\n", filename);
+    exit(1);
+  }
+  if (id >= s.kinds.size()) {
+    s.kinds.resize(id + 1, HEAP_TOKEN);
+    s.tags.resize(id + 1, 0);
+    s.sizes.resize(id + 1, 0);
+  }
+  return id;
+}
+
+static void readSnapshot(snapshot &s) {
+  char magic[sizeof(HEAP_SNAPSHOT_MAGIC) - 1];
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, HEAP_SNAPSHOT_MAGIC, sizeof(magic))) {
+    fprintf(stderr, "%s: not a heap snapshot\n", filename);
+    exit(1);
+  }
+  while (true) {
+    int record = getc_unlocked(in);
+    switch (record) {
+    case HEAP_OBJECT: {
+      uint32_t id = getId(s);
+      s.kinds[id] = get();
+      s.tags[id] = get();
+      s.sizes[id] = get();
+      if (s.kinds[id] >= HEAP_OBJECT_KINDS) {
+        truncated();
+      }
+      for (uint64_t n = get(); n; n--) {
+        uint32_t target = getId(s);
+        s.edges.emplace_back(id, target);
+      }
+      break;
+    }
+    case HEAP_ROOT:
+      get();
+      s.roots.push_back(getId(s));
+      break;
+    case HEAP_SYMBOL: {
+      uint32_t tag = get();
+      std::string name(get(), '\0');
+      if (fread(&name[0], 1, name.size(), in) != name.size()) {
+        truncated();
+      }
+      s.symbols[tag] = name;
+      break;
+    }
+    case HEAP_END:
+      return;
+    default:
+      truncated();
+    }
+  }
+}
+
+// a graph in compressed sparse row form: the neighbours of vertex v are
+// targets[offsets[v]] to targets[offsets[v+1]-1].
+struct graph {
+  std::vector<uint64_t> offsets;
+  std::vector<uint32_t> targets;
+
+  graph(uint32_t n, const std::vector<std::pair<uint32_t, uint32_t>> &edges, bool reverse) : offsets(n + 2, 0), targets(edges.size()) {
+    for (auto &e : edges) {
+      offsets[(reverse ? e.second : e.first) + 2]++;
+    }
+    for (uint32_t v = 2; v < n + 2; v++) {
+      offsets[v] += offsets[v - 1];
+    }
+    for (auto &e : edges) {
+      targets[offsets[(reverse ? e.second : e.first) + 1]++] = reverse ? e.first : e.second;
+    }
+  }
+};
+
+// Computes the immediate dominators of the vertices reachable from root with
+// the algorithm of Lengauer and Tarjan, using path compression only. Returns
+// the vertices in depth-first order, with their immediate dominators given by
+// their index in that order. The root comes first and is its own dominator.
+static void dominators(uint32_t n, uint32_t root, const graph &successors, const graph &predecessors,
+    std::vector<uint32_t> &vertex, std::vector<uint32_t> &idom) {
+  std::vector<uint32_t> number(n, NONE), parent;
+  std::vector<std::pair<uint32_t, uint64_t>> stack;
+  number[root] = 0;
+  vertex.push_back(root);
+  parent.push_back(0);
+  stack.emplace_back(root, successors.offsets[root]);
+  while (!stack.empty()) {
+    uint32_t v = stack.back().first;
+    uint64_t &next = stack.back().second;
+    if (next == successors.offsets[v + 1]) {
+      stack.pop_back();
+      continue;
+    }
+    uint32_t w = successors.targets[next++];
+    if (number[w] == NONE) {
+      number[w] = vertex.size();
+      vertex.push_back(w);
+      parent.push_back(number[v]);
+      stack.emplace_back(w, successors.offsets[w]);
+    }
+  }
+
+  uint32_t count = vertex.size();
+  std::vector<uint32_t> semi(count), label(count), ancestor(count, NONE);
+  std::vector<uint32_t> bucket(count, NONE), nextInBucket(count, NONE), path;
+  idom.assign(count, 0);
+  for (uint32_t i = 0; i < count; i++) {
+    semi[i] = label[i] = i;
+  }
+  auto eval = [&](uint32_t v) {
+    if (ancestor[v] == NONE) {
+      return v;
+    }
+    uint32_t u = v;
+    while (ancestor[ancestor[u]] != NONE) {
+      path.push_back(u);
+      u = ancestor[u];
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+      uint32_t x = *it;
+      if (semi[label[ancestor[x]]] < semi[label[x]]) {
+        label[x] = label[ancestor[x]];
+      }
+      ancestor[x] = ancestor[ancestor[x]];
+    }
+    path.clear();
+    return label[v];
+  };
+  for (uint32_t w = count - 1; w > 0; w--) {
+    uint32_t original = vertex[w];
+    for (uint64_t i = predecessors.offsets[original]; i < predecessors.offsets[original + 1]; i++) {
+      uint32_t v = number[predecessors.targets[i]];
+      if (v != NONE) {
+        semi[w] = std::min(semi[w], semi[eval(v)]);
+      }
+    }
+    nextInBucket[w] = bucket[semi[w]];
+    bucket[semi[w]] = w;
+    uint32_t p = parent[w];
+    ancestor[w] = p;
+    for (uint32_t v = bucket[p]; v != NONE; v = nextInBucket[v]) {
+      uint32_t u = eval(v);
+      idom[v] = semi[u] < semi[v] ? u : p;
+    }
+    bucket[p] = NONE;
+  }
+  for (uint32_t w = 1; w < count; w++) {
+    if (idom[w] != semi[w]) {
+      idom[w] = idom[idom[w]];
+    }
+  }
+}
+
+struct row {
+  std::string name;
+  uint64_t objects, shallow, retained;
+};
+
+static void writeRows(std::vector<row> &rows, const char *header, const char *shallow, size_t limit) {
+  std::sort(rows.begin(), rows.end(), [](const row &a, const row &b) {
+    return a.retained > b.retained;
+  });
+  printf("# %s\tobjects\t%s\tretained\n", header, shallow);
+  for (size_t i = 0; i < rows.size() && i < limit; i++) {
+    printf("%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n", rows[i].name.c_str(), rows[i].objects, rows[i].shallow, rows[i].retained);
+  }
+}
+
+// returns the name of a symbol without its sort parameters and the Lbl prefix
+// of K labels, decoded.
+static std::string symbolName(const std::string &symbol) {
+  std::string name = symbol.substr(0, symbol.find('{'));
+  if (!name.compare(0, 3, "Lbl")) {
+    name = name.substr(3);
+  }
+  return decodeKore(name);
+}
+
+int main (int argc, char **argv) {
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "usage: %s <snapshot> [<rows>]\n", argv[0]);
+    return 1;
+  }
+  filename = argv[1];
+  size_t limit = argc == 3 ? strtoull(argv[2], nullptr, 10) : SIZE_MAX;
+  in = fopen(filename, "rb");
+  if (!in) {
+    perror(filename);
+    return 1;
+  }
+  snapshot s;
+  readSnapshot(s);
+  fclose(in);
+
+  // a virtual root points to the objects referenced by roots.
+  uint32_t n = s.kinds.size();
+  uint32_t root = n;
+  for (uint32_t target : s.roots) {
+    s.edges.emplace_back(root, target);
+  }
+  std::vector<uint32_t> vertex, idom;
+  {
+    graph successors(n + 1, s.edges, false);
+    graph predecessors(n + 1, s.edges, true);
+    s.edges = std::vector<std::pair<uint32_t, uint32_t>>();
+    dominators(n + 1, root, successors, predecessors, vertex, idom);
+  }
+  uint32_t count = vertex.size();
+
+  // the objects are grouped by symbol for terms, and by kind for the others.
+  std::vector<row> classes;
+  std::unordered_map<std::string, uint32_t> classOfName;
+  std::unordered_map<uint32_t, uint32_t> classOfTag;
+  std::vector<bool> isCell;
+  auto classId = [&](const std::string &name) {
+    auto result = classOfName.emplace(name, classes.size());
+    if (result.second) {
+      classes.push_back({name, 0, 0, 0});
+      isCell.push_back(name.size() > 2 && name.front() == '<' && name.back() == '>');
+    }
+    return result.first->second;
+  };
+  for (int kind = 1; kind < HEAP_OBJECT_KINDS; kind++) {
+    classId(KIND_NAMES[kind]);
+  }
+  for (auto &symbol : s.symbols) {
+    classOfTag[symbol.first] = classId(symbolName(symbol.second));
+  }
+  std::vector<uint32_t> classOf(count, NONE);
+  std::vector<uint64_t> retained(count, 0);
+  for (uint32_t i = 1; i < count; i++) {
+    uint32_t v = vertex[i];
+    if (s.kinds[v] == HEAP_TERM) {
+      auto it = classOfTag.find(s.tags[v]);
+      classOf[i] = it != classOfTag.end() ? it->second : classId("tag " + std::to_string(s.tags[v]));
+    } else {
+      classOf[i] = s.kinds[v] - 1;
+    }
+    retained[i] = s.sizes[v];
+    classes[classOf[i]].objects++;
+    classes[classOf[i]].shallow += s.sizes[v];
+  }
+  // the dominators of an object come before it in depth-first order.
+  for (uint32_t i = count - 1; i > 0; i--) {
+    retained[idom[i]] += retained[i];
+  }
+
+  // walks the dominator tree, keeping track of the number of objects of each
+  // class and of the closest cell that dominate the current object.
+  std::vector<uint32_t> firstChild(count, NONE), nextSibling(count, NONE);
+  for (uint32_t i = count - 1; i > 0; i--) {
+    nextSibling[i] = firstChild[idom[i]];
+    firstChild[idom[i]] = i;
+  }
+  std::vector<uint32_t> active(classes.size(), 0);
+  std::vector<uint64_t> cellObjects(classes.size(), 0), cellExclusive(classes.size(), 0);
+  uint64_t outsideCells = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> stack; // the vertex and its closest dominating cell.
+  for (uint32_t child = firstChild[0]; child != NONE; child = nextSibling[child]) {
+    stack.emplace_back(child, NONE);
+  }
+  // exits are pushed as the complement of the vertex.
+  while (!stack.empty()) {
+    uint32_t i = stack.back().first;
+    uint32_t cell = stack.back().second;
+    stack.pop_back();
+    if (i >= count) {
+      active[classOf[~i]]--;
+      continue;
+    }
+    uint32_t c = classOf[i];
+    if (!active[c]++) {
+      classes[c].retained += retained[i];
+    }
+    if (isCell[c]) {
+      cell = c;
+      cellObjects[c]++;
+    }
+    if (cell == NONE) {
+      outsideCells += s.sizes[vertex[i]];
+    } else {
+      cellExclusive[cell] += s.sizes[vertex[i]];
+    }
+    stack.emplace_back(~i, cell);
+    for (uint32_t child = firstChild[i]; child != NONE; child = nextSibling[child]) {
+      stack.emplace_back(child, cell);
+    }
+  }
+
+  printf("# %" PRIu32 " objects, %" PRIu64 " bytes\n\n", count - 1, retained[0]);
+  std::vector<row> cells;
+  for (uint32_t c = 0; c < classes.size(); c++) {
+    if (isCell[c] && cellObjects[c]) {
+      cells.push_back({classes[c].name, cellObjects[c], cellExclusive[c], classes[c].retained});
+    }
+  }
+  classes.erase(std::remove_if(classes.begin(), classes.end(), [](const row &r) {
+    return !r.objects;
+  }), classes.end());
+  writeRows(classes, "symbol", "shallow", limit);
+  printf("\n");
+  if (outsideCells) {
+    cells.push_back({"[outside cells]", 0, outsideCells, outsideCells});
+  }
+  writeRows(cells, "cell", "exclusive", limit);
+  return 0;
+}
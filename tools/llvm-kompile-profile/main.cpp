@@ -0,0 +1,223 @@
+#include "kllvm/ast/AST.h"
+#include "kllvm/parser/KOREScanner.h"
+#include "kllvm/parser/KOREParser.h"
+
+#include "llvm/DebugInfo/Symbolize/Symbolize.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+using namespace kllvm;
+using namespace kllvm::parser;
+
+// Turns the samples written by an interpreter run with KLLVM_PROFILE_SAMPLES
+// (see runtime/collect/sampler.cpp) into collapsed stacks, one line per
+// distinct stack:
+//
+//   <outermost frame>;...;<innermost frame> <number of samples>
+//
+// as read by flamegraph.pl and most other flame graph viewers. The frames of
+// the right-hand side and the side condition of a rule are named after the
+// label and the source location of the rule. In the debug information, they
+// are apply_rule_<ordinal> and side_condition_<ordinal>, or <label>.rhs and
+// <label>.sc if the rule has a label. The frames of eval_<symbol> are named
+// after the K symbol, and the garbage collector is split into its phases.
+
+struct mapping {
+  uint64_t bias, end;
+  std::string path;
+};
+
+static const char *GC_PHASES[] = {"", "[gc roots]", "[gc evacuate]", "[gc sweep]"};
+
+static KOREDefinition *definition;
+// the ordinals of the labelled axioms of the definition, by label.
+static std::map<std::string, unsigned long> labels;
+
+static std::string stringAttribute(KOREAxiomDeclaration *axiom, const std::string &name) {
+  return axiom->getAttributes().count(name) ? axiom->getStringAttribute(name) : "";
+}
+
+// names a rule after its label and source location, taken from the
+// definition if one was given, or from the debug information otherwise.
+static std::string ruleName(unsigned long ordinal, const llvm::DILineInfo &info) {
+  std::string label, location;
+  if (definition) {
+    KOREAxiomDeclaration *axiom = definition->getAxiomByOrdinal(ordinal);
+    label = stringAttribute(axiom, "label");
+    std::string source = stringAttribute(axiom, "org'Stop'kframework'Stop'attributes'Stop'Source");
+    std::string loc = stringAttribute(axiom, "org'Stop'kframework'Stop'attributes'Stop'Location");
+    if (source.size() >= 8 && loc.size() >= 10) {
+      size_t first_comma = loc.find_first_of(',');
+      location = source.substr(7, source.length() - 8) + ":" + loc.substr(9, first_comma - 9);
+    }
+  } else if (info.Line) {
+    location = info.FileName + ":" + std::to_string(info.Line);
+  }
+  std::string name = "rule " + (label.empty() ? std::to_string(ordinal) : label);
+  return location.empty() ? name : name + " (" + location + ")";
+}
+
+// names a rule that the debug information gives by its label.
+static std::string labelledRuleName(const std::string &label, const llvm::DILineInfo &info) {
+  auto ordinal = labels.find(label);
+  if (ordinal != labels.end()) {
+    return ruleName(ordinal->second, info);
+  }
+  std::string name = "rule " + label;
+  return info.Line ? name + " (" + info.FileName + ":" + std::to_string(info.Line) + ")" : name;
+}
+
+static bool endsWith(const std::string &s, const std::string &suffix) {
+  return s.size() > suffix.size() && !s.compare(s.size() - suffix.size(), suffix.size(), suffix);
+}
+
+static std::string frameName(const llvm::DILineInfo &info) {
+  const std::string &function = info.FunctionName;
+  if (endsWith(function, ".rhs")) {
+    return labelledRuleName(function.substr(0, function.size() - 4), info);
+  }
+  if (endsWith(function, ".sc")) {
+    return "side condition of " + labelledRuleName(function.substr(0, function.size() - 3), info);
+  }
+  if (!function.compare(0, 11, "apply_rule_")) {
+    return ruleName(std::stoul(function.substr(11)), info);
+  }
+  if (!function.compare(0, 15, "side_condition_")) {
+    return "side condition of " + ruleName(std::stoul(function.substr(15)), info);
+  }
+  if (!function.compare(0, 8, "eval_Lbl")) {
+    return "function " + decodeKore(function.substr(8, function.find('{') - 8));
+  }
+  return function;
+}
+
+// returns the names of the frames of the code at an address, with the
+// functions inlined into each other from the outermost to the innermost.
+static std::vector<std::string> symbolize(llvm::symbolize::LLVMSymbolizer &symbolizer, const std::map<uint64_t, mapping> &mappings, uint64_t address) {
+  char hex[32];
+  snprintf(hex, sizeof(hex), "0x%llx", (unsigned long long)address);
+  auto it = mappings.upper_bound(address);
+  if (it == mappings.begin() || (--it, address >= it->second.end)) {
+    return {hex};
+  }
+  uint64_t offset = address - it->second.bias;
+#if __clang_major__ >= 9
+  auto frames = symbolizer.symbolizeInlinedCode(it->second.path, {offset, llvm::object::SectionedAddress::UndefSection});
+#else
+  auto frames = symbolizer.symbolizeInlinedCode(it->second.path, offset);
+#endif
+  std::vector<std::string> result;
+  if (frames) {
+    for (int i = frames->getNumberOfFrames() - 1; i >= 0; i--) {
+      const llvm::DILineInfo &info = frames->getFrame(i);
+      if (info.FunctionName != llvm::DILineInfo::BadString) {
+        result.push_back(frameName(info));
+      }
+    }
+  } else {
+    llvm::consumeError(frames.takeError());
+  }
+  if (result.empty()) {
+    result.push_back(hex);
+  }
+  return result;
+}
+
+int main (int argc, char **argv) try {
+  if (argc != 2 && argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <samples> [<definition.kore>]" << std::endl;
+    return 1;
+  }
+  ptr<KOREDefinition> def;
+  if (argc == 3) {
+    KOREParser parser(argv[2]);
+    def = parser.definition();
+    def->preprocess();
+    definition = def.get();
+    for (KOREAxiomDeclaration *axiom : definition->getAxioms()) {
+      std::string label = stringAttribute(axiom, "label");
+      if (!label.empty()) {
+        labels[label] = axiom->getOrdinal();
+      }
+    }
+  }
+
+  std::ifstream in(argv[1]);
+  if (!in) {
+    std::cerr << argv[1] << ": cannot open file" << std::endl;
+    return 1;
+  }
+  // the mappings by start address, and the samples by phase and stack.
+  std::map<uint64_t, mapping> mappings;
+  std::map<std::vector<uint64_t>, uint64_t> samples;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string kind;
+    fields >> kind;
+    if (kind == "m") {
+      uint64_t start;
+      mapping m;
+      fields >> std::hex >> m.bias >> start >> m.end >> std::ws;
+      std::getline(fields, m.path);
+      mappings[start] = m;
+    } else if (kind == "s") {
+      std::vector<uint64_t> sample;
+      uint64_t value;
+      while (fields >> std::hex >> value) {
+        sample.push_back(value);
+      }
+      if (sample.size() >= 2) {
+        samples[sample]++;
+      }
+    }
+  }
+
+  llvm::symbolize::LLVMSymbolizer symbolizer;
+  std::map<uint64_t, std::vector<std::string>> names;
+  std::map<std::string, uint64_t> stacks;
+  for (auto &sample : samples) {
+    const std::vector<uint64_t> &s = sample.first;
+    std::vector<std::string> stack;
+    for (size_t i = s.size() - 1; i >= 1; i--) {
+      // return addresses point after the call, which may be the first
+      // instruction of the next line or function.
+      uint64_t address = i == 1 ? s[i] : s[i] - 1;
+      if (!names.count(address)) {
+        names[address] = symbolize(symbolizer, mappings, address);
+      }
+      stack.insert(stack.end(), names[address].begin(), names[address].end());
+    }
+    uint64_t phase = s[0];
+    if (phase && phase < sizeof(GC_PHASES) / sizeof(GC_PHASES[0])) {
+      // the phase goes right above the collector, or on top if the stack was
+      // cut short before reaching it.
+      auto collect = std::find(stack.rbegin(), stack.rend(), "koreCollect");
+      stack.insert(collect == stack.rend() ? stack.end() : collect.base(), GC_PHASES[phase]);
+    }
+    std::string collapsed;
+    for (auto &frame : stack) {
+      if (!collapsed.empty()) {
+        collapsed += ';';
+      }
+      for (char c : frame) {
+        // semicolons separate the frames.
+        collapsed += c == ';' ? ',' : c;
+      }
+    }
+    stacks[collapsed] += sample.second;
+  }
+  for (auto &stack : stacks) {
+    std::cout << stack.first << " " << stack.second << "\n";
+  }
+
+  def.release(); // so we don't waste time calling delete a bunch of times
+} catch (ParseError &e) {
+  std::cerr << e.what() << "\n";
+  return -1;
+}
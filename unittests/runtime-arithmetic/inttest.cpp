@@ -618,4 +618,50 @@ BOOST_AUTO_TEST_CASE(rand) {
   BOOST_CHECK_EQUAL(mpz_cmp_ui(result, 59), 0);
 }
 
+BOOST_AUTO_TEST_CASE(small) {
+  mpz_ptr result;
+  mpz_t expected;
+  mpz_init(expected);
+  result = hook_INT_sub(make_small_int(3), make_small_int(10));
+  BOOST_CHECK(is_small_int(result));
+  BOOST_CHECK_EQUAL(small_int_value(result), -7);
+  result = hook_INT_add(make_small_int(SMALL_INT_MAX), make_small_int(1));
+  BOOST_CHECK(!is_small_int(result));
+  mpz_set_si(expected, SMALL_INT_MAX);
+  mpz_add_ui(expected, expected, 1);
+  BOOST_CHECK_EQUAL(mpz_cmp(result, expected), 0);
+  mpz_clear(result);
+  free(result);
+  result = hook_INT_mul(make_small_int(1LL << 40), make_small_int(-(1LL << 40)));
+  BOOST_CHECK(!is_small_int(result));
+  mpz_set_si(expected, -1);
+  mpz_mul_2exp(expected, expected, 80);
+  BOOST_CHECK_EQUAL(mpz_cmp(result, expected), 0);
+  mpz_clear(result);
+  free(result);
+  result = hook_INT_tdiv(make_small_int(SMALL_INT_MIN), make_small_int(-1));
+  BOOST_CHECK(!is_small_int(result));
+  mpz_set_si(expected, SMALL_INT_MIN);
+  mpz_neg(expected, expected);
+  BOOST_CHECK_EQUAL(mpz_cmp(result, expected), 0);
+  mpz_clear(result);
+  free(result);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_ediv(make_small_int(-7), make_small_int(3))), -3);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_emod(make_small_int(-7), make_small_int(3))), 2);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_ediv(make_small_int(-7), make_small_int(-3))), 3);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_emod(make_small_int(-7), make_small_int(-3))), 2);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_ediv(make_small_int(7), make_small_int(-3))), -2);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_emod(make_small_int(7), make_small_int(-3))), 1);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_shr(make_small_int(-5), make_small_int(1))), -3);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_shr(make_small_int(-5), make_small_int(100))), -1);
+  BOOST_CHECK_EQUAL(small_int_value(hook_INT_shl(make_small_int(3), make_small_int(4))), 48);
+  BOOST_CHECK_THROW(hook_INT_tmod(make_small_int(1), make_small_int(0)), std::invalid_argument);
+  mpz_set_si(expected, 42);
+  BOOST_CHECK(hook_INT_eq(make_small_int(42), expected));
+  BOOST_CHECK(hook_INT_eq(expected, make_small_int(42)));
+  BOOST_CHECK(hook_INT_lt(make_small_int(41), expected));
+  BOOST_CHECK(!hook_INT_lt(expected, make_small_int(-43)));
+  mpz_clear(expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,261 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "runtime/collect.h"
+#include "runtime/header.h"
+#include "runtime/kllvm-c.h"
+
+// A stand-in for the code that llvm-kompile generates for a definition with
+// a few constant symbols. Rewriting Lblfoo{}() takes no steps. Rewriting
+// Lblstuck{}() gets stuck in a function, and rewriting Lblparse{}() applies
+// #parseKORE to a malformed pattern. Both do so with safepoints inhibited, as
+// in the generated code. Lblcount<n>{}() rewrites to Lblcount<n-1>{}() until
+// Lblcount0{}(), in which no rule applies.
+extern "C" {
+
+#define COUNT_TAG 3
+#define NUM_SYMBOLS 11
+  const char *symbols[NUM_SYMBOLS] = {"Lblfoo{}", "Lblstuck{}", "Lblparse{}",
+      "Lblcount0{}", "Lblcount1{}", "Lblcount2{}", "Lblcount3{}", "Lblcount4{}",
+      "Lblcount5{}", "Lblcount6{}", "Lblcount7{}"};
+
+  const char **sort_table[NUM_SYMBOLS] = {};
+  const uint32_t first_inj_tag = NUM_SYMBOLS, last_inj_tag = 0;
+
+  static thread_local uint64_t steps = 0;
+  static thread_local uint64_t stepsTaken = 0;
+  static thread_local void (*stuckHandler)(block *) = nullptr;
+
+  block *hook_KREFLECTION_parseKORE(SortString kore);
+  string *makeString(const char *, int64_t len = -1);
+
+  uint32_t getTagForSymbolNameInternal(const char *s) {
+    for (uint32_t i = 0; i < NUM_SYMBOLS; i++) {
+      if (0 == strcmp(symbols[i], s)) {
+        return i;
+      }
+    }
+    return NUM_SYMBOLS;
+  }
+
+  const char *getSymbolNameForTag(uint32_t tag) {
+    return symbols[tag];
+  }
+
+  struct blockheader getBlockHeaderForSymbol(uint32_t tag) {
+    return blockheader {tag};
+  }
+
+  bool isSymbolAFunction(uint32_t) {
+    return false;
+  }
+
+  bool isSymbolABinder(uint32_t) {
+    return false;
+  }
+
+  void storeSymbolChildren(block *, void *[]) {}
+
+  void *evaluateFunctionSymbol(uint32_t, void *[]) {
+    abort();
+  }
+
+  void *getToken(const char *, uint64_t, const char *) {
+    abort();
+  }
+
+  layout *getLayoutData(uint16_t) {
+    return nullptr;
+  }
+
+  uint32_t getInjectionForSortOfTag(uint32_t) {
+    abort();
+  }
+
+  void visitChildren(block *, writer *,
+      void visitConfig(writer *, block *, const char *, bool),
+      void visitMap(writer *, map *, const char *, const char *, const char *),
+      void visitList(writer *, list *, const char *, const char *, const char *),
+      void visitSet(writer *, set *, const char *, const char *, const char *),
+      void visitInt(writer *, mpz_t, const char *),
+      void visitFloat(writer *, floating *, const char *),
+      void visitBool(writer *, bool, const char *),
+      void visitStringBuffer(writer *, stringbuffer *, const char *),
+      void visitMInt(writer *, size_t *, size_t, const char *),
+      void visitSeparator(writer *)) {}
+
+  bool hook_KEQUAL_eq(block *lhs, block *rhs) {
+    return lhs == rhs;
+  }
+
+  mpz_ptr move_int(mpz_t i) {
+    mpz_ptr result = (mpz_ptr)malloc(sizeof(__mpz_struct));
+    *result = *i;
+    return result;
+  }
+
+  floating *move_float(floating *i) {
+    floating *result = (floating *)malloc(sizeof(floating));
+    *result = *i;
+    return result;
+  }
+
+  void set_gc_threshold(uint64_t) {}
+
+  uint64_t get_gc_threshold(void) {
+    return 0;
+  }
+
+  uint64_t get_steps(void) {
+    return steps;
+  }
+
+  uint64_t get_steps_taken(void) {
+    return stepsTaken;
+  }
+
+  void set_stuck_in_function_handler(void (*handler)(block *)) {
+    stuckHandler = handler;
+  }
+
+  void initStaticObjects(void) {}
+
+  block *take_steps(int64_t depth, block *subject) {
+    uint32_t tag = ((uintptr_t)subject) >> 32;
+    stepsTaken = 0;
+    if (tag >= COUNT_TAG) {
+      for (; tag > COUNT_TAG && depth != 0; tag--, depth--) {
+        steps++;
+        stepsTaken++;
+      }
+      subject = leaf_block(tag);
+    }
+    // the check that stops rewriting.
+    steps++;
+    if (tag == 0 || tag >= COUNT_TAG) {
+      return subject;
+    }
+    gc_safepoint_inhibit++;
+    if (tag == 1) {
+      if (stuckHandler) {
+        stuckHandler(subject);
+      }
+      abort();
+    }
+    return hook_KREFLECTION_parseKORE(makeString("Lblfoo{}("));
+  }
+
+  int32_t get_exit_code(block *subject) {
+    return ((uintptr_t)subject) >> 32;
+  }
+}
+
+static kllvm_status load(const char *pattern) {
+  return kllvm_load(pattern, strlen(pattern));
+}
+
+static std::string lastError() {
+  return kllvm_last_error();
+}
+
+struct CApiTestFixture {
+  CApiTestFixture() {
+    BOOST_REQUIRE_EQUAL(kllvm_init(), KLLVM_OK);
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(CApiTest, CApiTestFixture)
+
+BOOST_AUTO_TEST_CASE(step) {
+  BOOST_CHECK_EQUAL(load("Lblfoo{}()"), KLLVM_OK);
+  int64_t taken = -1;
+  BOOST_CHECK_EQUAL(kllvm_step(-1, &taken), KLLVM_OK);
+  BOOST_CHECK_EQUAL(taken, 0);
+  BOOST_CHECK(kllvm_is_stuck());
+  char *data;
+  size_t size;
+  BOOST_CHECK_EQUAL(kllvm_get_kore(&data, &size), KLLVM_OK);
+  BOOST_CHECK_EQUAL(std::string(data, size), "Lblfoo{}()");
+  free(data);
+  int32_t exitCode = -1;
+  BOOST_CHECK_EQUAL(kllvm_get_exit_code(&exitCode), KLLVM_OK);
+  BOOST_CHECK_EQUAL(exitCode, 0);
+}
+
+// stepping a configuration a bounded number of steps at a time reaches the
+// same configuration, in the same number of steps, as an unbounded step.
+BOOST_AUTO_TEST_CASE(step_bounded) {
+  BOOST_CHECK_EQUAL(load("Lblcount7{}()"), KLLVM_OK);
+  int64_t taken = -1;
+  BOOST_CHECK_EQUAL(kllvm_step(-1, &taken), KLLVM_OK);
+  BOOST_CHECK_EQUAL(taken, 7);
+  BOOST_CHECK(kllvm_is_stuck());
+  char *data;
+  size_t size;
+  BOOST_CHECK_EQUAL(kllvm_get_kore(&data, &size), KLLVM_OK);
+  std::string unbounded(data, size);
+  free(data);
+  BOOST_CHECK_EQUAL(unbounded, "Lblcount0{}()");
+
+  for (int64_t n = 1; n <= 8; n++) {
+    BOOST_CHECK_EQUAL(load("Lblcount7{}()"), KLLVM_OK);
+    int64_t total = 0;
+    int calls = 0;
+    while (!kllvm_is_stuck() && calls++ < 16) {
+      BOOST_CHECK_EQUAL(kllvm_step(n, &taken), KLLVM_OK);
+      BOOST_CHECK_LE(taken, n);
+      total += taken;
+    }
+    BOOST_CHECK(kllvm_is_stuck());
+    BOOST_CHECK_EQUAL(total, 7);
+    BOOST_CHECK_EQUAL(kllvm_get_kore(&data, &size), KLLVM_OK);
+    BOOST_CHECK_EQUAL(std::string(data, size), unbounded);
+    free(data);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(malformed) {
+  BOOST_CHECK_EQUAL(load("Lblfoo{}("), KLLVM_ERROR_PARSE);
+  BOOST_CHECK(!lastError().empty());
+  BOOST_CHECK_EQUAL(kllvm_step(-1, nullptr), KLLVM_ERROR_NO_CONFIGURATION);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_in_hook) {
+  uint64_t inhibit = gc_safepoint_inhibit;
+  BOOST_CHECK_EQUAL(load("Lblparse{}()"), KLLVM_OK);
+  BOOST_CHECK_EQUAL(kllvm_step(-1, nullptr), KLLVM_ERROR_PARSE);
+  BOOST_CHECK(!lastError().empty());
+  BOOST_CHECK_EQUAL(gc_safepoint_inhibit, inhibit);
+  BOOST_CHECK_EQUAL(kllvm_step(-1, nullptr), KLLVM_ERROR_NO_CONFIGURATION);
+}
+
+BOOST_AUTO_TEST_CASE(stuck_function) {
+  uint64_t inhibit = gc_safepoint_inhibit;
+  BOOST_CHECK_EQUAL(load("Lblstuck{}()"), KLLVM_OK);
+  BOOST_CHECK_EQUAL(kllvm_step(-1, nullptr), KLLVM_ERROR_STUCK_FUNCTION);
+  BOOST_CHECK_EQUAL(lastError(), "Stuck in function: Lblstuck{}()");
+  BOOST_CHECK_EQUAL(gc_safepoint_inhibit, inhibit);
+  BOOST_CHECK(!kllvm_is_stuck());
+  BOOST_CHECK_EQUAL(kllvm_step(-1, nullptr), KLLVM_ERROR_NO_CONFIGURATION);
+}
+
+static void hostStuckHandler(block *) {
+  throw std::runtime_error("stuck in the host");
+}
+
+BOOST_AUTO_TEST_CASE(host_stuck_handler) {
+  set_stuck_in_function_handler(hostStuckHandler);
+  uint64_t inhibit = gc_safepoint_inhibit;
+  BOOST_CHECK_EQUAL(load("Lblstuck{}()"), KLLVM_OK);
+  BOOST_CHECK_EQUAL(kllvm_step(-1, nullptr), KLLVM_ERROR_HOOK);
+  BOOST_CHECK_EQUAL(lastError(), "stuck in the host");
+  BOOST_CHECK_EQUAL(gc_safepoint_inhibit, inhibit);
+  BOOST_CHECK_EQUAL(kllvm_step(-1, nullptr), KLLVM_ERROR_NO_CONFIGURATION);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,113 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "runtime/search_network.h"
+
+static const unsigned PROCESSES = 4;
+
+static std::vector<std::string> addresses(const std::string &dir) {
+  std::vector<std::string> result;
+  for (unsigned i = 0; i < PROCESSES; i++) {
+    result.push_back("unix:" + dir + "/" + std::to_string(i));
+  }
+  return result;
+}
+
+// Each message carries a number. A process receiving n > 0 sends n - 1 to two
+// other processes, so that process 0 starting a tree of depth 8 at every other
+// process leads to 511 messages per tree. If endless is set, the numbers never
+// decrease, and process 0 stops the search once it has received 100 messages.
+// Returns the number of messages received by each process at process 0.
+static std::vector<uint64_t> run(const std::vector<std::string> &addresses, unsigned self, bool endless) {
+  search_network network(addresses, self);
+  uint64_t received = 0;
+  auto forward = [&](uint8_t n) {
+    for (unsigned k = 1; k <= 2; k++) {
+      unsigned to = (self + k + n) % network.size();
+      if (to == self) {
+        to = (to + 1) % network.size();
+      }
+      network.send(to, 0, std::string(1, endless ? n : n - 1));
+    }
+  };
+  if (self == 0) {
+    for (unsigned j = 1; j < network.size(); j++) {
+      network.send(j, 0, std::string(1, 8));
+    }
+  }
+  std::vector<uint8_t> pending;
+  auto deliver = [&](unsigned, uint8_t, std::string &payload) {
+    received++;
+    pending.push_back(payload[0]);
+  };
+  while (network.poll(pending.empty(), deliver)) {
+    if (!pending.empty()) {
+      uint8_t n = pending.back();
+      pending.pop_back();
+      if (n > 0) {
+        forward(n);
+      }
+    }
+    if (endless && self == 0 && received >= 100) {
+      network.stop();
+    }
+  }
+  std::vector<std::string> counts = network.gather(std::to_string(received));
+  std::vector<uint64_t> result;
+  for (auto &c : counts) {
+    result.push_back(std::stoull(c));
+  }
+  return result;
+}
+
+// runs the processes after 0 in child processes and process 0 in this one.
+static std::vector<uint64_t> runAll(bool endless) {
+  const char *env = getenv("TMPDIR");
+  std::string dir = std::string(env ? env : "/tmp") + "/kllvm-network.XXXXXX";
+  BOOST_REQUIRE(mkdtemp(&dir[0]));
+  std::vector<pid_t> children;
+  for (unsigned i = 1; i < PROCESSES; i++) {
+    pid_t pid = fork();
+    BOOST_REQUIRE(pid >= 0);
+    if (pid == 0) {
+      run(addresses(dir), i, endless);
+      _exit(0);
+    }
+    children.push_back(pid);
+  }
+  std::vector<uint64_t> counts = run(addresses(dir), 0, endless);
+  for (pid_t pid : children) {
+    int status;
+    BOOST_CHECK_EQUAL(waitpid(pid, &status, 0), pid);
+    BOOST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  rmdir(dir.c_str());
+  return counts;
+}
+
+BOOST_AUTO_TEST_SUITE(SearchNetworkTest)
+
+  BOOST_AUTO_TEST_CASE(terminates) {
+    std::vector<uint64_t> counts = runAll(false);
+    BOOST_CHECK_EQUAL(counts.size(), PROCESSES);
+    uint64_t total = 0;
+    for (uint64_t c : counts) {
+      total += c;
+    }
+    BOOST_CHECK_EQUAL(total, (PROCESSES - 1) * 511);
+  }
+
+  BOOST_AUTO_TEST_CASE(stops) {
+    std::vector<uint64_t> counts = runAll(true);
+    BOOST_CHECK_EQUAL(counts.size(), PROCESSES);
+    BOOST_CHECK_GE(counts[0], 100);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
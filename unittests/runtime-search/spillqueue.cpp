@@ -0,0 +1,98 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <string>
+
+#include "runtime/spill_queue.h"
+
+// a string of a length that varies with i, so that records straddle the ends
+// of segments.
+static std::string record(size_t i) {
+  return std::to_string(i) + std::string(i % 200, 'a' + i % 26);
+}
+
+static std::string tmpdir() {
+  const char *env = getenv("TMPDIR");
+  return env ? env : "/tmp";
+}
+
+BOOST_AUTO_TEST_SUITE(SpillQueueTest)
+
+  BOOST_AUTO_TEST_CASE(in_memory) {
+    spill_budget budget{1024 * 1024, 0};
+    spill_queue queue(&budget, tmpdir());
+    std::string result;
+    BOOST_CHECK(!queue.pop(result));
+    for (size_t i = 0; i < 1000; i++) {
+      queue.push(record(i));
+    }
+    BOOST_CHECK_EQUAL(queue.size(), 1000);
+    BOOST_CHECK_EQUAL(queue.segmentFiles(), 0);
+    for (size_t i = 0; i < 1000; i++) {
+      BOOST_CHECK(queue.pop(result));
+      BOOST_CHECK_EQUAL(result, record(i));
+    }
+    BOOST_CHECK(queue.empty());
+    BOOST_CHECK_EQUAL(budget.used, 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(spills) {
+    spill_budget budget{4096, 0};
+    spill_queue queue(&budget, tmpdir(), 64 * 1024);
+    for (size_t i = 0; i < 100000; i++) {
+      queue.push(record(i));
+      BOOST_REQUIRE(budget.used <= budget.limit);
+    }
+    BOOST_CHECK(queue.segmentFiles() > 100);
+    std::string result;
+    for (size_t i = 0; i < 100000; i++) {
+      BOOST_REQUIRE(queue.pop(result));
+      BOOST_REQUIRE_EQUAL(result, record(i));
+    }
+    BOOST_CHECK(!queue.pop(result));
+    BOOST_CHECK_EQUAL(budget.used, 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(record_larger_than_segment) {
+    spill_budget budget{0, 0};
+    spill_queue queue(&budget, tmpdir(), 16);
+    std::string big(100000, 'x');
+    queue.push("small");
+    queue.push(big);
+    queue.push("");
+    std::string result;
+    BOOST_CHECK(queue.pop(result));
+    BOOST_CHECK_EQUAL(result, "small");
+    BOOST_CHECK(queue.pop(result));
+    BOOST_CHECK(result == big);
+    BOOST_CHECK(queue.pop(result));
+    BOOST_CHECK_EQUAL(result, "");
+    BOOST_CHECK(queue.empty());
+  }
+
+  // a breadth-first search of the graph in which i has successors 2i + 1 and
+  // 2i + 2, with two queues sharing a budget far smaller than a level, visits
+  // every node in order.
+  BOOST_AUTO_TEST_CASE(breadth_first) {
+    spill_budget budget{2048, 0};
+    spill_queue level(&budget, tmpdir(), 8192), nextLevel(&budget, tmpdir(), 8192);
+    const size_t nodes = 1 << 17;
+    level.push(record(0));
+    size_t expected = 0;
+    std::string state;
+    while (!level.empty()) {
+      while (level.pop(state)) {
+        BOOST_REQUIRE_EQUAL(state, record(expected));
+        size_t i = expected++;
+        for (size_t j = 2 * i + 1; j <= 2 * i + 2 && j < nodes - 1; j++) {
+          nextLevel.push(record(j));
+        }
+        BOOST_REQUIRE(budget.used <= budget.limit);
+      }
+      level.swap(nextLevel);
+    }
+    BOOST_CHECK_EQUAL(expected, nodes - 1);
+    BOOST_CHECK(level.segmentFiles() + nextLevel.segmentFiles() > 0);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()